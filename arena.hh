@@ -0,0 +1,70 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_ARENA_HH
+#define POF_ARENA_HH
+
+#include <atomic>
+#include <memory_resource>
+#include <new>
+
+#include "pof.hh"
+
+//
+// Forwards to an upstream resource and counts the allocations it serves:
+//
+struct counting_resource_t : pmr::memory_resource {
+    explicit counting_resource_t (
+        pmr::memory_resource* upstream = pmr::get_default_resource ())
+        : upstream (upstream)
+        { }
+
+    atomic< size_t > allocations{ }, deallocations{ }, bytes{ };
+
+private:
+    void* do_allocate (size_t n, size_t alignment) override {
+        ++allocations;
+        bytes += n;
+
+        return upstream->allocate (n, alignment);
+    }
+
+    void do_deallocate (void* p, size_t n, size_t alignment) override {
+        ++deallocations;
+        upstream->deallocate (p, n, alignment);
+    }
+
+    bool do_is_equal (const pmr::memory_resource& other) const noexcept
+        override {
+        return this == &other;
+    }
+
+private:
+    pmr::memory_resource* upstream;
+};
+
+//
+// A model living, with everything it owns, in a monotonic arena. The model is
+// never destroyed: its memory is released all at once, with the arena, in a
+// handful of deallocations regardless of the size of the model:
+//
+struct pof_arena_t {
+    explicit pof_arena_t (
+        size_t initial_size = 64 << 10,
+        pmr::memory_resource* upstream = pmr::get_default_resource ())
+        : resource (initial_size, upstream),
+          pof (new (resource.allocate (sizeof (pof_t), alignof (pof_t)))
+               pof_t (&resource))
+        { }
+
+    pof_arena_t (const pof_arena_t&) = delete;
+    pof_arena_t& operator= (const pof_arena_t&) = delete;
+
+    pof_t& operator* () const { return *pof; }
+    pof_t* operator-> () const { return pof; }
+
+private:
+    pmr::monotonic_buffer_resource resource;
+    pof_t* pof;
+};
+
+#endif // POF_ARENA_HH
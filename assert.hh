@@ -0,0 +1,15 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_ASSERT_HH
+#define POF_ASSERT_HH
+
+#ifdef NDEBUG
+#  define BOOST_DISABLE_ASSERTS
+#  define ASSERT(x) x
+#else
+#  define ASSERT BOOST_ASSERT
+#endif // NDEBUG
+
+#include <boost/assert.hpp>
+
+#endif // POF_ASSERT_HH
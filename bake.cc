@@ -0,0 +1,422 @@
+// -*- mode: c++; -*-
+
+#define BOOST_LOG_DYN_LINK 1
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+#include "bake.hh"
+#include "log.hh"
+
+#define BAKED_MAGIC       'PBAK'
+#define BAKED_BYTE_ORDER  0x01020304
+#define BAKED_ALIGNMENT   16
+
+using baked_header_t = baked_pof_t::header_t;
+
+//
+// Size of an element of each section, in section order:
+//
+static const size_t baked_strides [] = {
+    sizeof (vector3f_t), sizeof (vector3f_t), sizeof (int),
+
+    sizeof (int), sizeof (int), sizeof (int), sizeof (vector3f_t),
+    sizeof (vector3f_t), sizeof (float), sizeof (int), sizeof (int),
+    sizeof (int), sizeof (float), sizeof (float),
+
+    sizeof (baked_subobj_t), sizeof (int), sizeof (int),
+    sizeof (pof_t::box_t), sizeof (pof_t::cross_section_t),
+    sizeof (pof_t::light_t), sizeof (pof_t::eye_t), sizeof (baked_string_t),
+    sizeof (vertex3f_t), sizeof (pof_t::shield_t::face_t),
+    sizeof (pof_t::weapon_t),
+    sizeof (baked_dock_t), sizeof (int), sizeof (vector3f_t),
+    sizeof (vector3f_t),
+
+    sizeof (char)
+};
+
+static_assert (
+    sizeof baked_strides / sizeof *baked_strides == baked_pof_t::SECTIONS,
+    "a stride for each section");
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw runtime_error (what);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+baked_pof_t::baked_pof_t (const char* filename)
+    : file (filename), hdr{ } {
+    ensure (file.size >= sizeof (header_t), "baked: file too small");
+
+    hdr = reinterpret_cast< const header_t* > (file.data);
+
+    ensure (BAKED_MAGIC == hdr->magic, "baked: not a baked model");
+    ensure (BAKED_VERSION == hdr->version, "baked: version mismatch");
+    ensure (BAKED_BYTE_ORDER == hdr->byte_order, "baked: byte order mismatch");
+    ensure (file.size == hdr->size, "baked: size mismatch");
+
+    for (size_t i = 0; i < SECTIONS; ++i) {
+        const auto& s = hdr->sections [i];
+
+        ensure (baked_strides [i] == s.stride, "baked: stride mismatch");
+        ensure (0 == s.offset % BAKED_ALIGNMENT, "baked: misaligned section");
+
+        ensure (s.offset >= sizeof (header_t) && s.offset <= file.size &&
+                s.count <= (file.size - s.offset) / s.stride,
+                "baked: section out of range");
+    }
+
+    polys_ = {
+        section< int > (POLY_TYPE), section< int > (POLY_COLOR),
+        section< int > (POLY_SUBOBJ),
+        section< vector3f_t > (POLY_CENTER),
+        section< vector3f_t > (POLY_NORMAL),
+        section< float > (POLY_RADIUS),
+        section< int > (POLY_OFFSETS), section< int > (POLY_VERTICES),
+        section< int > (POLY_NORMALS),
+        section< float > (POLY_U), section< float > (POLY_V)
+    };
+
+    //
+    // The structure of the arrays is checked, offsets and ranges, but not
+    // the indices they hold; those are what the baker wrote:
+    //
+    const size_t n = polys_.size (), m = polys_.corners ();
+
+    ensure (n == polys_.color.size () && n == polys_.subobj_index.size () &&
+            n == polys_.center.size () && n == polys_.normal.size () &&
+            n == polys_.radius.size () && n + 1 == polys_.offsets.size (),
+            "baked: polygon arrays mismatch");
+
+    ensure (m == polys_.normals.size () && m == polys_.u.size () &&
+            m == polys_.v.size (), "baked: corner arrays mismatch");
+
+    ensure (0 == polys_.offsets [0] && m == size_t (polys_.offsets [n]),
+            "baked: polygon offsets out of range");
+
+    for (size_t i = 0; i < n; ++i)
+        ensure (polys_.offsets [i] <= polys_.offsets [i + 1],
+                "baked: polygon offsets out of order");
+
+    const auto strings = section< char > (STRINGS);
+
+    auto check_string = [&](const baked_string_t& s) {
+        ensure (s.offset < strings.size () &&
+                s.size < strings.size () - s.offset &&
+                0 == strings [s.offset + s.size],
+                "baked: string out of range");
+    };
+
+    auto check_range = [&](int i, const baked_range_t& r) {
+        ensure (r.first <= r.last && r.last <= hdr->sections [i].count,
+                "baked: range out of bounds");
+    };
+
+    for (const auto& subobj : subobjs ()) {
+        check_string (subobj.name);
+        check_string (subobj.properties);
+    }
+
+    for (const auto& texture : textures ())
+        check_string (texture);
+
+    ensure (section< vector3f_t > (DOCK_POS).size () ==
+            section< vector3f_t > (DOCK_NORMALS).size (),
+            "baked: dock arrays mismatch");
+
+    for (const auto& dock : docks ()) {
+        check_string (dock.properties);
+        check_range (DOCK_SPLINES, dock.splines);
+        check_range (DOCK_POS, dock.points);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+uint64_t
+content_hash (const char* p, size_t n) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ n, w;
+
+    auto mix = [&h](uint64_t w) {
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    };
+
+    for (; n >= sizeof w; p += sizeof w, n -= sizeof w)
+        memcpy (&w, p, sizeof w), mix (w);
+
+    if (n)
+        w = 0, memcpy (&w, p, n), mix (w);
+
+    return h;
+}
+
+namespace {
+
+//
+// Lays out the sections one after the other, each aligned, after a header
+// that is filled in as they are written:
+//
+struct baker_t {
+    vector< char > buf;
+    vector< char > strings;
+
+    baker_t () : buf (sizeof (baked_header_t)) { }
+
+    baked_header_t& header () {
+        return *reinterpret_cast< baked_header_t* > (buf.data ());
+    }
+
+    template< typename T >
+    void put (int i, const T* p, size_t n) {
+        buf.resize ((buf.size () + BAKED_ALIGNMENT - 1) & ~size_t (
+            BAKED_ALIGNMENT - 1));
+
+        auto& s = header ().sections [i];
+
+        s.offset = buf.size ();
+        s.count = n;
+        s.stride = sizeof (T);
+
+        if (n) {
+            const char* q = reinterpret_cast< const char* > (p);
+            buf.insert (buf.end (), q, q + n * sizeof (T));
+        }
+    }
+
+    template< typename Container >
+    void put (int i, const Container& xs) {
+        put (i, xs.data (), xs.size ());
+    }
+
+    template< typename String >
+    baked_string_t intern (const String& s) {
+        baked_string_t x{ uint32_t (strings.size ()), uint32_t (s.size ()) };
+
+        strings.insert (strings.end (), s.begin (), s.end ());
+        strings.push_back (0);
+
+        return x;
+    }
+};
+
+//
+// Writes a buffer to a new file of a unique name next to the cache, readable
+// by all, and returns its name; the file is removed if it cannot be written
+// whole:
+//
+string
+write_aside (const char* cache, const vector< char >& buf) {
+    string tmp = string (cache) + ".XXXXXX";
+
+    const int fd = ::mkstemp (tmp.data ());
+
+    if (0 > fd)
+        throw system_error (errno, system_category (), cache);
+
+    int err = 0 > ::fchmod (fd, 0644) ? errno : 0;
+
+    for (size_t off = 0; 0 == err && off < buf.size ();) {
+        const ssize_t n = ::write (fd, buf.data () + off, buf.size () - off);
+
+        if (0 <= n)
+            off += size_t (n);
+        else if (EINTR != errno)
+            err = errno;
+    }
+
+    if (0 > ::close (fd) && 0 == err)
+        err = errno;
+
+    if (err) {
+        ::unlink (tmp.c_str ());
+        throw system_error (err, system_category (), tmp);
+    }
+
+    return tmp;
+}
+
+} // anonymous namespace
+
+vector< char >
+bake (const pof_t& pof, size_t source_size, uint64_t hash) {
+    baker_t baker;
+
+    {
+        auto& h = baker.header ();
+
+        h.magic = BAKED_MAGIC;
+        h.version = BAKED_VERSION;
+        h.byte_order = BAKED_BYTE_ORDER;
+
+        h.hash = hash;
+        h.source_size = source_size;
+
+        h.flags = pof.flags;
+        h.minbox = pof.minbox;
+        h.maxbox = pof.maxbox;
+        h.radius = pof.radius;
+
+        h.mass = pof.mass;
+        h.mass_center = pof.mass_center;
+        memcpy (h.inertia_tensor, pof.inertia_tensor, sizeof h.inertia_tensor);
+
+        h.autocenter_point = pof.autocenter_point;
+    }
+
+    baker.put (baked_pof_t::VERTICES, pof.vertices);
+    baker.put (baked_pof_t::NORMALS, pof.normals);
+    baker.put (baked_pof_t::SUBOBJ_INDICES, pof.subobj_indices);
+
+    const auto& polys = pof.polys;
+
+    baker.put (baked_pof_t::POLY_TYPE, polys.type);
+    baker.put (baked_pof_t::POLY_COLOR, polys.color);
+    baker.put (baked_pof_t::POLY_SUBOBJ, polys.subobj_index);
+    baker.put (baked_pof_t::POLY_CENTER, polys.center);
+    baker.put (baked_pof_t::POLY_NORMAL, polys.normal);
+    baker.put (baked_pof_t::POLY_RADIUS, polys.radius);
+    baker.put (baked_pof_t::POLY_OFFSETS, polys.offsets);
+    baker.put (baked_pof_t::POLY_VERTICES, polys.vertices);
+    baker.put (baked_pof_t::POLY_NORMALS, polys.normals);
+    baker.put (baked_pof_t::POLY_U, polys.u);
+    baker.put (baked_pof_t::POLY_V, polys.v);
+
+    {
+        vector< baked_subobj_t > subobjs;
+        subobjs.reserve (pof.subobjs.size ());
+
+        for (const auto& x : pof.subobjs) {
+            subobjs.push_back ({
+                x.number, x.parent, x.detail,
+                baker.intern (x.name), baker.intern (x.properties),
+                x.center, x.off, x.real_off, x.minbox, x.maxbox, x.radius,
+                x.movement.type, x.movement.axis
+            });
+        }
+
+        baker.put (baked_pof_t::SUBOBJS, subobjs);
+    }
+
+    baker.put (baked_pof_t::DETAIL_SUBOBJ, pof.detail_subobj);
+    baker.put (baked_pof_t::DEBRIS_SUBOBJ, pof.debris_subobj);
+
+    baker.put (baked_pof_t::BOXES, pof.boxes);
+    baker.put (baked_pof_t::CROSS_SECTIONS, pof.cross_sections);
+    baker.put (baked_pof_t::LIGHTS, pof.lights);
+    baker.put (baked_pof_t::EYES, pof.eyes);
+
+    {
+        vector< baked_string_t > textures;
+
+        for (const auto& x : pof.textures)
+            textures.push_back (baker.intern (x.name));
+
+        baker.put (baked_pof_t::TEXTURES, textures);
+    }
+
+    baker.put (baked_pof_t::SHIELD_VERTICES, pof.shield.vertices);
+    baker.put (baked_pof_t::SHIELD_FACES, pof.shield.faces);
+    baker.put (baked_pof_t::WEAPONS, pof.weapons);
+
+    {
+        vector< baked_dock_t > docks;
+        vector< int > splines;
+        vector< vector3f_t > pos, normal;
+
+        for (const auto& x : pof.docks) {
+            baked_dock_t dock{ baker.intern (x.properties), { }, { } };
+
+            dock.splines.first = uint32_t (splines.size ());
+            splines.insert (splines.end (), x.splines.begin (),
+                            x.splines.end ());
+            dock.splines.last = uint32_t (splines.size ());
+
+            dock.points.first = uint32_t (pos.size ());
+            pos.insert (pos.end (), x.pos.begin (), x.pos.end ());
+            normal.insert (normal.end (), x.normal.begin (), x.normal.end ());
+            dock.points.last = uint32_t (pos.size ());
+
+            docks.push_back (dock);
+        }
+
+        baker.put (baked_pof_t::DOCKS, docks);
+        baker.put (baked_pof_t::DOCK_SPLINES, splines);
+        baker.put (baked_pof_t::DOCK_POS, pos);
+        baker.put (baked_pof_t::DOCK_NORMALS, normal);
+    }
+
+    baker.put (baked_pof_t::STRINGS, baker.strings);
+
+    baker.buf.resize ((baker.buf.size () + BAKED_ALIGNMENT - 1) & ~size_t (
+        BAKED_ALIGNMENT - 1));
+
+    baker.header ().size = baker.buf.size ();
+
+    return move (baker.buf);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+unique_ptr< baked_pof_t >
+load_baked (const char* filename, const char* cache) {
+    mapped_file_t source (filename);
+    const uint64_t hash = content_hash (source.data, source.size);
+
+    if (fs::exists (cache)) {
+        try {
+            auto p = make_unique< baked_pof_t > (cache);
+
+            if (p->header ().hash == hash &&
+                p->header ().source_size == source.size)
+                return p;
+
+            II << cache << " : stale, baking " << filename;
+        }
+        catch (const exception& e) {
+            II << cache << " : " << e.what () << ", baking " << filename;
+        }
+    }
+
+    vector< char > buf;
+
+    {
+        pof_t pof;
+        read (source.data, source.size, pof);
+
+        buf = bake (pof, source.size, hash);
+    }
+
+    //
+    // Written aside, to a file of its own, and renamed over the cache, so that
+    // a reader never maps a partially written file, even with other processes
+    // baking the same model:
+    //
+    const string tmp = write_aside (cache, buf);
+
+    error_code ec;
+    fs::rename (tmp, cache, ec);
+
+    if (ec) {
+        ::unlink (tmp.c_str ());
+        throw fs::filesystem_error ("load_baked", tmp, cache, ec);
+    }
+
+    return make_unique< baked_pof_t > (cache);
+}
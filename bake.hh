@@ -0,0 +1,258 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_BAKE_HH
+#define POF_BAKE_HH
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "mmap.hh"
+#include "pof.hh"
+#include "span.hh"
+
+#define BAKED_VERSION  2
+
+//
+// Baked model: the decoded and post-processed model, laid out as flat arrays
+// that are used in place once the file is mapped. The file starts with a
+// header that locates each array by its offset from the start of the file;
+// arrays are aligned to 16 bytes and hold plain data, with strings stored as
+// references into a pool of NUL-terminated characters. A baked file is tied
+// to the version of the format, to the byte order of the machine that baked
+// it, and to the size and hash of the POF it was baked from.
+//
+// It holds the geometry, the subobjects, the shield, the weapons and the
+// docks, together with the model's bounds and mass properties; the chunks
+// that are not baked can be decoded from the POF with lazy_pof_t:
+//
+struct baked_string_t {
+    uint32_t offset, size;
+};
+
+struct baked_range_t {
+    uint32_t first, last;
+};
+
+struct baked_subobj_t {
+    int number, parent, detail;
+    baked_string_t name, properties;
+
+    vector3f_t center, off, real_off;
+    vector3f_t minbox, maxbox;
+    float radius;
+
+    int movement_type, movement_axis;
+};
+
+struct baked_dock_t {
+    baked_string_t properties;
+
+    //
+    // The splines, and the points with their normals, in the docks' arrays:
+    //
+    baked_range_t splines, points;
+};
+
+struct baked_pof_t {
+    enum {
+        VERTICES, NORMALS, SUBOBJ_INDICES,
+
+        POLY_TYPE, POLY_COLOR, POLY_SUBOBJ, POLY_CENTER, POLY_NORMAL,
+        POLY_RADIUS, POLY_OFFSETS, POLY_VERTICES, POLY_NORMALS, POLY_U,
+        POLY_V,
+
+        SUBOBJS, DETAIL_SUBOBJ, DEBRIS_SUBOBJ,
+        BOXES, CROSS_SECTIONS, LIGHTS, EYES, TEXTURES,
+        SHIELD_VERTICES, SHIELD_FACES, WEAPONS,
+        DOCKS, DOCK_SPLINES, DOCK_POS, DOCK_NORMALS,
+
+        STRINGS, SECTIONS
+    };
+
+    struct section_t {
+        uint64_t offset, count;
+        uint32_t stride, reserved;
+    };
+
+    struct header_t {
+        uint32_t magic, version, byte_order, reserved;
+        uint64_t hash, source_size, size;
+
+        section_t sections [SECTIONS];
+
+        int flags;
+        vector3f_t minbox, maxbox;
+        float radius;
+
+        float mass;
+        vector3f_t mass_center;
+        float inertia_tensor [3][3];
+
+        vector3f_t autocenter_point;
+    };
+
+    //
+    // Polygon store of the model, with the same layout and views as that of
+    // a decoded model:
+    //
+    struct polys_t {
+        span_t< const int > type, color, subobj_index;
+        span_t< const vector3f_t > center, normal;
+        span_t< const float > radius;
+
+        span_t< const int > offsets, vertices, normals;
+        span_t< const float > u, v;
+
+        size_t size () const { return type.size (); }
+        bool empty () const { return type.empty (); }
+
+        size_t corners () const { return vertices.size (); }
+
+        pof_t::poly_t operator[] (size_t i) const {
+            const int* a = &offsets [i];
+
+            const bool textured = TEXTPOLY_DEF == type [i];
+            const int n = textured ? a [1] - a [0] : 0;
+
+            return {
+                type [i], color [i], subobj_index [i],
+                center [i], normal [i], radius [i],
+                { vertices.first + a [0], vertices.first + a [1] },
+                { normals.first + a [0], normals.first + a [1] },
+                { u.first + a [0], u.first + a [0] + n },
+                { v.first + a [0], v.first + a [0] + n }
+            };
+        }
+    };
+
+    //
+    // Maps and validates a baked file; throws if the file is not a baked
+    // model of this version and byte order, or is malformed:
+    //
+    explicit baked_pof_t (const char*);
+
+    baked_pof_t (const baked_pof_t&) = delete;
+    baked_pof_t& operator= (const baked_pof_t&) = delete;
+
+    const header_t& header () const { return *hdr; }
+
+    span_t< const vector3f_t > vertices () const {
+        return section< vector3f_t > (VERTICES);
+    }
+
+    span_t< const vector3f_t > normals () const {
+        return section< vector3f_t > (NORMALS);
+    }
+
+    span_t< const int > subobj_indices () const {
+        return section< int > (SUBOBJ_INDICES);
+    }
+
+    const polys_t& polys () const { return polys_; }
+
+    span_t< const baked_subobj_t > subobjs () const {
+        return section< baked_subobj_t > (SUBOBJS);
+    }
+
+    span_t< const int > detail_subobj () const {
+        return section< int > (DETAIL_SUBOBJ);
+    }
+
+    span_t< const int > debris_subobj () const {
+        return section< int > (DEBRIS_SUBOBJ);
+    }
+
+    span_t< const pof_t::box_t > boxes () const {
+        return section< pof_t::box_t > (BOXES);
+    }
+
+    span_t< const pof_t::cross_section_t > cross_sections () const {
+        return section< pof_t::cross_section_t > (CROSS_SECTIONS);
+    }
+
+    span_t< const pof_t::light_t > lights () const {
+        return section< pof_t::light_t > (LIGHTS);
+    }
+
+    span_t< const pof_t::eye_t > eyes () const {
+        return section< pof_t::eye_t > (EYES);
+    }
+
+    span_t< const baked_string_t > textures () const {
+        return section< baked_string_t > (TEXTURES);
+    }
+
+    span_t< const vertex3f_t > shield_vertices () const {
+        return section< vertex3f_t > (SHIELD_VERTICES);
+    }
+
+    span_t< const pof_t::shield_t::face_t > shield_faces () const {
+        return section< pof_t::shield_t::face_t > (SHIELD_FACES);
+    }
+
+    span_t< const pof_t::weapon_t > weapons () const {
+        return section< pof_t::weapon_t > (WEAPONS);
+    }
+
+    span_t< const baked_dock_t > docks () const {
+        return section< baked_dock_t > (DOCKS);
+    }
+
+    span_t< const int > splines (const baked_dock_t& dock) const {
+        return slice< int > (DOCK_SPLINES, dock.splines);
+    }
+
+    span_t< const vector3f_t > pos (const baked_dock_t& dock) const {
+        return slice< vector3f_t > (DOCK_POS, dock.points);
+    }
+
+    span_t< const vector3f_t > normal (const baked_dock_t& dock) const {
+        return slice< vector3f_t > (DOCK_NORMALS, dock.points);
+    }
+
+    string_view str (const baked_string_t& s) const {
+        return { section< char > (STRINGS).first + s.offset, s.size };
+    }
+
+private:
+    template< typename T >
+    span_t< const T > section (int i) const {
+        const auto& s = hdr->sections [i];
+        const T* p = reinterpret_cast< const T* > (file.data + s.offset);
+        return { p, p + s.count };
+    }
+
+    template< typename T >
+    span_t< const T > slice (int i, baked_range_t r) const {
+        const T* p = section< T > (i).first;
+        return { p + r.first, p + r.last };
+    }
+
+private:
+    mapped_file_t file;
+    const header_t* hdr;
+
+    polys_t polys_;
+};
+
+//
+// Hash of the contents of a POF file, which identifies the model a baked file
+// was baked from:
+//
+uint64_t content_hash (const char*, size_t);
+
+//
+// Lays out a decoded model in the baked format, tagged with the size and hash
+// of its source:
+//
+vector< char > bake (const pof_t&, size_t, uint64_t);
+
+//
+// Opens the baked cache of a POF file, (re)baking it first if it is missing,
+// of another version or byte order, or baked from other contents:
+//
+unique_ptr< baked_pof_t > load_baked (const char*, const char*);
+
+#endif // POF_BAKE_HH
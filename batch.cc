@@ -0,0 +1,91 @@
+// -*- mode: c++; -*-
+
+#define BOOST_LOG_DYN_LINK 1
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace fs = std::filesystem;
+
+#include "batch.hh"
+#include "log.hh"
+#include "pool.hh"
+#include "vector.hh"
+
+static bool
+is_pof (const fs::path& path) {
+    string ext = path.extension ().string ();
+
+    transform (ext.begin (), ext.end (), ext.begin (), [](unsigned char c) {
+        return char (tolower (c));
+    });
+
+    return ext == ".pof";
+}
+
+pof_batch_t
+load_directory (const char* dirname, thread_pool_t& pool) {
+    pof_batch_t batch{ };
+
+    for (auto& entry : fs::recursive_directory_iterator (dirname)) {
+        if (entry.is_regular_file () && is_pof (entry.path ())) {
+            batch.items.push_back ({ });
+
+            auto& item = batch.items.back ();
+
+            item.filename = entry.path ().string ();
+            item.size = entry.file_size ();
+
+            batch.bytes += item.size;
+        }
+    }
+
+    sort (batch.items.begin (), batch.items.end (),
+          [](const auto& lhs, const auto& rhs) {
+              return lhs.filename < rhs.filename;
+          });
+
+    //
+    // Schedule the largest files first, the small ones fill in the gaps at
+    // the end:
+    //
+    vector< size_t > order (batch.items.size ());
+
+    for (size_t i = 0; i < order.size (); ++i)
+        order [i] = i;
+
+    stable_sort (order.begin (), order.end (), [&](size_t lhs, size_t rhs) {
+        return batch.items [lhs].size > batch.items [rhs].size;
+    });
+
+    auto start = chrono::steady_clock::now ();
+
+    pool.parallel_for (order.size (), [&](size_t i) {
+        auto& item = batch.items [order [i]];
+
+        try {
+            load (item.filename.c_str (), item.pof, pool);
+        }
+        catch (const exception& e) {
+            item.pof = pof_t{ };
+            item.error = e.what ();
+        }
+    });
+
+    chrono::duration< double > elapsed = chrono::steady_clock::now () - start;
+    batch.seconds = elapsed.count ();
+
+    for (auto& item : batch.items) {
+        if (!item.error.empty ()) {
+            ++batch.failures;
+            WW << item.filename << " : " << item.error;
+        }
+    }
+
+    return batch;
+}
@@ -0,0 +1,39 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_BATCH_HH
+#define POF_BATCH_HH
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "pof.hh"
+
+struct thread_pool_t;
+
+//
+// Result of loading every model under a directory. Items are sorted by path;
+// an item that failed to load carries an error message and an empty model:
+//
+struct pof_batch_t {
+    struct item_t {
+        string filename;
+        size_t size;
+
+        pof_t pof;
+        string error;
+    };
+
+    vector< item_t > items;
+
+    size_t bytes, failures;
+    double seconds;
+};
+
+//
+// Recursively finds the .pof files under a directory and decodes each on the
+// pool:
+//
+pof_batch_t load_directory (const char*, thread_pool_t&);
+
+#endif // POF_BATCH_HH
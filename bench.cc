@@ -0,0 +1,770 @@
+// -*- mode: c++; -*-
+
+#define BOOST_LOG_DYN_LINK 1
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include "cull.hh"
+#include "instance.hh"
+#include "log.hh"
+#include "parser.hh"
+#include "pof.hh"
+#include "pool.hh"
+#include "simd.hh"
+#include "synth.hh"
+#include "vector.hh"
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Inputs of the kernels, and a copy of each output for every level, to check
+// the levels agree:
+//
+struct data_t {
+    vector< vector3f_t > xs, ys, out;
+    vector< float > dots;
+
+    vector< vector3f_block_t > blocks, out_blocks;
+
+    vector< float > radii;
+    vector< plane_t > planes;
+    vector< uint8_t > masks;
+
+    transform_t t;
+    aabb_t box;
+};
+
+static void
+generate (data_t& data, size_t n) {
+    mt19937 g (n);
+    uniform_real_distribution< float > d (-1000.f, 1000.f);
+
+    data.xs.resize (n);
+    data.ys.resize (n);
+
+    for (size_t i = 0; i < n; ++i) {
+        data.xs [i] = { { d (g), d (g), d (g) } };
+        data.ys [i] = { { d (g), d (g), d (g) } };
+    }
+
+    //
+    // A few null vectors, which normalize leaves alone:
+    //
+    for (size_t i = 0; i < n; i += 97)
+        data.xs [i] = { { 0, 0, 0 } };
+
+    data.out.resize (n);
+    data.dots.resize (n);
+
+    data.blocks.resize (blocks_for (n));
+    data.out_blocks.resize (blocks_for (n));
+
+    pack ({ data.xs.data (), data.xs.data () + n }, data.blocks.data ());
+
+    //
+    // Spheres about as large as the gaps between their centers, against the
+    // six planes of a box:
+    //
+    uniform_real_distribution< float > r (0.f, 200.f);
+
+    data.radii.resize (8 * data.blocks.size ());
+
+    for (auto& radius : data.radii)
+        radius = r (g);
+
+    for (size_t k = 0; k < 6; ++k) {
+        vector3f_t n{ };
+        n.value [k / 2] = k % 2 ? -1.f : 1.f;
+
+        data.planes.push_back ({ n, 500.f });
+    }
+
+    data.masks.resize (data.radii.size ());
+
+    const float a = .5f, c = cos (a), s = sin (a);
+
+    data.t = { { { c, 0, s }, { 0, 1, 0 }, { -s, 0, c } },
+               { { 10.f, -20.f, 30.f } } };
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Runs the kernel at least 8 times and for at least 100 ms, and returns the
+// best time per element, in nanoseconds:
+//
+static double
+measure (const function< void () >& kernel, size_t n) {
+    using clock_type = chrono::steady_clock;
+
+    kernel ();
+
+    double best = HUGE_VAL;
+    auto start = clock_type::now ();
+
+    for (size_t i = 0;
+         i < 8 || clock_type::now () - start < chrono::milliseconds (100);
+         ++i) {
+        const auto t0 = clock_type::now ();
+        kernel ();
+        const auto t1 = clock_type::now ();
+
+        best = min (best, chrono::duration< double, nano > (t1 - t0).count ());
+    }
+
+    return best / n;
+}
+
+struct kernel_t {
+    const char* name;
+    function< void (data_t&) > run;
+};
+
+static vector< kernel_t >
+kernels () {
+    return {
+        { "translate", [](data_t& d) {
+            d.out = d.xs;
+            translate ({ d.out.data (), d.out.data () + d.out.size () },
+                       d.t.t);
+        } },
+        { "transform", [](data_t& d) {
+            transform ({ d.xs.data (), d.xs.data () + d.xs.size () }, d.t,
+                       d.out.data ());
+        } },
+        { "normalize", [](data_t& d) {
+            d.out = d.xs;
+            normalize ({ d.out.data (), d.out.data () + d.out.size () });
+        } },
+        { "dot", [](data_t& d) {
+            dot ({ d.xs.data (), d.xs.data () + d.xs.size () },
+                 d.ys.data (), d.dots.data ());
+        } },
+        { "cross", [](data_t& d) {
+            cross ({ d.xs.data (), d.xs.data () + d.xs.size () },
+                   d.ys.data (), d.out.data ());
+        } },
+        { "bounds", [](data_t& d) {
+            d.box = bounds (span_t< const vector3f_t >{
+                    d.xs.data (), d.xs.data () + d.xs.size () });
+        } },
+        { "transform8", [](data_t& d) {
+            transform (span_t< const vector3f_block_t >{
+                    d.blocks.data (), d.blocks.data () + d.blocks.size () },
+                d.t, d.out_blocks.data ());
+        } },
+        { "bounds8", [](data_t& d) {
+            d.box = bounds (span_t< const vector3f_block_t >{
+                    d.blocks.data (), d.blocks.data () + d.blocks.size () });
+        } },
+        { "classify8", [](data_t& d) {
+            classify ({ d.blocks.data (), d.blocks.data () + d.blocks.size () },
+                      d.radii.data (),
+                      { d.planes.data (), d.planes.data () + d.planes.size () },
+                      d.masks.data ());
+        } }
+    };
+}
+
+static bool
+same (const data_t& lhs, const data_t& rhs) {
+    const size_t n = lhs.xs.size ();
+
+    return
+        0 == memcmp (lhs.out.data (), rhs.out.data (),
+                     n * sizeof (vector3f_t)) &&
+        0 == memcmp (lhs.dots.data (), rhs.dots.data (), n * sizeof (float)) &&
+        0 == memcmp (lhs.out_blocks.data (), rhs.out_blocks.data (),
+                     lhs.out_blocks.size () * sizeof (vector3f_block_t)) &&
+        0 == memcmp (&lhs.box, &rhs.box, sizeof lhs.box) &&
+        lhs.masks == rhs.masks;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static int
+run_kernels (size_t n) {
+    const auto top = simd_supported ();
+    bool agree = true;
+
+    printf ("%zu vectors, ns per vector:\n%-12s", n, "");
+
+    for (int level = SIMD_SCALAR; level <= top; ++level)
+        printf (" %8s", simd_name (simd_level_t (level)));
+
+    printf ("   speedup\n");
+
+    for (const auto& kernel : kernels ()) {
+        data_t base;
+        double scalar = 0, best = 0;
+
+        printf ("%-12s", kernel.name);
+
+        for (int level = SIMD_SCALAR; level <= top; ++level) {
+            simd_select (simd_level_t (level));
+
+            data_t data;
+            generate (data, n);
+
+            const double t = measure ([&] { kernel.run (data); }, n);
+            printf (" %8.3f", t);
+
+            if (SIMD_SCALAR == level)
+                base = move (data), scalar = t;
+            else if (!same (base, data))
+                printf (" (differs)"), agree = false;
+
+            best = t;
+        }
+
+        printf ("   %6.2fx\n", scalar / best);
+    }
+
+    simd_select (top);
+
+    return agree ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// The parse corpus: synthetic models from a handful of parts up to a capital
+// ship, with the extremes of BSP depth, shield size and weapon and dock counts
+// each in a model of its own, a hull of few, finely tessellated parts to
+// measure the mesh pipeline on, and a model in the older chunk layouts:
+//
+struct model_t {
+    string name;
+    synth_params_t params;
+};
+
+static vector< model_t >
+corpus () {
+    auto model = [](const char* name, int subobjs, int depth, int polys,
+                    int shield, int weapons, int docks) {
+        model_t model{ name, { } };
+        auto& params = model.params;
+
+        params.subobjs = subobjs;
+        params.depth = depth;
+        params.polys = polys;
+        params.shield = shield;
+
+        params.guns = params.missiles = weapons;
+        params.turrets = weapons / 4;
+        params.docks = docks;
+
+        return model;
+    };
+
+    vector< model_t > models {
+        model ("tiny",     1,  1,   16,    80,   2,  0),
+        model ("fighter",  8,  4,  256,   320,   8,  1),
+        model ("cruiser", 24,  6, 1024,  1280,  24,  4),
+        model ("capital", 64,  8, 4096,  5120,  64,  8),
+        model ("deep",     4, 12, 4096,   320,   4,  1),
+        model ("shield",   2,  4,  256, 20480,   4,  1),
+        model ("armed",   16,  4,  128,   320, 512, 32),
+        model ("hull",     2,  4, 8192,   320,   4,  1),
+        model ("legacy",  24,  6, 1024,  1280,  24,  4)
+    };
+
+    models.back ().params.version = 2014;
+
+    return models;
+}
+
+//
+// Resident set size of the process and its peak, in megabytes, from procfs; 0
+// where there is no procfs. Writing 5 to clear_refs resets the peak, after the
+// heap gives back what earlier models freed:
+//
+static double
+rss (const char* field) {
+    ifstream s ("/proc/self/status");
+
+    for (string line; getline (s, line);) {
+        if (0 == line.compare (0, strlen (field), field))
+            return atof (line.c_str () + strlen (field)) / 1024;
+    }
+
+    return 0;
+}
+
+static void
+reset_peak_rss () {
+#if defined (__GLIBC__)
+    malloc_trim (0);
+#endif // __GLIBC__
+
+    ofstream ("/proc/self/clear_refs") << "5";
+}
+
+//
+// Latencies of the decode, in microseconds, sorted: the decode runs a few times
+// to warm up, then at least the given number of times and for at least 250 ms:
+//
+static vector< double >
+sample (const function< void () >& decode, size_t runs) {
+    using clock_type = chrono::steady_clock;
+
+    for (size_t i = 0; i < 3; ++i)
+        decode ();
+
+    vector< double > ts;
+    const auto start = clock_type::now ();
+
+    while (ts.size () < runs ||
+           (clock_type::now () - start < chrono::milliseconds (250) &&
+            ts.size () < 100000)) {
+        const auto t0 = clock_type::now ();
+        decode ();
+        const auto t1 = clock_type::now ();
+
+        ts.push_back (chrono::duration< double, micro > (t1 - t0).count ());
+    }
+
+    return sort (ts.begin (), ts.end ()), ts;
+}
+
+//
+// Nearest-rank percentile of sorted samples:
+//
+static double
+percentile (const vector< double >& ts, double p) {
+    const size_t i = size_t (ceil (p / 100 * ts.size ()));
+    return ts [min (ts.size (), max (size_t (1), i)) - 1];
+}
+
+static int
+run_parse (const vector< model_t >& models, const vector< string >& files,
+           size_t runs) {
+    //
+    // The decoder logs warnings, e.g., for the chunks it skips; they are not
+    // what is measured:
+    //
+    boost::log::core::get ()->set_filter (
+        boost::log::trivial::severity >= boost::log::trivial::error);
+
+    thread_pool_t pool;
+
+    printf ("%-10s %8s  %-8s %10s %10s %8s %8s %8s\n", "model", "KB",
+            "decoder", "median us", "p99 us", "MB/s", "peak MB", "+MB");
+
+    auto bench = [&](const string& name, const string& image) {
+        istringstream stream (image);
+
+        const vector< pair< const char*, function< void () > > > decoders {
+            { "memory", [&] {
+                pof_t pof;
+                read (image.data (), image.size (), pof);
+            } },
+            { "stream", [&] {
+                stream.clear ();
+
+                pof_t pof;
+                read (stream, pof);
+            } },
+            { "pool", [&] {
+                pof_t pof;
+                read (image.data (), image.size (), pof, pool);
+            } },
+            //
+            // Fed in blocks of 1500 bytes, as packets off a network:
+            //
+            { "push", [&] {
+                pof_t pof;
+                pof_parser_t parser (pof);
+
+                for (size_t i = 0; i < image.size (); i += 1500)
+                    parser.feed (image.data () + i,
+                                 min (size_t (1500), image.size () - i));
+
+                parser.finish ();
+            } }
+        };
+
+        for (const auto& decoder : decoders) {
+            reset_peak_rss ();
+            const double base = rss ("VmRSS:");
+
+            const auto ts = sample (decoder.second, runs);
+            const double median = percentile (ts, 50);
+            const double peak = rss ("VmHWM:");
+
+            printf ("%-10s %8.1f  %-8s %10.1f %10.1f %8.1f %8.1f %8.1f\n",
+                    name.c_str (), image.size () / 1024., decoder.first,
+                    median, percentile (ts, 99),
+                    image.size () / median, peak, max (0., peak - base));
+        }
+    };
+
+    for (const auto& model : models)
+        bench (model.name, synthesize (model.params));
+
+    for (const auto& file : files) {
+        ifstream s (file, ios::binary);
+
+        if (!s)
+            return fprintf (stderr, "bench : cannot read %s\n",
+                            file.c_str ()), 1;
+
+        bench (file.substr (file.find_last_of ('/') + 1),
+               string (istreambuf_iterator< char > (s), { }));
+    }
+
+    return 0;
+}
+
+//
+// Stream buffer which drops what it is given:
+//
+struct null_buffer_t : streambuf {
+    int overflow (int c) override { return c; }
+    streamsize xsputn (const char*, streamsize n) override { return n; }
+};
+
+//
+// Decodes a batch of models on the pool, alternately with logging off and on,
+// and reports what the records the decoder issues at info and up cost. The
+// records are formatted and written out to a stream which drops them, so that
+// the cost is that of logging, not of the console. Records below the
+// compile-time minimum severity cost nothing either way:
+//
+static int
+run_logging (size_t runs) {
+    using clock_type = chrono::steady_clock;
+
+    null_buffer_t buffer;
+    ostream null_stream (&buffer);
+
+    pof_set_log_stream (null_stream);
+    pof_set_log_threshold (boost::log::trivial::info);
+
+    //
+    // A directory's worth of small models, where the records of the chunks
+    // and subobjects weigh the most:
+    //
+    vector< string > images;
+    size_t bytes = 0;
+
+    for (unsigned i = 0; i < 256; ++i) {
+        synth_params_t params;
+
+        params.seed = i + 1;
+        params.subobjs = 16;
+        params.polys = 32;
+
+        images.push_back (synthesize (params));
+        bytes += images.back ().size ();
+    }
+
+    thread_pool_t pool;
+
+    auto batch = [&](bool logging) {
+        boost::log::core::get ()->set_logging_enabled (logging);
+
+        const auto t0 = clock_type::now ();
+
+        pool.parallel_for (images.size (), [&](size_t i) {
+            pof_t pof;
+            read (images [i].data (), images [i].size (), pof);
+        });
+
+        const auto t1 = clock_type::now ();
+
+        return chrono::duration< double, milli > (t1 - t0).count ();
+    };
+
+    for (size_t i = 0; i < 3; ++i)
+        batch (false), batch (true);
+
+    vector< double > off, on;
+    const auto start = clock_type::now ();
+
+    while (off.size () < runs ||
+           clock_type::now () - start < chrono::milliseconds (250)) {
+        off.push_back (batch (false));
+        on.push_back (batch (true));
+    }
+
+    boost::log::core::get ()->set_logging_enabled (true);
+
+    pof_set_log_threshold (boost::log::trivial::warning);
+    pof_set_log_stream (clog);
+
+    sort (off.begin (), off.end ());
+    sort (on.begin (), on.end ());
+
+    printf ("%zu models, %.1f MB, on %zu threads, records below %s compiled "
+            "out\n", images.size (), bytes / 1048576., pool.size (),
+            POF_LOG_MIN_SEVERITY_NAME);
+
+    printf ("%-12s %10s %10s\n", "logging", "median ms", "p99 ms");
+    printf ("%-12s %10.2f %10.2f\n", "off", percentile (off, 50),
+            percentile (off, 99));
+    printf ("%-12s %10.2f %10.2f\n", "on", percentile (on, 50),
+            percentile (on, 99));
+
+    printf ("overhead     %9.1f%%\n",
+            100 * (percentile (on, 50) / percentile (off, 50) - 1));
+
+    return 0;
+}
+
+//
+// A scene of ships, instances of the corpus models, placed at random in a
+// cube with room for all, each heading anywhere about the vertical:
+//
+struct scene_t {
+    vector< unique_ptr< pof_t > > models;
+    instance_pool_t instances;
+};
+
+static void
+populate (scene_t& scene, const vector< model_t >& models, size_t ships) {
+    for (const auto& model : models) {
+        const string image = synthesize (model.params);
+
+        scene.models.push_back (make_unique< pof_t > ());
+        read (image.data (), image.size (), *scene.models.back ());
+
+        scene.instances.add_model (*scene.models.back ());
+    }
+
+    mt19937 g (ships);
+
+    const float side = 100 * cbrt (float (ships));
+
+    uniform_real_distribution< float > at (-side / 2, side / 2);
+    uniform_real_distribution< float > heading (0, float (2 * M_PI));
+
+    for (size_t i = 0; i < ships; ++i) {
+        const float a = heading (g), c = cos (a), s = sin (a);
+
+        const transform_t placement{
+            { { c, 0, s }, { 0, 1, 0 }, { -s, 0, c } },
+            { { at (g), at (g), at (g) } } };
+
+        scene.instances.add_instance (i % models.size (), placement);
+    }
+}
+
+//
+// Turns the turrets of every ship a little, then updates the transforms of
+// all the ships, with and without the pool, and reports the time taken by a
+// tick and the memory the ships hold, against copies of their models. Then
+// culls the scene from a view at its center, by subobject and by polygon
+// cluster, and reports the time taken and what is left to draw:
+//
+static int
+run_scene (size_t ships, size_t runs) {
+    scene_t scene;
+    populate (scene, corpus (), ships);
+
+    auto& instances = scene.instances;
+
+    size_t nodes = 0, copies = 0;
+
+    for (const auto& model : instances.models) {
+        nodes += model.size () * model.nodes ();
+        copies += model.size () * model.pof->vertices.size () *
+            sizeof (vector3f_t);
+    }
+
+    thread_pool_t pool;
+
+    auto tick = [&](thread_pool_t* pool) {
+        for (auto& model : instances.models)
+            for (auto& angle : model.angles)
+                angle += .01f;
+
+        instances.update (pool);
+    };
+
+    printf ("%zu ships of %zu models, %zu nodes, on %zu threads\n",
+            instances.size (), instances.models.size (), nodes, pool.size ());
+
+    printf ("%-12s %10s %10s %10s\n", "update", "median us", "p99 us",
+            "ns/node");
+
+    for (thread_pool_t* p : { (thread_pool_t*) 0, &pool }) {
+        const auto ts = sample ([&] { tick (p); }, runs);
+
+        printf ("%-12s %10.1f %10.1f %10.1f\n", p ? "pool" : "serial",
+                percentile (ts, 50), percentile (ts, 99),
+                percentile (ts, 50) * 1e3 / nodes);
+    }
+
+    printf ("instance state %.1f KB, %.1f bytes/ship; copies of the "
+            "vertices alone %.1f MB\n", instances.bytes () / 1024.,
+            double (instances.bytes ()) / instances.size (),
+            copies / 1048576.);
+
+    vector< cull_bounds_t > bounds (instances.models.size ());
+
+    size_t polys = 0;
+
+    for (size_t i = 0; i < bounds.size (); ++i) {
+        const auto& model = instances.models [i];
+
+        bound (*model.pof, model.hierarchy, bounds [i]);
+        polys += model.size () * model.pof->polys.size ();
+    }
+
+    const float side = 100 * cbrt (float (ships));
+
+    const view_t view = perspective (
+        { { 0, 0, 0 } }, { { 0, 0, 1 } }, { { 0, 1, 0 } },
+        float (M_PI / 3), 16.f / 9, 1.f, side, 1080.f);
+
+    printf ("%-16s %10s %10s %10s %10s %10s\n", "cull", "median us",
+            "p99 us", "ships", "draws", "polygons");
+
+    vector< draw_t > draws;
+
+    for (bool clusters : { false, true }) {
+        cull_options_t options;
+        options.clusters = clusters;
+
+        for (thread_pool_t* p : { (thread_pool_t*) 0, &pool }) {
+            const auto ts = sample ([&] {
+                draws.clear ();
+                cull (instances, bounds, view, options, draws, p);
+            }, runs);
+
+            size_t drawn = 0, visible = 0;
+
+            for (size_t i = 0; i < draws.size (); ++i) {
+                drawn += draws [i].last - draws [i].first;
+
+                visible += 0 == i ||
+                    draws [i].model != draws [i - 1].model ||
+                    draws [i].instance != draws [i - 1].instance;
+            }
+
+            const string name = string (clusters ? "clusters" : "subobjects") +
+                (p ? "/pool" : "");
+
+            printf ("%-16s %10.1f %10.1f %10zu %10zu %9.1f%%\n",
+                    name.c_str (), percentile (ts, 50), percentile (ts, 99),
+                    visible, draws.size (), 100. * drawn / polys);
+        }
+    }
+
+    return 0;
+}
+
+//
+// Writes the corpus to the directory, for the pof program or other tools:
+//
+static int
+write_corpus (const vector< model_t >& models, const string& dir) {
+    for (const auto& model : models) {
+        const string filename = dir + "/" + model.name + ".pof";
+        ofstream s (filename, ios::binary);
+
+        if (!synthesize (s, model.params) || !s.flush ())
+            return fprintf (stderr, "bench : cannot write %s\n",
+                            filename.c_str ()), 1;
+
+        printf ("%s\n", filename.c_str ());
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+usage () {
+    printf ("Usage: bench [-n vectors]\n"
+            "       bench -p [-i runs] [file ...]\n"
+            "       bench -l [-i runs]\n"
+            "       bench -s ships [-i runs]\n"
+            "       bench -w dir\n");
+}
+
+int main (int argc, char** argv) {
+    size_t n = 4096, runs = 20;
+
+    bool parse = false, logging = false;
+    size_t ships = 0;
+    const char* dir = 0;
+
+    for (int opt; -1 != (opt = getopt (argc, argv, "n:pls:i:w:"));) {
+        switch (opt) {
+        case 'n':
+            n = size_t (atol (optarg));
+            break;
+
+        case 'p':
+            parse = true;
+            break;
+
+        case 'l':
+            logging = true;
+            break;
+
+        case 's':
+            ships = size_t (atol (optarg));
+            break;
+
+        case 'i':
+            runs = size_t (atol (optarg));
+            break;
+
+        case 'w':
+            dir = optarg;
+            break;
+
+        default:
+            return usage (), 1;
+        }
+    }
+
+    if (dir)
+        return optind == argc ? write_corpus (corpus (), dir) : (usage (), 1);
+
+    if (logging)
+        return 0 == runs || optind != argc
+            ? (usage (), 1) : run_logging (runs);
+
+    if (ships)
+        return 0 == runs || optind != argc
+            ? (usage (), 1) : run_scene (ships, runs);
+
+    if (parse) {
+        if (0 == runs)
+            return usage (), 1;
+
+        return run_parse (corpus (), { argv + optind, argv + argc }, runs);
+    }
+
+    if (0 == n || optind != argc)
+        return usage (), 1;
+
+    return run_kernels (n);
+}
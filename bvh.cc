@@ -0,0 +1,579 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#if defined (__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#include "bvh.hh"
+#include "pool.hh"
+
+#define BVH_BINS           16
+#define BVH_LEAF_SIZE       4   // most triangles in a leaf
+#define BVH_TRAVERSAL_COST  1.f // cost of a node visit, per triangle test
+#define BVH_MAX_DEPTH      48   // depth past which nodes are split in halves
+#define BVH_STACK_SIZE    128
+#define BVH_PARALLEL_SIZE 4096  // fewest triangles of a subtree built apart
+#define BVH_RAY_BATCH     256
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+//
+// Boxes of the builder, with corners padded to four floats for SSE:
+//
+struct alignas (16) box_t {
+    float lo [4], hi [4];
+};
+
+inline box_t
+empty_box () {
+    const float inf = HUGE_VALF;
+    return { { inf, inf, inf, inf }, { -inf, -inf, -inf, -inf } };
+}
+
+inline void
+grow (box_t& box, const float* lo, const float* hi) {
+#if defined (__SSE2__)
+    _mm_store_ps (box.lo, _mm_min_ps (_mm_load_ps (box.lo), _mm_load_ps (lo)));
+    _mm_store_ps (box.hi, _mm_max_ps (_mm_load_ps (box.hi), _mm_load_ps (hi)));
+#else
+    for (size_t k = 0; k < 4; ++k) {
+        box.lo [k] = min (box.lo [k], lo [k]);
+        box.hi [k] = max (box.hi [k], hi [k]);
+    }
+#endif // __SSE2__
+}
+
+inline void
+grow (box_t& box, const box_t& other) {
+    grow (box, other.lo, other.hi);
+}
+
+//
+// Half the surface area, zero for an empty box:
+//
+inline float
+area (const box_t& box) {
+    const float x = box.hi [0] - box.lo [0];
+    const float y = box.hi [1] - box.lo [1];
+    const float z = box.hi [2] - box.lo [2];
+
+    return x < 0 ? 0 : x * y + y * z + z * x;
+}
+
+struct prim_t {
+    box_t box;
+    alignas (16) float centroid [4];
+    uint32_t index;
+};
+
+//
+// Builds a tree over the prims in nodes that have a slot for each node of the
+// largest tree, 2n - 1 for n prims: the subtree of a node with n prims takes
+// the 2n - 1 slots from the node's on, its first child's subtree the slots
+// right after the node. Subtrees are built apart, in parallel, without
+// sharing anything but the arrays; the tree is then compacted:
+//
+struct builder_t {
+    vector< prim_t >& prims;
+    vector< bvh_t::node_t >& nodes;
+
+    thread_pool_t* pool;
+
+    void build (size_t, size_t, size_t, size_t);
+    size_t split (size_t, size_t, const box_t&, const box_t&, size_t, int&);
+};
+
+void
+builder_t::build (size_t slot, size_t first, size_t n, size_t depth) {
+    box_t box = empty_box (), centroids = empty_box ();
+
+    for (size_t i = first; i < first + n; ++i) {
+        grow (box, prims [i].box);
+        grow (centroids, prims [i].centroid, prims [i].centroid);
+    }
+
+    auto& node = nodes [slot];
+
+    node.box = {
+        { { box.lo [0], box.lo [1], box.lo [2] } },
+        { { box.hi [0], box.hi [1], box.hi [2] } }
+    };
+
+    int axis = 0;
+    const size_t left =
+        1 < n ? split (first, n, box, centroids, depth, axis) : 0;
+
+    if (0 == left) {
+        node.offset = uint32_t (first);
+        node.count = uint16_t (n);
+        node.axis = 0;
+
+        return;
+    }
+
+    node.offset = uint32_t (slot + 2 * left);
+    node.count = 0;
+    node.axis = uint16_t (axis);
+
+    auto f = [&](size_t i) {
+        if (0 == i)
+            build (slot + 1, first, left, depth + 1);
+        else
+            build (slot + 2 * left, first + left, n - left, depth + 1);
+    };
+
+    if (pool && BVH_PARALLEL_SIZE <= n)
+        pool->parallel_for (2, f);
+    else
+        f (0), f (1);
+}
+
+//
+// Partitions the prims and returns the number that go to the first child, or
+// 0 for a leaf:
+//
+size_t
+builder_t::split (size_t first, size_t n, const box_t& box,
+                  const box_t& centroids, size_t depth, int& axis) {
+    const auto begin = prims.begin () + first, end = begin + n;
+
+    if (depth < BVH_MAX_DEPTH) {
+        //
+        // As many bins as prims in small nodes, which are most of them:
+        //
+        const int nbins = int (min< size_t > (BVH_BINS, n));
+
+        float best = HUGE_VALF;
+        int best_axis = -1, best_bin = 0;
+
+        for (int k = 0; k < 3; ++k) {
+            const float lo = centroids.lo [k];
+            const float extent = centroids.hi [k] - lo;
+
+            if (!(0 < extent))
+                continue;
+
+            const float scale = nbins / extent;
+
+            size_t counts [BVH_BINS] = { };
+            box_t boxes [BVH_BINS];
+
+            fill (boxes, boxes + nbins, empty_box ());
+
+            for (auto iter = begin; iter != end; ++iter) {
+                const float x = (iter->centroid [k] - lo) * scale;
+                const int bin = 0 < x ? min (int (x), nbins - 1) : 0;
+
+                ++counts [bin];
+                grow (boxes [bin], iter->box);
+            }
+
+            //
+            // Costs of the splits before each bin, the areas of the boxes of
+            // the bins after it swept from the last bin; empty bins add no
+            // split:
+            //
+            float areas [BVH_BINS];
+            box_t acc = empty_box ();
+
+            for (int b = nbins - 1; 0 < b; --b) {
+                if (counts [b])
+                    grow (acc, boxes [b]), areas [b] = area (acc);
+            }
+
+            acc = empty_box ();
+            size_t count = 0;
+
+            for (int b = 1; b < nbins; ++b) {
+                if (counts [b - 1])
+                    grow (acc, boxes [b - 1]), count += counts [b - 1];
+
+                if (0 == count || 0 == counts [b])
+                    continue;
+
+                const float cost = area (acc) * count + areas [b] * (n - count);
+
+                if (cost < best)
+                    best = cost, best_axis = k, best_bin = b;
+            }
+        }
+
+        if (0 <= best_axis) {
+            const float a = area (box);
+
+            if (n <= BVH_LEAF_SIZE && a * n <= BVH_TRAVERSAL_COST * a + best)
+                return 0;
+
+            const float lo = centroids.lo [best_axis];
+            const float scale = nbins / (centroids.hi [best_axis] - lo);
+
+            const auto mid = partition (begin, end, [&](const prim_t& prim) {
+                const float x = (prim.centroid [best_axis] - lo) * scale;
+                return (0 < x ? min (int (x), nbins - 1) : 0) < best_bin;
+            });
+
+            axis = best_axis;
+            return size_t (mid - begin);
+        }
+    }
+
+    if (n <= BVH_LEAF_SIZE)
+        return 0;
+
+    //
+    // Coincident centroids or a deep node: halves along the longest axis of
+    // the centroids:
+    //
+    float d [3];
+
+    for (size_t k = 0; k < 3; ++k)
+        d [k] = centroids.hi [k] - centroids.lo [k];
+
+    axis = int (max_element (d, d + 3) - d);
+
+    nth_element (begin, begin + n / 2, end, [&](auto& lhs, auto& rhs) {
+        return lhs.centroid [axis] < rhs.centroid [axis];
+    });
+
+    return n / 2;
+}
+
+//
+// A subobject's tree, built apart and then appended to the model's:
+//
+struct tree_t {
+    vector< bvh_t::node_t > nodes;
+
+    vector< bvh_t::triangle_t > triangles;
+    vector< bvh_t::ref_t > refs;
+};
+
+//
+// Copies the nodes of the subtree at slot depth-first, without the unused
+// slots:
+//
+void
+compact (const vector< bvh_t::node_t >& nodes, size_t slot,
+         vector< bvh_t::node_t >& out) {
+    const size_t i = out.size ();
+    out.push_back (nodes [slot]);
+
+    if (0 == nodes [slot].count) {
+        compact (nodes, slot + 1, out);
+        out [i].offset = uint32_t (out.size ());
+        compact (nodes, nodes [slot].offset, out);
+    }
+}
+
+void
+build_tree (tree_t& tree, thread_pool_t* pool) {
+    const size_t n = tree.triangles.size ();
+
+    if (0 == n)
+        return;
+
+    vector< prim_t > prims (n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto& t = tree.triangles [i];
+        const vector3f_t b = t.p + t.e1, c = t.p + t.e2;
+
+        auto& prim = prims [i];
+
+        for (size_t k = 0; k < 3; ++k) {
+            const float x = t.p.value [k], y = b.value [k], z = c.value [k];
+
+            prim.box.lo [k] = min ({ x, y, z });
+            prim.box.hi [k] = max ({ x, y, z });
+            prim.centroid [k] = (prim.box.lo [k] + prim.box.hi [k]) * .5f;
+        }
+
+        prim.box.lo [3] = prim.box.hi [3] = prim.centroid [3] = 0;
+        prim.index = uint32_t (i);
+    }
+
+    vector< bvh_t::node_t > nodes (2 * n - 1);
+
+    builder_t builder{ prims, nodes, pool };
+    builder.build (0, 0, n, 0);
+
+    tree.nodes.reserve (nodes.size ());
+    compact (nodes, 0, tree.nodes);
+
+    //
+    // Triangles in the order of the leaves:
+    //
+    vector< bvh_t::triangle_t > triangles (n);
+    vector< bvh_t::ref_t > refs (n);
+
+    for (size_t i = 0; i < n; ++i) {
+        triangles [i] = tree.triangles [prims [i].index];
+        refs [i] = tree.refs [prims [i].index];
+    }
+
+    tree.triangles = move (triangles);
+    tree.refs = move (refs);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+inline bool
+slabs (const aabb_t& box, const vector3f_t& origin, const vector3f_t& inv,
+       float t) {
+    float t0 = 0, t1 = t;
+
+    for (size_t k = 0; k < 3; ++k) {
+        float a = (box.lo.value [k] - origin.value [k]) * inv.value [k];
+        float b = (box.hi.value [k] - origin.value [k]) * inv.value [k];
+
+        if (b < a)
+            swap (a, b);
+
+        t0 = t0 < a ? a : t0;
+        t1 = b < t1 ? b : t1;
+    }
+
+    return t0 <= t1;
+}
+
+//
+// Moller-Trumbore, both sides of the triangle:
+//
+inline bool
+intersect (const bvh_t::triangle_t& tri, const ray_t& ray, hit_t& hit) {
+    const vector3f_t p = cross (ray.direction, tri.e2);
+    const float det = dot (tri.e1, p);
+
+    if (fabs (det) < 1e-20f)
+        return false;
+
+    const float inv = 1.f / det;
+    const vector3f_t s = ray.origin - tri.p;
+
+    const float u = dot (s, p) * inv;
+
+    if (u < 0 || 1 < u)
+        return false;
+
+    const vector3f_t q = cross (s, tri.e1);
+    const float v = dot (ray.direction, q) * inv;
+
+    if (v < 0 || 1 < u + v)
+        return false;
+
+    const float t = dot (tri.e2, q) * inv;
+
+    if (!(0 < t && t < hit.t))
+        return false;
+
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+
+    return true;
+}
+
+void
+cast (const bvh_t& bvh, int subobj, const ray_t& ray, const vector3f_t& inv,
+      hit_t& hit) {
+    const auto& tree = bvh.trees [subobj];
+
+    if (0 == tree.nodes)
+        return;
+
+    uint32_t stack [BVH_STACK_SIZE];
+    size_t top = 0;
+
+    uint32_t i = uint32_t (tree.first_node);
+
+    for (;;) {
+        const auto& node = bvh.nodes [i];
+
+        if (slabs (node.box, ray.origin, inv, hit.t)) {
+            if (0 == node.count) {
+                uint32_t near = i + 1, far = node.offset;
+
+                if (ray.direction.value [node.axis] < 0)
+                    swap (near, far);
+
+                stack [top++] = far;
+                i = near;
+
+                continue;
+            }
+
+            for (size_t j = node.offset; j < node.offset + node.count; ++j) {
+                if (intersect (bvh.triangles [j], ray, hit)) {
+                    hit.subobj = subobj;
+                    hit.poly = bvh.refs [j].poly;
+                    hit.triangle = bvh.refs [j].triangle;
+                }
+            }
+        }
+
+        if (0 == top)
+            break;
+
+        i = stack [--top];
+    }
+}
+
+void
+cast (const bvh_t& bvh, span_t< const int > subobjs, const ray_t& ray,
+      hit_t& hit) {
+    hit = { -1, -1, -1, ray.t, 0, 0 };
+
+    vector3f_t inv;
+
+    for (size_t k = 0; k < 3; ++k)
+        inv.value [k] = 1.f / ray.direction.value [k];
+
+    for (int subobj : subobjs)
+        cast (bvh, subobj, ray, inv, hit);
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////
+
+void
+build_bvh (const pof_t& pof, bvh_t& bvh, thread_pool_t* pool) {
+    const size_t nsubobjs = pof.subobjs.size ();
+
+    //
+    // The triangles of each subobject's fans:
+    //
+    vector< tree_t > trees (nsubobjs);
+
+    const auto& polys = pof.polys;
+    const auto& vertices = pof.vertices;
+
+    vector< size_t > counts (nsubobjs);
+
+    for (size_t i = 0; i < polys.size (); ++i) {
+        const int subobj = polys.subobj_index [i];
+        ensure (0 <= subobj && size_t (subobj) < nsubobjs,
+                "bvh: polygon subobject");
+
+        const int n = polys.offsets [i + 1] - polys.offsets [i];
+        counts [subobj] += size_t (max (n - 2, 0));
+    }
+
+    for (size_t i = 0; i < nsubobjs; ++i) {
+        trees [i].triangles.reserve (counts [i]);
+        trees [i].refs.reserve (counts [i]);
+    }
+
+    for (size_t i = 0; i < polys.size (); ++i) {
+        const int subobj = polys.subobj_index [i];
+
+        const int* corners = polys.vertices.data () + polys.offsets [i];
+        const int n = polys.offsets [i + 1] - polys.offsets [i];
+
+        for (int j = 0; j < n; ++j)
+            ensure (0 <= corners [j] && size_t (corners [j]) < vertices.size (),
+                    "bvh: polygon vertex");
+
+        auto& tree = trees [subobj];
+
+        for (int j = 0; j + 2 < n; ++j) {
+            const vector3f_t& a = vertices [corners [0]];
+
+            tree.triangles.push_back ({
+                    a,
+                    vertices [corners [j + 1]] - a,
+                    vertices [corners [j + 2]] - a });
+
+            tree.refs.push_back ({ int (i), j });
+        }
+    }
+
+    if (pool)
+        pool->parallel_for (nsubobjs, [&](size_t i) {
+            build_tree (trees [i], pool);
+        });
+    else
+        for (auto& tree : trees)
+            build_tree (tree, pool);
+
+    bvh.nodes.clear ();
+    bvh.triangles.clear ();
+    bvh.refs.clear ();
+
+    bvh.trees.resize (nsubobjs);
+
+    for (size_t i = 0; i < nsubobjs; ++i) {
+        auto& tree = trees [i];
+
+        const size_t first_node = bvh.nodes.size ();
+        const size_t first_triangle = bvh.triangles.size ();
+
+        for (auto node : tree.nodes) {
+            node.offset += uint32_t (node.count ? first_triangle : first_node);
+            bvh.nodes.push_back (node);
+        }
+
+        auto& triangles = bvh.triangles;
+        triangles.insert (
+            triangles.end (), tree.triangles.begin (), tree.triangles.end ());
+
+        auto& refs = bvh.refs;
+        refs.insert (refs.end (), tree.refs.begin (), tree.refs.end ());
+
+        bvh.trees [i] = {
+            first_node, tree.nodes.size (),
+            first_triangle, tree.triangles.size ()
+        };
+    }
+}
+
+void
+cast (const bvh_t& bvh, span_t< const ray_t > rays, hit_t* hits,
+      thread_pool_t* pool) {
+    vector< int > subobjs (bvh.trees.size ());
+
+    for (size_t i = 0; i < subobjs.size (); ++i)
+        subobjs [i] = int (i);
+
+    cast (bvh, { subobjs.data (), subobjs.data () + subobjs.size () },
+          rays, hits, pool);
+}
+
+void
+cast (const bvh_t& bvh, span_t< const int > subobjs,
+      span_t< const ray_t > rays, hit_t* hits, thread_pool_t* pool) {
+    for (int subobj : subobjs)
+        ensure (0 <= subobj && size_t (subobj) < bvh.trees.size (),
+                "bvh: cast subobject");
+
+    const size_t n = rays.size ();
+
+    auto f = [&](size_t batch) {
+        const size_t first = batch * BVH_RAY_BATCH;
+        const size_t last = min (first + BVH_RAY_BATCH, n);
+
+        for (size_t i = first; i < last; ++i)
+            cast (bvh, subobjs, rays [i], hits [i]);
+    };
+
+    const size_t batches = (n + BVH_RAY_BATCH - 1) / BVH_RAY_BATCH;
+
+    if (pool)
+        pool->parallel_for (batches, f);
+    else
+        for (size_t i = 0; i < batches; ++i)
+            f (i);
+}
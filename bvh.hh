@@ -0,0 +1,100 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_BVH_HH
+#define POF_BVH_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "pof.hh"
+#include "simd.hh"
+#include "span.hh"
+#include "vector.hh"
+
+struct thread_pool_t;
+
+//
+// Bounding volume hierarchies over the polygons of a model, fan-triangulated,
+// one for each subobject. Triangles are in the model's frame with the
+// subobjects at rest, as the model's vertices are decoded and rendered.
+// The hierarchies are built with the surface area heuristic over binned
+// triangle centroids, subobjects and large subtrees in parallel.
+//
+// The nodes of all the trees are in one array, each tree depth-first with a
+// node's first child right after it. An inner node's second child is at
+// offset and axis is the axis it is split on; a leaf has count triangles,
+// from offset on, stored in the order the leaves refer to them:
+//
+struct bvh_t {
+    struct node_t {
+        aabb_t box;
+        uint32_t offset;
+        uint16_t count, axis;
+    };
+
+    //
+    // A triangle as a vertex and the two edges from it. Triangle k of a
+    // polygon's fan has the polygon's corners 0, k + 1 and k + 2:
+    //
+    struct triangle_t {
+        vector3f_t p, e1, e2;
+    };
+
+    struct ref_t {
+        int poly, triangle;
+    };
+
+    //
+    // A subobject's tree, empty if it has no polygons:
+    //
+    struct tree_t {
+        size_t first_node, nodes;
+        size_t first_triangle, triangles;
+    };
+
+    vector< node_t > nodes;
+
+    vector< triangle_t > triangles;
+    vector< ref_t > refs;
+
+    vector< tree_t > trees;
+};
+
+//
+// Builds the hierarchies of a decoded model; throws out_of_range if a polygon
+// refers to a vertex the model does not have:
+//
+void build_bvh (const pof_t&, bvh_t&, thread_pool_t* = 0);
+
+//
+// A ray from origin along direction, up to t times the direction. The
+// distances of the hits are in units of the direction, i.e., actual distances
+// for a unit direction:
+//
+struct ray_t {
+    vector3f_t origin, direction;
+    float t;
+};
+
+//
+// The nearest hit of a ray: the subobject and the polygon, the triangle of
+// the polygon's fan and the barycentric coordinates of the hit in it, i.e.,
+// p0 + u (p1 - p0) + v (p2 - p0). Subobject and polygon are -1 for a miss:
+//
+struct hit_t {
+    int subobj, poly, triangle;
+    float t, u, v;
+};
+
+//
+// Casts the rays against all subobjects or those listed, the hits for each
+// ray in the same position in the output. Batches of rays are cast in
+// parallel on the pool, if one is given:
+//
+void cast (const bvh_t&, span_t< const ray_t >, hit_t*, thread_pool_t* = 0);
+
+void cast (const bvh_t&, span_t< const int >, span_t< const ray_t >, hit_t*,
+           thread_pool_t* = 0);
+
+#endif // POF_BVH_HH
@@ -0,0 +1,363 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "cull.hh"
+#include "pool.hh"
+
+#define CULL_CLUSTER_SIZE  64 // polygons in a cluster, at most
+#define CULL_BATCH        256 // instances culled by a task
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+inline float
+length (const vector3f_t& x) {
+    return sqrt (dot (x, x));
+}
+
+inline vector3f_t
+apply (const transform_t& t, const vector3f_t& p) {
+    vector3f_t q;
+
+    for (size_t k = 0; k < 3; ++k)
+        q.value [k] = t.m [k][0] * p.value [0] + t.m [k][1] * p.value [1] +
+            t.m [k][2] * p.value [2] + t.t.value [k];
+
+    return q;
+}
+
+//
+// Mask of the planes of the view, among those in mask, a sphere straddles,
+// or SPHERE_OUTSIDE:
+//
+inline uint8_t
+straddled (const view_t& view, uint8_t mask, const vector3f_t& c, float r) {
+    uint8_t result = 0;
+
+    for (size_t k = 0; k < 6; ++k) {
+        if (0 == (mask & (1U << k)))
+            continue;
+
+        const float d = dot (view.planes [k].n, c) + view.planes [k].d;
+
+        if (d < -r)
+            return SPHERE_OUTSIDE;
+
+        if (d < r)
+            result |= uint8_t (1U << k);
+    }
+
+    return result;
+}
+
+//
+// Sphere around spheres, centered in their bounding box:
+//
+cull_bounds_t::sphere_t
+enclose (const vector< cull_bounds_t::sphere_t >& spheres) {
+    const float inf = HUGE_VALF;
+
+    vector3f_t lo{ { inf, inf, inf } }, hi{ { -inf, -inf, -inf } };
+
+    for (const auto& s : spheres) {
+        for (size_t k = 0; k < 3; ++k) {
+            lo.value [k] = min (lo.value [k], s.center.value [k] - s.radius);
+            hi.value [k] = max (hi.value [k], s.center.value [k] + s.radius);
+        }
+    }
+
+    cull_bounds_t::sphere_t result{ (lo + hi) * .5f, 0.f };
+
+    for (const auto& s : spheres)
+        result.radius = max (result.radius,
+                             length (s.center - result.center) + s.radius);
+
+    return result;
+}
+
+} // anonymous namespace
+
+void
+bound (const pof_t& pof, const hierarchy_t& h, cull_bounds_t& b) {
+    const size_t n = h.size ();
+    const auto& polys = pof.polys;
+
+    //
+    // Polygons of each subobject:
+    //
+    vector< pair< size_t, size_t > > ranges (pof.subobjs.size (), { 0, 0 });
+    vector< bool > seen (pof.subobjs.size ());
+
+    for (size_t i = 0; i < polys.size (); ++i) {
+        const int subobj = polys.subobj_index [i];
+
+        ensure (0 <= subobj && size_t (subobj) < ranges.size (),
+                "bound: polygon subobject out of range");
+
+        auto& range = ranges [subobj];
+
+        if (!seen [subobj])
+            seen [subobj] = true, range = { i, i };
+
+        ensure (range.second == i,
+                "bound: polygons of a subobject are not contiguous");
+
+        ++range.second;
+    }
+
+    b.nodes.resize (n);
+    b.details.resize (n);
+
+    b.clusters.clear ();
+    b.node_clusters.assign (1, 0);
+
+    b.radius = pof.radius;
+
+    vector< float > reach (n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto& subobj = pof.subobjs [h.subobjs [i]];
+        const int parent = h.parents [i];
+
+        const vector3f_t& pivot = h.pivots [i];
+        const vector3f_t center = subobj.off + subobj.center;
+
+        b.nodes [i] = { center, subobj.radius };
+        b.details [i] = subobj.detail;
+
+        //
+        // Parents come first, and reach out first:
+        //
+        reach [i] = 0 > parent
+            ? length (pivot)
+            : reach [parent] + length (pivot - h.pivots [parent]);
+
+        b.radius = max (b.radius,
+                        reach [i] + length (center - pivot) + subobj.radius);
+
+        //
+        // Clusters of consecutive polygons:
+        //
+        const auto range = ranges [h.subobjs [i]];
+
+        for (size_t first = range.first; first < range.second;
+             first += CULL_CLUSTER_SIZE) {
+            const size_t last = min (first + CULL_CLUSTER_SIZE, range.second);
+
+            vector< cull_bounds_t::sphere_t > spheres;
+
+            for (size_t k = first; k < last; ++k)
+                spheres.push_back (
+                    { subobj.off + polys.center [k], polys.radius [k] });
+
+            b.clusters.push_back (
+                { enclose (spheres), uint32_t (first), uint32_t (last) });
+        }
+
+        b.node_clusters.push_back (uint32_t (b.clusters.size ()));
+    }
+}
+
+view_t
+perspective (const vector3f_t& eye, const vector3f_t& forward,
+             const vector3f_t& up, float fovy, float aspect, float near,
+             float far, float height) {
+    const vector3f_t f = normalize (forward);
+    const vector3f_t r = normalize (cross (f, up));
+    const vector3f_t u = cross (r, f);
+
+    const float ty = tan (fovy / 2), tx = aspect * ty;
+
+    view_t view;
+
+    view.planes [0] = { f, -dot (f, eye) - near };
+    view.planes [1] = { f * -1.f, dot (f, eye) + far };
+
+    const vector3f_t sides [4] = {
+        normalize (f * tx + r), normalize (f * tx - r),
+        normalize (f * ty + u), normalize (f * ty - u)
+    };
+
+    for (size_t k = 0; k < 4; ++k)
+        view.planes [2 + k] = { sides [k], -dot (sides [k], eye) };
+
+    view.eye = eye;
+    view.scale = height / (2 * ty);
+
+    return view;
+}
+
+void
+cull (const instance_pool_t& pool, const vector< cull_bounds_t >& bounds,
+      const view_t& view, const cull_options_t& options,
+      vector< draw_t >& draws, thread_pool_t* threads) {
+    const auto& models = pool.models;
+
+    ensure (bounds.size () == models.size (), "cull: bounds do not match");
+
+    //
+    // Batches of instances of one model each, and what each draws:
+    //
+    vector< pair< size_t, size_t > > batches;
+
+    for (size_t i = 0; i < models.size (); ++i) {
+        ensure (bounds [i].nodes.size () == models [i].nodes (),
+                "cull: bounds do not match");
+
+        for (size_t k = 0; k < models [i].size (); k += CULL_BATCH)
+            batches.emplace_back (i, k);
+    }
+
+    vector< vector< draw_t > > results (batches.size ());
+
+    auto f = [&](size_t batch) {
+        const size_t m = batches [batch].first;
+
+        const auto& model = models [m];
+        const auto& b = bounds [m];
+        const auto& h = model.hierarchy;
+
+        const size_t first = batches [batch].second;
+        const size_t count = min (size_t (CULL_BATCH), model.size () - first);
+
+        const size_t nodes = model.nodes ();
+        const size_t levels =
+            max (size_t (1), model.pof->detail_subobj.size ());
+
+        auto& out = results [batch];
+
+        //
+        // Spheres of the instances against the frustum, in blocks:
+        //
+        vector< vector3f_t > centers (count);
+
+        for (size_t k = 0; k < count; ++k)
+            centers [k] = model.placements [first + k].t;
+
+        vector< vector3f_block_t > blocks (blocks_for (count));
+        vector< float > radii (8 * blocks.size (), b.radius);
+        vector< uint8_t > masks (radii.size ());
+
+        pack ({ centers.data (), centers.data () + count }, blocks.data ());
+
+        classify ({ blocks.data (), blocks.data () + blocks.size () },
+                  radii.data (), { view.planes, view.planes + 6 },
+                  masks.data ());
+
+        vector< uint8_t > hidden (nodes);
+
+        for (size_t k = 0; k < count; ++k) {
+            if (masks [k] & SPHERE_OUTSIDE)
+                continue;
+
+            //
+            // Detail level by projected size, the first when the eye is
+            // within the sphere:
+            //
+            const float distance = length (centers [k] - view.eye);
+
+            size_t level = 0;
+
+            if (distance > b.radius) {
+                const float pixels = 2 * b.radius * view.scale / distance;
+
+                if (pixels < options.min_pixels)
+                    continue;
+
+                for (float t = options.detail_pixels;
+                     pixels < t && level + 1 < levels;
+                     t *= options.detail_ratio)
+                    ++level;
+            }
+
+            const int detail = model.pof->detail_subobj.empty ()
+                ? -1 : int (level);
+
+            const size_t instance = first + k;
+
+            const uint8_t* destroyed = model.destroyed.data () +
+                instance * nodes;
+            const transform_t* ts = model.transforms.data () +
+                instance * nodes;
+
+            for (size_t i = 0; i < nodes; ++i) {
+                const int parent = h.parents [i];
+
+                hidden [i] = destroyed [i] || (0 <= parent && hidden [parent]);
+
+                if (hidden [i] || b.details [i] != detail)
+                    continue;
+
+                const size_t c0 = b.node_clusters [i];
+                const size_t c1 = b.node_clusters [i + 1];
+
+                if (c0 == c1)
+                    continue;
+
+                uint8_t mask = masks [k];
+
+                if (mask) {
+                    mask = straddled (view, mask,
+                                      apply (ts [i], b.nodes [i].center),
+                                      b.nodes [i].radius);
+
+                    if (mask & SPHERE_OUTSIDE)
+                        continue;
+                }
+
+                const draw_t draw{ uint32_t (m), uint32_t (instance),
+                    uint32_t (i), b.clusters [c0].first, 0 };
+
+                if (0 == mask || !options.clusters) {
+                    out.push_back (draw);
+                    out.back ().last = b.clusters [c1 - 1].last;
+
+                    continue;
+                }
+
+                //
+                // Runs of the clusters in view:
+                //
+                for (size_t c = c0; c < c1; ++c) {
+                    const auto& cluster = b.clusters [c];
+
+                    if (straddled (view, mask,
+                                   apply (ts [i], cluster.sphere.center),
+                                   cluster.sphere.radius) & SPHERE_OUTSIDE)
+                        continue;
+
+                    if (!out.empty () && out.back ().node == i &&
+                        out.back ().instance == instance &&
+                        out.back ().model == m &&
+                        out.back ().last == cluster.first)
+                        out.back ().last = cluster.last;
+                    else {
+                        out.push_back (draw);
+                        out.back ().first = cluster.first;
+                        out.back ().last = cluster.last;
+                    }
+                }
+            }
+        }
+    };
+
+    if (threads)
+        threads->parallel_for (batches.size (), f);
+    else
+        for (size_t i = 0; i < batches.size (); ++i)
+            f (i);
+
+    for (const auto& result : results)
+        draws.insert (draws.end (), result.begin (), result.end ());
+}
@@ -0,0 +1,118 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_CULL_HH
+#define POF_CULL_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hierarchy.hh"
+#include "instance.hh"
+#include "pof.hh"
+#include "simd.hh"
+#include "vector.hh"
+
+struct thread_pool_t;
+
+//
+// Bounding spheres of a model for culling, in the model's frame at rest:
+//
+// - a sphere about the model's origin which holds every subobject in any
+//   pose, the larger of the model's radius and the reach of each subobject
+//   from the origin, pivot to pivot, with its own sphere at the end,
+// - the sphere of each node, from its subobject's center and radius,
+// - spheres of clusters of up to 64 consecutive polygons of each node, from
+//   the polygons' centers and radii.
+//
+// Nodes also carry the detail level of their subobject. The clusters of node
+// i are those in [node_clusters [i], node_clusters [i + 1]), over polygons
+// [first, last) of the model:
+//
+struct cull_bounds_t {
+    struct sphere_t {
+        vector3f_t center;
+        float radius;
+    };
+
+    struct cluster_t {
+        sphere_t sphere;
+        uint32_t first, last;
+    };
+
+    float radius;
+
+    vector< sphere_t > nodes;
+    vector< int > details;
+
+    vector< cluster_t > clusters;
+    vector< uint32_t > node_clusters;
+};
+
+//
+// Bounds of a model and its flattened hierarchy; throws out_of_range if the
+// polygons of a subobject are not contiguous:
+//
+void bound (const pof_t&, const hierarchy_t&, cull_bounds_t&);
+
+//
+// A perspective view: the planes of the frustum, inside facing, its near
+// plane first, and the eye, with the number of pixels a unit spans at a unit
+// distance from the eye:
+//
+struct view_t {
+    plane_t planes [6];
+
+    vector3f_t eye;
+    float scale;
+};
+
+//
+// View from an eye along a direction, with a vertical field of view, in
+// radians, an aspect ratio, the distances of the near and far planes and the
+// height of the image, in pixels:
+//
+view_t perspective (const vector3f_t& eye, const vector3f_t& forward,
+                    const vector3f_t& up, float fovy, float aspect,
+                    float near, float far, float height);
+
+//
+// An instance whose projected diameter, in pixels, is at least detail_pixels
+// is drawn at detail0, one at least detail_pixels * detail_ratio at detail1,
+// and so forth down to the lowest level of the model; one smaller than
+// min_pixels is not drawn. With clusters set, the polygons of a subobject
+// that straddles the frustum are culled by cluster:
+//
+struct cull_options_t {
+    float detail_pixels = 400.f;
+    float detail_ratio = .4f;
+    float min_pixels = 2.f;
+    bool clusters = false;
+};
+
+//
+// A subobject to draw, a run of its polygons, of an instance of a model of
+// the pool, at the instance's transform for the subobject's node:
+//
+struct draw_t {
+    uint32_t model, instance, node;
+    uint32_t first, last;
+};
+
+//
+// Culls all instances of all models of the pool against the view, from their
+// transforms as of the last update, and appends what is to be drawn, by model
+// then by instance, in batches of instances, in parallel on the pool if any.
+// Bounds are those of the models of the pool, in order.
+//
+// The spheres of the instances of a model are first classified against the
+// frustum in blocks; an instance wholly inside the frustum draws all its
+// subobjects at the chosen level untested, and one that straddles it tests
+// the subobjects against the planes it straddles only. Destroyed subobjects
+// are hidden with those below them:
+//
+void cull (const instance_pool_t&, const vector< cull_bounds_t >&,
+           const view_t&, const cull_options_t&, vector< draw_t >&,
+           thread_pool_t* = 0);
+
+#endif // POF_CULL_HH
@@ -0,0 +1,135 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_CURSOR_HH
+#define POF_CURSOR_HH
+
+#include <cstring>
+#include <ios>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "endian.hh"
+#include "span.hh"
+#include "util.hh"
+#include "vector.hh"
+
+//
+// Bounds-checked read cursor over an in-memory byte range. It mimics the
+// small subset of istream the chunk decoder uses (tellg/seekg) so that the
+// same decoding code works on both; any access outside [beg, end) throws:
+//
+struct cursor_t {
+    const char *beg, *cur, *end;
+
+    cursor_t (const char* p, size_t n)
+        : beg (p), cur (p), end (p + n)
+        { }
+
+    size_t size () const { return end - beg; }
+    size_t avail () const { return end - cur; }
+
+    const char* take (size_t n) {
+        if (n > avail ())
+            throw out_of_range ("cursor_t: read past end of buffer");
+
+        const char* p = cur;
+        return cur += n, p;
+    }
+
+    streamoff tellg () const { return cur - beg; }
+
+    cursor_t& seekg (streamoff off, ios_base::seekdir dir = ios_base::beg) {
+        const char* p = dir == ios_base::beg ? beg
+            : dir == ios_base::cur ? cur : end;
+
+        if (off < beg - p || off > end - p)
+            throw out_of_range ("cursor_t: seek outside of buffer");
+
+        return cur = p + off, *this;
+    }
+
+    explicit operator bool () const { return true; }
+};
+
+//
+// Scalars, and vectors of them, are little-endian in the buffer:
+//
+template< typename T >
+inline cursor_t&
+read (cursor_t& s, T& t, size_t n = sizeof (T)) {
+    t = T{ };
+    memcpy (&t, s.take (n), n);
+
+    if constexpr (is_bulk_v< T >)
+        t = from_little (t);
+
+    return s;
+}
+
+//
+// Copies an array of arithmetic types, or of vectors of them, in one go:
+//
+template< typename T >
+inline cursor_t&
+read (cursor_t& s, span_t< T > xs) {
+    static_assert (is_bulk_v< T >, "read: not an arithmetic type");
+
+    const size_t n = xs.size () * sizeof (T);
+
+    if (n)
+        memcpy (xs.first, s.take (n), n);
+
+    return from_little (xs), s;
+}
+
+static inline cursor_t&
+read (cursor_t& s, char* pbuf, streamsize len, const char* x = "") {
+    int n = 0;
+
+    ASSERT (read (s, n));
+    ASSERT (0 < n);
+
+    string buf (s.take (size_t (n)), size_t (n));
+
+    const size_t j = min (
+        size_t (len), compact_string (&buf [0], size_t (n), x));
+
+    return memcpy (pbuf, buf.data (), j), pbuf [j] = 0, s;
+}
+
+template< typename Traits, typename Alloc >
+inline cursor_t&
+read (cursor_t& s, basic_string< char, Traits, Alloc >& str,
+      const char* x = "") {
+    int n = 0;
+
+    ASSERT (read (s, n));
+    ASSERT (0 < n);
+
+    const size_t at = str.size ();
+    str.append (s.take (size_t (n)), size_t (n));
+
+    str.resize (at + compact_string (&str [at], size_t (n), x));
+
+    return s;
+}
+
+template< typename T, size_t N >
+inline cursor_t&
+read (cursor_t& s, vector_t< T, N >& v) {
+    return read (s, span_t< T >{ v.value, v.value + N });
+}
+
+template< typename T, typename Alloc >
+inline cursor_t&
+read (cursor_t& s, vector< T, Alloc >& xs) {
+    if constexpr (is_bulk_v< T >)
+        read (s, span_t< T >{ xs.data (), xs.data () + xs.size () });
+    else
+        for (auto& x : xs) ASSERT (read (s, x));
+
+    return s;
+}
+
+#endif // POF_CURSOR_HH
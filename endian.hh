@@ -0,0 +1,142 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_ENDIAN_HH
+#define POF_ENDIAN_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <boost/endian/conversion.hpp>
+
+#include "span.hh"
+#include "vector.hh"
+
+//
+// Scalar type of the objects decoded in bulk, arithmetic types and vectors and
+// vertices of them, and void for all other types:
+//
+template< typename T >
+struct scalar_of {
+    using type = conditional_t< is_arithmetic_v< T >, T, void >;
+};
+
+template< typename T, size_t N >
+struct scalar_of< vector_t< T, N > > {
+    using type = typename scalar_of< T >::type;
+};
+
+template< typename T >
+struct scalar_of< vertex_t< T > > {
+    using type = T;
+};
+
+template< typename T >
+using scalar_of_t = typename scalar_of< T >::type;
+
+template< typename T >
+constexpr bool is_bulk_v = !is_void_v< scalar_of_t< T > >;
+
+//
+// Byte shuffles of the compiler's vector extensions, which map to vperm on
+// POWER and z, vrev32 on NEON and pshufb with SSSE3:
+//
+#if defined (__has_builtin)
+#  if __has_builtin (__builtin_shufflevector)
+#    define POF_ENDIAN_SHUFFLE 1
+#  endif
+#endif // __has_builtin
+
+//
+// Reverses the bytes of n 4-byte scalars in place, the bulk of them in byte
+// shuffles of 16 bytes where the compiler has them:
+//
+inline void
+reverse_bytes_4 (unsigned char* p, size_t n) {
+    size_t i = 0;
+
+#if defined (POF_ENDIAN_SHUFFLE)
+    typedef uint8_t bytes_t __attribute__ ((vector_size (16)));
+
+    for (; i + 4 <= n; i += 4, p += 16) {
+        bytes_t x;
+
+        memcpy (&x, p, sizeof x);
+        x = __builtin_shufflevector (
+            x, x, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        memcpy (p, &x, sizeof x);
+    }
+#endif // POF_ENDIAN_SHUFFLE
+
+    for (; i < n; ++i, p += 4) {
+        uint32_t u;
+
+        memcpy (&u, p, sizeof u);
+        u = boost::endian::endian_reverse (u);
+        memcpy (p, &u, sizeof u);
+    }
+}
+
+//
+// POF data is little-endian. Converts objects in place between little-endian
+// and native order, either way. A no-op on little-endian hosts; on big-endian
+// ones, 4-byte scalars, the bulk of the format, go through reverse_bytes_4,
+// and others through a plain loop:
+//
+template< typename T >
+inline void
+from_little (span_t< T > xs) {
+    using S = scalar_of_t< T >;
+    static_assert (is_bulk_v< T >, "from_little: not an arithmetic type");
+
+    if constexpr (boost::endian::order::native != boost::endian::order::little
+                  && 1 < sizeof (S)) {
+        using U = conditional_t< 2 == sizeof (S), uint16_t,
+                  conditional_t< 4 == sizeof (S), uint32_t, uint64_t > >;
+
+        unsigned char* p = reinterpret_cast< unsigned char* > (xs.first);
+        const size_t n = xs.size () * sizeof (T) / sizeof (U);
+
+        if (4 == sizeof (U))
+            return reverse_bytes_4 (p, n);
+
+        for (size_t i = 0; i < n; ++i, p += sizeof (U)) {
+            U u;
+
+            memcpy (&u, p, sizeof u);
+            u = boost::endian::endian_reverse (u);
+            memcpy (p, &u, sizeof u);
+        }
+    }
+}
+
+template< typename T >
+inline void
+to_little (span_t< T > xs) {
+    from_little (xs);
+}
+
+template< typename T >
+inline T
+from_little (T x) {
+    return from_little (span_t< T >{ &x, &x + 1 }), x;
+}
+
+template< typename T >
+inline T
+to_little (T x) {
+    return from_little (x);
+}
+
+//
+// Loads a little-endian object from a possibly unaligned address:
+//
+template< typename T >
+inline T
+load_little (const char* p) {
+    T x;
+    return memcpy (&x, p, sizeof x), from_little (x);
+}
+
+#endif // POF_ENDIAN_HH
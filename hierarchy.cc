@@ -0,0 +1,190 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+#include "hierarchy.hh"
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+//
+// Axis of a subobject's rotation, as a component index, or -1:
+//
+int
+axis_of (const pof_t::subobj_t& subobj) {
+    if (MOVEMENT_TYPE_ROT != subobj.movement.type &&
+        MOVEMENT_TYPE_ROT_SPECIAL != subobj.movement.type)
+        return -1;
+
+    switch (subobj.movement.axis) {
+    case MOVEMENT_AXIS_X: return 0;
+    case MOVEMENT_AXIS_Y: return 1;
+    case MOVEMENT_AXIS_Z: return 2;
+
+    default:
+        return -1;
+    }
+}
+
+//
+// Rotation by an angle about an axis through a pivot:
+//
+inline transform_t
+rotation (int axis, float angle, const vector3f_t& pivot) {
+    transform_t t{ { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }, { } };
+
+    if (0 > axis || 0 == angle)
+        return t;
+
+    const float c = cos (angle), s = sin (angle);
+    const int i = (axis + 1) % 3, j = (axis + 2) % 3;
+
+    t.m [i][i] = c;
+    t.m [i][j] = -s;
+    t.m [j][i] = s;
+    t.m [j][j] = c;
+
+    for (size_t k = 0; k < 3; ++k)
+        t.t.value [k] = pivot.value [k] - (t.m [k][0] * pivot.value [0] +
+                                           t.m [k][1] * pivot.value [1] +
+                                           t.m [k][2] * pivot.value [2]);
+
+    return t;
+}
+
+//
+// Transform b, then a:
+//
+inline transform_t
+compose (const transform_t& a, const transform_t& b) {
+    transform_t t;
+
+    for (size_t k = 0; k < 3; ++k) {
+        for (size_t l = 0; l < 3; ++l)
+            t.m [k][l] = a.m [k][0] * b.m [0][l] + a.m [k][1] * b.m [1][l] +
+                a.m [k][2] * b.m [2][l];
+
+        t.t.value [k] = a.m [k][0] * b.t.value [0] +
+            a.m [k][1] * b.t.value [1] + a.m [k][2] * b.t.value [2] +
+            a.t.value [k];
+    }
+
+    return t;
+}
+
+} // anonymous namespace
+
+void
+flatten (const pof_t& pof, hierarchy_t& h) {
+    const auto& subobjs = pof.subobjs;
+    const size_t n = subobjs.size ();
+
+    //
+    // Depths in one pass, parents first:
+    //
+    vector< int > depths (n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const int parent = subobjs [i].parent;
+
+        ensure (-1 <= parent && parent < int (i),
+                "flatten: sub-object parent out of range");
+
+        depths [i] = 0 > parent ? 0 : depths [parent] + 1;
+    }
+
+    //
+    // Counting sort by depth, stable:
+    //
+    const int deepest = n ? *max_element (depths.begin (), depths.end ()) : -1;
+
+    h.levels.assign (size_t (deepest + 2), 0);
+
+    for (int d : depths)
+        ++h.levels [d + 1];
+
+    for (size_t d = 1; d < h.levels.size (); ++d)
+        h.levels [d] += h.levels [d - 1];
+
+    vector< size_t > at (h.levels.begin (), h.levels.end () - 1);
+
+    h.nodes.resize (n);
+
+    for (size_t i = 0; i < n; ++i)
+        h.nodes [i] = int (at [depths [i]]++);
+
+    h.subobjs.resize (n);
+    h.parents.resize (n);
+    h.depths.resize (n);
+    h.axes.resize (n);
+    h.pivots.resize (n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto& subobj = subobjs [i];
+        const int node = h.nodes [i];
+
+        h.subobjs [node] = int (i);
+        h.parents [node] = 0 > subobj.parent ? -1 : h.nodes [subobj.parent];
+        h.depths [node] = depths [i];
+        h.axes [node] = axis_of (subobj);
+        h.pivots [node] = subobj.off;
+    }
+}
+
+void
+pose (const hierarchy_t& h, span_t< const float > angles,
+      const transform_t& root, transform_t* out) {
+    const size_t n = h.size ();
+
+    ensure (angles.empty () || angles.size () == n,
+            "pose: angles do not match the nodes");
+
+    if (0 == n)
+        return;
+
+    //
+    // Local transforms, then each depth after its parents':
+    //
+    for (size_t i = 0; i < n; ++i)
+        out [i] = rotation (h.axes [i], angles.empty () ? 0 : angles [i],
+                            h.pivots [i]);
+
+    for (size_t i = 0; i < h.levels [1]; ++i)
+        out [i] = compose (root, out [i]);
+
+    for (size_t d = 1; d < h.depth (); ++d) {
+        const size_t first = h.levels [d], last = h.levels [d + 1];
+
+        for (size_t i = first; i < last; ++i)
+            out [i] = compose (out [h.parents [i]], out [i]);
+    }
+}
+
+void
+pose_vertices (const pof_t& pof, const hierarchy_t& h, const transform_t* ts,
+               vector3f_t* out) {
+    const auto& ids = pof.subobj_indices;
+    const vector3f_t* p = pof.vertices.data ();
+
+    const size_t n = pof.vertices.size ();
+
+    for (size_t i = 0, j; i < n; i = j) {
+        const int subobj = ids [i];
+
+        ensure (0 <= subobj && size_t (subobj) < h.nodes.size (),
+                "pose_vertices: vertex subobject out of range");
+
+        for (j = i + 1; j < n && ids [j] == subobj; ++j) ;
+
+        transform ({ p + i, p + j }, ts [h.nodes [subobj]], out + i);
+    }
+}
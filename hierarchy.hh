@@ -0,0 +1,68 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_HIERARCHY_HH
+#define POF_HIERARCHY_HH
+
+#include <cstddef>
+#include <vector>
+
+#include "pof.hh"
+#include "simd.hh"
+#include "span.hh"
+#include "vector.hh"
+
+//
+// Subobject hierarchy of a model, flattened: one node per subobject, sorted by
+// depth, roots first, so that every node comes after its parent and the nodes
+// of a depth are contiguous and independent of one another. Node arrays are
+// parallel; nodes keep the relative order of their subobjects.
+//
+// A node rotates about its pivot, the subobject's origin at rest, if the
+// subobject's movement is a rotation about a known axis; its axis is then 0,
+// 1 or 2 for x, y and z, and -1 otherwise:
+//
+struct hierarchy_t {
+    vector< int > subobjs, parents, depths, axes;
+    vector< vector3f_t > pivots;
+
+    //
+    // Node of each subobject, and the first node of each depth followed by
+    // the number of nodes:
+    //
+    vector< int > nodes;
+    vector< size_t > levels{ 0 };
+
+    size_t size () const { return subobjs.size (); }
+    size_t depth () const { return levels.size () - 1; }
+};
+
+//
+// Flattens the hierarchy of a decoded model, in time linear in the number of
+// subobjects; throws out_of_range if a subobject does not come after its
+// parent:
+//
+void flatten (const pof_t&, hierarchy_t&);
+
+//
+// Transforms of all nodes, indexed by node, given an angle for each node, in
+// radians, counterclockwise about its axis, or none for all at rest; the
+// angles of nodes that do not rotate are ignored. A node's transform takes its
+// subobject's vertices, as decoded, to the frame root takes the model to,
+// with the node rotated about its pivot and then moved by its parent's
+// transform; at rest, with the identity for root, it is the identity.
+//
+// The nodes are swept once, in order, each depth from the local transforms
+// of its nodes and the transforms of their parents, computed by the previous
+// depth:
+//
+void pose (const hierarchy_t&, span_t< const float >, const transform_t& root,
+           transform_t*);
+
+//
+// Vertices of the model posed by the transforms of the nodes, each run of
+// vertices of a subobject transformed in one batch:
+//
+void pose_vertices (const pof_t&, const hierarchy_t&, const transform_t*,
+                    vector3f_t*);
+
+#endif // POF_HIERARCHY_HH
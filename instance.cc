@@ -0,0 +1,142 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "instance.hh"
+#include "pool.hh"
+
+#define INSTANCE_BATCH 64 // instances updated by a task
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+//
+// Moves row j of n elements into row i, then drops the last row:
+//
+template< typename T >
+void
+move_row (vector< T >& v, size_t i, size_t j, size_t n) {
+    if (i != j)
+        copy (v.begin () + j * n, v.begin () + (j + 1) * n, v.begin () + i * n);
+
+    v.resize (v.size () - n);
+}
+
+} // anonymous namespace
+
+size_t
+instance_pool_t::add_model (const pof_t& pof) {
+    models.emplace_back ();
+
+    auto& model = models.back ();
+    model.pof = &pof;
+
+    flatten (pof, model.hierarchy);
+
+    return models.size () - 1;
+}
+
+size_t
+instance_pool_t::add_instance (size_t i, const transform_t& placement) {
+    ensure (i < models.size (), "add_instance: model out of range");
+    auto& model = models [i];
+
+    const size_t n = model.nodes ();
+
+    model.placements.push_back (placement);
+
+    model.angles.resize (model.angles.size () + n, 0.f);
+    model.health.resize (model.health.size () + model.subsystems (), 1.f);
+    model.destroyed.resize (model.destroyed.size () + n, 0);
+    model.transforms.resize (model.transforms.size () + n);
+
+    const size_t k = model.size () - 1;
+
+    pose (model.hierarchy, { }, placement,
+          model.transforms.data () + k * n);
+
+    return k;
+}
+
+void
+instance_pool_t::remove_instance (size_t i, size_t k) {
+    ensure (i < models.size (), "remove_instance: model out of range");
+    auto& model = models [i];
+
+    ensure (k < model.size (), "remove_instance: instance out of range");
+
+    const size_t last = model.size () - 1;
+    const size_t n = model.nodes ();
+
+    move_row (model.placements, k, last, 1);
+    move_row (model.angles, k, last, n);
+    move_row (model.health, k, last, model.subsystems ());
+    move_row (model.destroyed, k, last, n);
+    move_row (model.transforms, k, last, n);
+}
+
+size_t
+instance_pool_t::size () const {
+    size_t n = 0;
+
+    for (const auto& model : models)
+        n += model.size ();
+
+    return n;
+}
+
+void
+instance_pool_t::update (thread_pool_t* pool) {
+    //
+    // Batches of instances of one model each:
+    //
+    vector< pair< size_t, size_t > > batches;
+
+    for (size_t i = 0; i < models.size (); ++i)
+        for (size_t k = 0; k < models [i].size (); k += INSTANCE_BATCH)
+            batches.emplace_back (i, k);
+
+    auto f = [&](size_t batch) {
+        auto& model = models [batches [batch].first];
+
+        const size_t first = batches [batch].second;
+        const size_t last = min (first + INSTANCE_BATCH, model.size ());
+
+        const size_t n = model.nodes ();
+
+        for (size_t k = first; k < last; ++k) {
+            const auto angles = model.angles_of (k);
+
+            pose (model.hierarchy, { angles.begin (), angles.end () },
+                  model.placements [k], model.transforms.data () + k * n);
+        }
+    };
+
+    if (pool)
+        pool->parallel_for (batches.size (), f);
+    else
+        for (size_t i = 0; i < batches.size (); ++i)
+            f (i);
+}
+
+size_t
+instance_pool_t::bytes () const {
+    size_t n = 0;
+
+    for (const auto& model : models)
+        n += model.placements.size () * sizeof (transform_t) +
+            (model.angles.size () + model.health.size ()) * sizeof (float) +
+            model.destroyed.size () +
+            model.transforms.size () * sizeof (transform_t);
+
+    return n;
+}
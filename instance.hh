@@ -0,0 +1,106 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_INSTANCE_HH
+#define POF_INSTANCE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hierarchy.hh"
+#include "pof.hh"
+#include "simd.hh"
+#include "span.hh"
+
+struct thread_pool_t;
+
+//
+// Instances of models sharing one decoded model each. A model is read-only
+// once added and must outlive the pool; what changes per instance is kept by
+// the pool, by model, in parallel arrays with a row per instance:
+//
+// - the placement, which takes the model to the world,
+// - the angle of each node of the flattened hierarchy, of which only those
+//   of the rotating nodes are used,
+// - the health of each subsystem, from 1 to 0,
+// - whether each node is destroyed, which hides it and the nodes below it,
+// - the transform of each node, which takes the subobject's vertices, as
+//   decoded, to the world, as of the last update.
+//
+// Rows of nodes are in node order; a subobject's node is in the hierarchy.
+// Removing an instance moves the model's last instance into its place:
+//
+struct instance_pool_t {
+    struct model_t {
+        const pof_t* pof;
+        hierarchy_t hierarchy;
+
+        vector< transform_t > placements;
+        vector< float > angles, health;
+        vector< uint8_t > destroyed;
+        vector< transform_t > transforms;
+
+        size_t size () const { return placements.size (); }
+
+        size_t nodes () const { return hierarchy.size (); }
+        size_t subsystems () const { return pof->subsys.size (); }
+
+        span_t< float > angles_of (size_t i) {
+            return row (angles, i, nodes ());
+        }
+
+        span_t< float > health_of (size_t i) {
+            return row (health, i, subsystems ());
+        }
+
+        span_t< uint8_t > destroyed_of (size_t i) {
+            return row (destroyed, i, nodes ());
+        }
+
+        span_t< const transform_t > transforms_of (size_t i) const {
+            return row (transforms, i, nodes ());
+        }
+
+    private:
+        template< typename T >
+        static span_t< T > row (vector< T >& v, size_t i, size_t n) {
+            return { v.data () + i * n, v.data () + (i + 1) * n };
+        }
+
+        template< typename T >
+        static span_t< const T >
+        row (const vector< T >& v, size_t i, size_t n) {
+            return { v.data () + i * n, v.data () + (i + 1) * n };
+        }
+    };
+
+    vector< model_t > models;
+
+    //
+    // Adds a model and returns its index:
+    //
+    size_t add_model (const pof_t&);
+
+    //
+    // Adds an instance of a model, at rest, whole and at full health, and
+    // returns its index among the instances of the model:
+    //
+    size_t add_instance (size_t, const transform_t&);
+    void remove_instance (size_t, size_t);
+
+    size_t size () const;
+
+    //
+    // Transforms of the nodes of all instances of all models, from their
+    // placements and angles, in batches of instances, in parallel on the pool
+    // if any:
+    //
+    void update (thread_pool_t* = 0);
+
+    //
+    // Bytes held for the instances, not counting the models they share:
+    //
+    size_t bytes () const;
+};
+
+#endif // POF_INSTANCE_HH
@@ -0,0 +1,49 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "lazy.hh"
+
+lazy_pof_t::lazy_pof_t (
+    const char* filename, const vector< int >& selected, thread_pool_t* pool)
+    : file (filename, MADV_RANDOM), ctx{ } {
+    ctx.pool = pool;
+
+    table = read_chunks (ctx, file.data, file.size);
+
+    for (const auto& chunk : table) {
+        if (selected.empty () || selected.end () != find (
+                selected.begin (), selected.end (), chunk.id)) {
+            read_chunk (ctx, chunk.id, file.data + chunk.offset, chunk.size,
+                        pof);
+            ids.push_back (chunk.id);
+        }
+    }
+
+    //
+    // The detail levels are set on the subobjects, if any were selected:
+    //
+    if (!pof.subobjs.empty ())
+        postprocess (pof);
+}
+
+bool
+lazy_pof_t::has (int id) const {
+    return table.end () != find_if (
+        table.begin (), table.end (), [=](const auto& chunk) {
+            return chunk.id == id;
+        });
+}
+
+bool
+lazy_pof_t::decoded (int id) const {
+    return ids.end () != find (ids.begin (), ids.end (), id);
+}
+
+const pof_t&
+lazy_pof_t::geometry () {
+    call_once (geometry_flag, [this] { read_geometry (ctx, pof); });
+    return pof;
+}
@@ -0,0 +1,48 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_LAZY_HH
+#define POF_LAZY_HH
+
+#include <mutex>
+#include <vector>
+
+#include "mmap.hh"
+#include "pof.hh"
+
+struct thread_pool_t;
+
+//
+// Model decoded from a chunk index. The file is mapped and its chunk table
+// read, then only the chunks with the given ids are decoded; an empty list
+// selects all chunks. The BSP data of the selected subobjects is left in the
+// mapping and decoded on the first call to geometry, which may be made from
+// any number of threads. Until then the model has no vertices, normals and
+// polygons:
+//
+struct lazy_pof_t {
+    explicit lazy_pof_t (const char*, const vector< int >& = { },
+                         thread_pool_t* = 0);
+
+    lazy_pof_t (const lazy_pof_t&) = delete;
+    lazy_pof_t& operator= (const lazy_pof_t&) = delete;
+
+    const vector< pof_chunk_t >& chunks () const { return table; }
+
+    bool has (int) const;
+    bool decoded (int) const;
+
+    const pof_t& get () const { return pof; }
+    const pof_t& geometry ();
+
+private:
+    mapped_file_t file;
+    pof_context_t ctx;
+
+    vector< pof_chunk_t > table;
+    vector< int > ids;
+
+    pof_t pof;
+    once_flag geometry_flag;
+};
+
+#endif // POF_LAZY_HH
@@ -0,0 +1,785 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "lod.hh"
+#include "pool.hh"
+
+#define LOD_MAX_LEVELS   8 // detail levels of a model, at most
+#define LOD_BORDER_WEIGHT 8 // of the planes along open edges, to the faces
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+//
+// Symmetric 4x4 matrix of a quadric, its upper triangle row by row, and the
+// sum of the weights of its planes:
+//
+struct quadric_t {
+    double a [10], w;
+};
+
+inline quadric_t&
+operator+= (quadric_t& lhs, const quadric_t& rhs) {
+    for (size_t i = 0; i < 10; ++i)
+        lhs.a [i] += rhs.a [i];
+
+    return lhs.w += rhs.w, lhs;
+}
+
+inline quadric_t
+operator+ (quadric_t lhs, const quadric_t& rhs) {
+    return lhs += rhs, lhs;
+}
+
+//
+// Quadric of the plane through p with unit normal n, weighted by w:
+//
+inline quadric_t
+plane_quadric (const vector3f_t& n, const vector3f_t& p, double w) {
+    const double a = n.value [0], b = n.value [1], c = n.value [2];
+    const double d = -(a * p.value [0] + b * p.value [1] + c * p.value [2]);
+
+    return { {
+        w * a * a, w * a * b, w * a * c, w * a * d,
+        w * b * b, w * b * c, w * b * d,
+        w * c * c, w * c * d,
+        w * d * d
+    }, w };
+}
+
+//
+// Sum of the weighted squared distances of p to the planes of the quadric:
+//
+inline double
+error (const quadric_t& q, const vector3f_t& p) {
+    const double x = p.value [0], y = p.value [1], z = p.value [2];
+    const double* a = q.a;
+
+    return a [0] * x * x + 2 * a [1] * x * y + 2 * a [2] * x * z +
+        2 * a [3] * x + a [4] * y * y + 2 * a [5] * y * z + 2 * a [6] * y +
+        a [7] * z * z + 2 * a [8] * z + a [9];
+}
+
+//
+// A triangle corner: its vertex and normal, as indices in the model, and its
+// texture coordinates. Of the normals of equal value, corners refer to the
+// first, so that equal normals compare equal:
+//
+struct corner_t {
+    int vertex, normal;
+    float u, v;
+};
+
+inline bool
+same_attributes (const corner_t& lhs, const corner_t& rhs) {
+    return lhs.normal == rhs.normal && lhs.u == rhs.u && lhs.v == rhs.v;
+}
+
+//
+// A triangle over the welded positions of a subobject, with the type, the
+// color, or texture, and the normal of the polygon it comes from:
+//
+struct triangle_t {
+    uint32_t v [3];
+    corner_t c [3];
+    int type, color;
+    vector3f_t normal;
+    bool dead;
+
+    int find (uint32_t x) const {
+        return x == v [0] ? 0 : x == v [1] ? 1 : x == v [2] ? 2 : -1;
+    }
+};
+
+using level_t = vector< triangle_t >;
+
+struct position_hash_t {
+    size_t operator() (const vector3f_t& x) const {
+        uint32_t w [3];
+        memcpy (w, x.value, sizeof w);
+
+        return size_t ((w [0] * 0x9e3779b97f4a7c15ULL) ^
+                       (w [1] * 0xc2b2ae3d27d4eb4fULL) ^
+                       (w [2] * 0x165667b19e3779f9ULL));
+    }
+};
+
+struct position_equal_t {
+    bool operator() (const vector3f_t& lhs, const vector3f_t& rhs) const {
+        return 0 == memcmp (lhs.value, rhs.value, sizeof lhs.value);
+    }
+};
+
+//
+// Collapse of vertex u onto its neighbor v, at the cost of the error of the
+// quadrics of both at v. The candidates of u are stale once its neighborhood
+// changes, which bumps its stamp:
+//
+struct candidate_t {
+    double cost;
+    uint32_t u, v, stamp;
+
+    bool operator> (const candidate_t& other) const {
+        return cost != other.cost ? cost > other.cost
+            : u != other.u ? u > other.u : v > other.v;
+    }
+};
+
+//
+// Half-edge collapse simplifier of one subobject (Garland and Heckbert,
+// with the vertices kept in place). Welded positions are the vertices of the
+// simplification. A vertex on two open edges only moves along them, onto the
+// other end of either, and its quadric has planes through the edges, normal
+// to their triangles, which keep the border in place. Vertices whose corners
+// differ in anything but the vertex index, on an edge shared by more than two
+// triangles or on more than two open edges are locked:
+//
+struct simplifier_t {
+    vector< vector3f_t > positions;
+    vector< quadric_t > quadrics;
+
+    vector< triangle_t > triangles;
+    size_t live = 0;
+
+    //
+    // The triangles around each vertex; some may have died or moved on since
+    // and are dropped by tidy:
+    //
+    vector< vector< uint32_t > > incident;
+
+    vector< uint32_t > stamps;
+    vector< char > locked, border, dead;
+
+    priority_queue< candidate_t, vector< candidate_t >,
+                    greater< candidate_t > > queue;
+
+    vector< uint32_t > scratch [2];
+
+    simplifier_t (const pof_t&, const vector< uint32_t >&);
+
+    void tidy (uint32_t);
+    void neighbors (uint32_t, vector< uint32_t >&);
+
+    void consider (uint32_t);
+    bool collapse (uint32_t, uint32_t);
+
+    //
+    // Largest weighted mean squared distance of a vertex to the planes it
+    // gathered:
+    //
+    double limit = HUGE_VAL;
+
+    vector< level_t > simplify (const vector< size_t >&);
+};
+
+simplifier_t::simplifier_t (const pof_t& pof, const vector< uint32_t >& which) {
+    const auto& polys = pof.polys;
+
+    using ids_type = unordered_map<
+        vector3f_t, uint32_t, position_hash_t, position_equal_t >;
+
+    ids_type ids;
+
+    auto weld = [&](int vertex) {
+        ensure (0 <= vertex && size_t (vertex) < pof.vertices.size (),
+                "lod: polygon vertex out of range");
+
+        const auto& x = pof.vertices [vertex];
+        auto iter = ids.try_emplace (x, uint32_t (positions.size ()));
+
+        if (iter.second)
+            positions.push_back (x);
+
+        return iter.first->second;
+    };
+
+    using normals_type = unordered_map<
+        vector3f_t, int, position_hash_t, position_equal_t >;
+
+    normals_type normals;
+
+    auto first_normal = [&](int normal) {
+        ensure (0 <= normal && size_t (normal) < pof.normals.size (),
+                "lod: polygon normal out of range");
+
+        return normals.try_emplace (pof.normals [normal], normal).first->second;
+    };
+
+    for (auto i : which) {
+        const auto poly = polys [i];
+        const size_t n = poly.vertices.size ();
+
+        auto corner = [&](size_t j) {
+            return corner_t{
+                poly.vertices [j], first_normal (poly.normals [j]),
+                poly.u.empty () ? 0.f : poly.u [j],
+                poly.v.empty () ? 0.f : poly.v [j]
+            };
+        };
+
+        //
+        // Fan around the first corner; triangles that weld into a line are
+        // dropped:
+        //
+        for (size_t j = 1; j + 1 < n; ++j) {
+            triangle_t t{
+                { weld (poly.vertices [0]), weld (poly.vertices [j]),
+                  weld (poly.vertices [j + 1]) },
+                { corner (0), corner (j), corner (j + 1) },
+                poly.type, poly.color, poly.normal, false
+            };
+
+            if (t.v [0] != t.v [1] && t.v [1] != t.v [2] &&
+                t.v [0] != t.v [2])
+                triangles.push_back (t);
+        }
+    }
+
+    const size_t n = positions.size ();
+
+    live = triangles.size ();
+
+    quadrics.assign (n, quadric_t{ });
+    incident.resize (n);
+    stamps.assign (n, 0);
+    locked.assign (n, 0);
+    border.assign (n, 0);
+    dead.assign (n, 0);
+
+    //
+    // The first triangle seen at each vertex, which the others must match:
+    //
+    vector< uint32_t > first (n, ~uint32_t (0));
+    //
+    // The triangles on each edge, and the first of them:
+    //
+    struct edge_t {
+        uint32_t count, triangle;
+    };
+
+    unordered_map< uint64_t, edge_t > edges;
+
+    for (uint32_t i = 0; i < triangles.size (); ++i) {
+        const auto& t = triangles [i];
+
+        const auto& a = positions [t.v [0]];
+        const vector3f_t normal = cross (
+            positions [t.v [1]] - a, positions [t.v [2]] - a);
+
+        const double area = sqrt (dot (normal, normal)) / 2;
+        const quadric_t q = plane_quadric (normalize (normal), a, area);
+
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t x = t.v [k];
+
+            quadrics [x] += q;
+            incident [x].push_back (i);
+
+            if (~uint32_t (0) == first [x])
+                first [x] = i;
+            else {
+                const auto& f = triangles [first [x]];
+
+                if (f.type != t.type || f.color != t.color ||
+                    !same_attributes (f.c [f.find (x)], t.c [k]))
+                    locked [x] = 1;
+            }
+
+            const uint32_t y = t.v [(k + 1) % 3];
+            auto iter = edges.try_emplace (
+                uint64_t (min (x, y)) << 32 | max (x, y), edge_t{ 0, i });
+
+            ++iter.first->second.count;
+        }
+    }
+
+    vector< uint32_t > open (n);
+
+    for (const auto& [edge, e] : edges) {
+        const uint32_t x = uint32_t (edge >> 32), y = uint32_t (edge);
+
+        if (2 < e.count)
+            locked [x] = locked [y] = 1;
+        else if (1 == e.count) {
+            ++open [x];
+            ++open [y];
+
+            const auto& t = triangles [e.triangle];
+
+            const auto& a = positions [t.v [0]];
+            const vector3f_t normal = cross (
+                positions [t.v [1]] - a, positions [t.v [2]] - a);
+
+            const vector3f_t d = positions [y] - positions [x];
+            const quadric_t q = plane_quadric (
+                normalize (cross (d, normal)), positions [x],
+                LOD_BORDER_WEIGHT * dot (d, d));
+
+            quadrics [x] += q;
+            quadrics [y] += q;
+        }
+    }
+
+    for (size_t x = 0; x < n; ++x) {
+        if (2 == open [x])
+            border [x] = 1;
+        else if (open [x])
+            locked [x] = 1;
+    }
+}
+
+void
+simplifier_t::tidy (uint32_t x) {
+    auto& ts = incident [x];
+
+    ts.erase (remove_if (ts.begin (), ts.end (), [&](uint32_t i) {
+        return triangles [i].dead || 0 > triangles [i].find (x);
+    }), ts.end ());
+}
+
+void
+simplifier_t::neighbors (uint32_t x, vector< uint32_t >& xs) {
+    xs.clear ();
+
+    for (auto i : incident [x])
+        for (auto y : triangles [i].v)
+            if (y != x)
+                xs.push_back (y);
+
+    sort (xs.begin (), xs.end ());
+    xs.erase (unique (xs.begin (), xs.end ()), xs.end ());
+}
+
+//
+// Queues the collapses of the vertex onto each of its neighbors, if it may
+// move, onto the neighbors across an open edge, i.e., that share a single
+// triangle with it, if it is on a border; should the cheapest be refused, the
+// next is tried:
+//
+void
+simplifier_t::consider (uint32_t u) {
+    if (locked [u] || dead [u])
+        return;
+
+    tidy (u);
+
+    auto& xs = scratch [0];
+    xs.clear ();
+
+    for (auto i : incident [u])
+        for (auto y : triangles [i].v)
+            if (y != u)
+                xs.push_back (y);
+
+    sort (xs.begin (), xs.end ());
+
+    for (size_t i = 0, j; i < xs.size (); i = j) {
+        const uint32_t v = xs [i];
+
+        for (j = i + 1; j < xs.size () && v == xs [j]; ++j) ;
+
+        if (border [u] && 1 != j - i)
+            continue;
+
+        const quadric_t q = quadrics [u] + quadrics [v];
+        const double cost = max (error (q, positions [v]), 0.);
+
+        if (cost <= limit * q.w)
+            queue.push ({ cost, u, v, stamps [u] });
+    }
+}
+
+//
+// Moves u onto v, unless that would make the surface non-manifold or flip a
+// triangle, and queues the collapses of the vertices around v again:
+//
+bool
+simplifier_t::collapse (uint32_t u, uint32_t v) {
+    tidy (u);
+    tidy (v);
+
+    auto& us = scratch [0];
+    auto& vs = scratch [1];
+
+    neighbors (u, us);
+    neighbors (v, vs);
+
+    //
+    // The vertices next to both must be those across the edge, or the
+    // collapse pinches the surface:
+    //
+    size_t common = 0, shared = 0;
+
+    for (size_t i = 0, j = 0; i < us.size () && j < vs.size ();) {
+        if (us [i] < vs [j])
+            ++i;
+        else if (vs [j] < us [i])
+            ++j;
+        else
+            ++common, ++i, ++j;
+    }
+
+    const corner_t* attributes = 0;
+
+    for (auto i : incident [u]) {
+        const auto& t = triangles [i];
+        const int k = t.find (v);
+
+        if (0 <= k) {
+            attributes = &t.c [k];
+            ++shared;
+
+            continue;
+        }
+
+        //
+        // Triangles that stay must keep facing the same way:
+        //
+        const int j = t.find (u);
+
+        vector3f_t p [3] = {
+            positions [t.v [0]], positions [t.v [1]], positions [t.v [2]]
+        };
+
+        const vector3f_t before = cross (p [1] - p [0], p [2] - p [0]);
+        p [j] = positions [v];
+        const vector3f_t after = cross (p [1] - p [0], p [2] - p [0]);
+
+        if (0 >= dot (before, after) || 0 == dot (after, after))
+            return false;
+    }
+
+    if (0 == shared || common != shared)
+        return false;
+
+    //
+    // The corners of u take v's attributes on u's side of any seam through v,
+    // which the triangles on the edge have:
+    //
+    const corner_t c = *attributes;
+
+    for (auto i : incident [u]) {
+        auto& t = triangles [i];
+
+        if (0 <= t.find (v)) {
+            t.dead = true;
+            --live;
+        }
+        else {
+            const int j = t.find (u);
+
+            t.v [j] = v;
+            t.c [j] = c;
+
+            incident [v].push_back (i);
+        }
+    }
+
+    incident [u].clear ();
+    dead [u] = 1;
+
+    quadrics [v] += quadrics [u];
+
+    tidy (v);
+    neighbors (v, vs);
+
+    const vector< uint32_t > around (vs);
+
+    ++stamps [v];
+    consider (v);
+
+    for (auto x : around) {
+        ++stamps [x];
+        consider (x);
+    }
+
+    return true;
+}
+
+//
+// Collapses vertices, cheapest first, down to each of the triangle counts,
+// in decreasing order, and returns the triangles left at each:
+//
+vector< level_t >
+simplifier_t::simplify (const vector< size_t >& targets) {
+    for (uint32_t u = 0; u < positions.size (); ++u)
+        consider (u);
+
+    vector< level_t > levels;
+
+    for (auto target : targets) {
+        while (live > target && !queue.empty ()) {
+            const auto c = queue.top ();
+            queue.pop ();
+
+            if (dead [c.u] || dead [c.v] || c.stamp != stamps [c.u])
+                continue;
+
+            collapse (c.u, c.v);
+        }
+
+        level_t level;
+        level.reserve (live);
+
+        for (const auto& t : triangles)
+            if (!t.dead)
+                level.push_back (t);
+
+        levels.push_back (move (level));
+    }
+
+    return levels;
+}
+
+//
+// Appends the triangles of a level to the model, as polygons of the
+// subobject, with copies of the vertices and normals they use:
+//
+void
+append_level (pof_t& pof, const level_t& level, int subobj) {
+    unordered_map< int, int > vertices, normals;
+
+    auto vertex = [&](int i) {
+        auto iter = vertices.try_emplace (i, int (pof.vertices.size ()));
+
+        if (iter.second) {
+            const vector3f_t x = pof.vertices [i];
+
+            pof.vertices.push_back (x);
+            pof.subobj_indices.push_back (subobj);
+        }
+
+        return iter.first->second;
+    };
+
+    auto normal = [&](int i) {
+        auto iter = normals.try_emplace (i, int (pof.normals.size ()));
+
+        if (iter.second) {
+            const vector3f_t x = pof.normals [i];
+            pof.normals.push_back (x);
+        }
+
+        return iter.first->second;
+    };
+
+    auto& polys = pof.polys;
+
+    for (const auto& t : level) {
+        const size_t k = polys.append (3);
+        const size_t first = size_t (polys.offsets [k]);
+
+        polys.type [k] = t.type;
+        polys.color [k] = t.color;
+        polys.subobj_index [k] = subobj;
+
+        const vector3f_t p [3] = {
+            pof.vertices [t.c [0].vertex],
+            pof.vertices [t.c [1].vertex],
+            pof.vertices [t.c [2].vertex]
+        };
+
+        const vector3f_t center = (p [0] + p [1] + p [2]) * (1.f / 3);
+
+        float radius = 0;
+
+        for (size_t j = 0; j < 3; ++j)
+            radius = max (radius, dot (p [j] - center, p [j] - center));
+
+        //
+        // Centers are relative to the subobject, as the decoder stores them:
+        //
+        polys.center [k] = center - pof.subobjs [subobj].off;
+        polys.radius [k] = sqrt (radius);
+
+        //
+        // Facing the way the polygon the triangle comes from did:
+        //
+        const vector3f_t n = normalize (cross (p [1] - p [0], p [2] - p [0]));
+        polys.normal [k] = 0 > dot (n, t.normal) ? n * -1.f : n;
+
+        for (size_t j = 0; j < 3; ++j) {
+            polys.vertices [first + j] = vertex (t.c [j].vertex);
+            polys.normals [first + j] = normal (t.c [j].normal);
+
+            if (TEXTPOLY_DEF == t.type) {
+                polys.u [first + j] = t.c [j].u;
+                polys.v [first + j] = t.c [j].v;
+            }
+        }
+    }
+}
+
+//
+// Triangles of the polygons of a detail level, once fan-triangulated:
+//
+size_t
+triangles_of (const pof_t& pof, int detail) {
+    size_t n = 0;
+
+    const auto& polys = pof.polys;
+
+    for (size_t i = 0; i < polys.size (); ++i) {
+        const int subobj = polys.subobj_index [i];
+        const int corners = polys.offsets [i + 1] - polys.offsets [i];
+
+        if (0 <= subobj && size_t (subobj) < pof.subobjs.size () &&
+            detail == pof.subobjs [subobj].detail)
+            n += size_t (max (corners, 2) - 2);
+    }
+
+    return n;
+}
+
+} // anonymous namespace
+
+size_t
+build_lods (pof_t& pof, const lod_options_t& options, thread_pool_t* pool) {
+    ensure (0 < options.ratio && options.ratio <= 1,
+            "lod: ratio out of range");
+
+    if (pof.detail_subobj.empty ())
+        return 0;
+
+    if (options.replace)
+        pof.detail_subobj.resize (1);
+
+    const size_t first = pof.detail_subobj.size ();
+    const size_t last = min (options.levels, size_t (LOD_MAX_LEVELS));
+
+    if (first >= last)
+        return 0;
+
+    const size_t nsubobjs = pof.subobjs.size ();
+    const int root = pof.detail_subobj [0];
+
+    ensure (0 <= root && size_t (root) < nsubobjs,
+            "lod: detail sub-object out of range");
+
+    //
+    // The detail0 hierarchy, parents first, and the polygons of each of its
+    // subobjects:
+    //
+    vector< int > members, member (nsubobjs, -1);
+
+    for (size_t i = 0; i < nsubobjs; ++i) {
+        const int parent = pof.subobjs [i].parent;
+
+        if (int (i) == root ||
+            (0 <= parent && size_t (parent) < i && 0 <= member [parent])) {
+            member [i] = int (members.size ());
+            members.push_back (int (i));
+        }
+    }
+
+    vector< vector< uint32_t > > polys (members.size ());
+
+    for (size_t i = 0; i < pof.polys.size (); ++i) {
+        const int subobj = pof.polys.subobj_index [i];
+
+        if (0 <= subobj && size_t (subobj) < nsubobjs && 0 <= member [subobj])
+            polys [member [subobj]].push_back (uint32_t (i));
+    }
+
+    vector< vector< level_t > > levels (members.size ());
+
+    auto simplify = [&](size_t i) {
+        simplifier_t simplifier (pof, polys [i]);
+
+        const double radius = pof.subobjs [members [i]].radius;
+
+        if (0 < radius && 0 < options.error)
+            simplifier.limit = pow (options.error * radius, 2);
+
+        vector< size_t > targets;
+        const double n = double (simplifier.triangles.size ());
+
+        for (size_t level = first; level < last; ++level)
+            targets.push_back (size_t (ceil (n * pow (options.ratio, level))));
+
+        levels [i] = simplifier.simplify (targets);
+    };
+
+    if (pool)
+        pool->parallel_for (members.size (), simplify);
+    else
+        for (size_t i = 0; i < members.size (); ++i)
+            simplify (i);
+
+    //
+    // Levels stop at the first that is no smaller than the one above it, e.g.,
+    // for a model all borders and seams:
+    //
+    size_t end = first;
+
+    for (size_t above = triangles_of (pof, int (first) - 1); end < last;
+         ++end) {
+        size_t n = 0;
+
+        for (const auto& subobj : levels)
+            n += subobj [end - first].size ();
+
+        if (n >= above)
+            break;
+
+        above = n;
+    }
+
+    if (end == first)
+        return 0;
+
+    //
+    // Each level copies the hierarchy, parents mapped to their copies:
+    //
+    for (size_t level = first; level < end; ++level) {
+        vector< int > copies (members.size ());
+
+        for (size_t i = 0; i < members.size (); ++i) {
+            pof_t::subobj_t subobj (pof.subobjs [members [i]],
+                                    pof.get_allocator ());
+
+            const int index = int (pof.subobjs.size ());
+            const int parent = subobj.parent;
+
+            subobj.number = index;
+
+            if (0 <= parent && 0 <= member [parent])
+                subobj.parent = copies [member [parent]];
+
+            const string name = members [i] == root
+                ? "detail" + to_string (level)
+                : string (subobj.name.data (), subobj.name.size ()) + "-lod" +
+                  to_string (level);
+
+            subobj.name.assign (name.data (), name.size ());
+
+            pof.subobjs.push_back (move (subobj));
+            copies [i] = index;
+
+            append_level (pof, levels [i][level - first], index);
+        }
+
+        pof.detail_subobj.push_back (copies [0]);
+    }
+
+    postprocess (pof);
+
+    return end - first;
+}
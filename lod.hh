@@ -0,0 +1,45 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_LOD_HH
+#define POF_LOD_HH
+
+#include <cstddef>
+
+#include "pof.hh"
+
+struct thread_pool_t;
+
+//
+// Detail levels generated from detail0: the model ends up with levels detail
+// levels, detail0 included, each keeping ratio of the triangles of the one
+// above it. A subobject is not simplified past an error, as a fraction of its
+// radius, of its vertices from the surface of its detail0, whatever the
+// ratio; a level may then have more triangles than asked for, and lower
+// levels as many. Unless replace is set, the levels the model has are kept
+// and only the missing ones are generated; otherwise the model's own lower
+// levels are dropped from detail_subobj, though their subobjects remain:
+//
+struct lod_options_t {
+    size_t levels = 4;
+    float ratio = .5f;
+    float error = .02f;
+    bool replace = false;
+};
+
+//
+// Builds the missing detail levels by quadric edge-collapse simplification of
+// the detail0 hierarchy, each subobject apart, in parallel on the pool if
+// any. Collapses move a vertex onto a neighbor, so that all vertices keep
+// their positions, normals and texture coordinates. A vertex on an open edge,
+// on a UV seam, on a hard edge or between textures is never moved, which
+// keeps these borders intact at all levels.
+//
+// Each level is a copy of the detail0 hierarchy whose subobjects hold the
+// simplified triangles, appended to the subobjects and registered in
+// detail_subobj; the detail levels are then set again. Levels stop short of
+// the first that would be no smaller than the one above it. Returns the number
+// of levels added:
+//
+size_t build_lods (pof_t&, const lod_options_t& = { }, thread_pool_t* = 0);
+
+#endif // POF_LOD_HH
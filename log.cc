@@ -2,50 +2,260 @@
 
 #define BOOST_LOG_DYN_LINK 1
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
 #include <thread>
 #include <mutex>
 
+#include <boost/core/null_deleter.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <boost/log/expressions.hpp>
-#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/sources/severity_channel_logger.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
 
 using namespace boost::log;
 
 #include "log.hh"
 
+#define LOG_QUEUE_SIZE 1024 // records, a power of two
+
+std::atomic< int > pof_log_threshold{ trivial::warning };
+
 BOOST_LOG_ATTRIBUTE_KEYWORD (severity, "Severity", trivial::severity_level)
 BOOST_LOG_ATTRIBUTE_KEYWORD (channel, "Channel", std::string)
 
-BOOST_LOG_GLOBAL_LOGGER_INIT(pof_logger, pof_logger_type) {
-    pof_logger_type logger;
+namespace {
+
+//
+// Queueing strategy of the asynchronous sink: a bounded, lock-free ring of
+// records, after Vyukov's MPMC queue. Each slot carries a sequence number
+// which tells whether the slot is free for the enqueue at a position, or
+// holds the record for the dequeue at that position. Producers only wait when
+// the ring is full, yielding to the writer thread. The writer sleeps while the
+// ring is empty, for a few milliseconds at a time, and producers wake it up
+// early only once the ring is half full, so that a burst of records costs a
+// single wake up, not one each:
+//
+class ring_queue_t {
+    struct slot_t {
+        std::atomic< size_t > sequence;
+        record_view record;
+    };
+
+    std::unique_ptr< slot_t [] > slots;
+
+    alignas (64) std::atomic< size_t > head{ };
+    alignas (64) std::atomic< size_t > tail{ };
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic< bool > sleeping{ false }, interrupted{ false };
+
+    void wake (size_t pos) {
+        if (pos - tail.load (std::memory_order_relaxed) >= LOG_QUEUE_SIZE / 2 &&
+            sleeping.load ()) {
+            std::lock_guard< std::mutex > lock (m);
+            cv.notify_one ();
+        }
+    }
+
+protected:
+    ring_queue_t () : slots (new slot_t [LOG_QUEUE_SIZE]) {
+        for (size_t i = 0; i < LOG_QUEUE_SIZE; ++i)
+            slots [i].sequence.store (i, std::memory_order_relaxed);
+    }
+
+    template< typename Args >
+    explicit ring_queue_t (const Args&) : ring_queue_t () { }
+
+    bool try_enqueue (const record_view& record) {
+        size_t pos = head.load (std::memory_order_relaxed);
+
+        for (;;) {
+            auto& slot = slots [pos & (LOG_QUEUE_SIZE - 1)];
+
+            const size_t sequence = slot.sequence.load (
+                std::memory_order_acquire);
+            const intptr_t diff = intptr_t (sequence) - intptr_t (pos);
+
+            if (0 == diff) {
+                if (head.compare_exchange_weak (
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.record = record;
+                    slot.sequence.store (pos + 1);
+
+                    return wake (pos), true;
+                }
+            }
+            else if (0 > diff)
+                return false;
+            else
+                pos = head.load (std::memory_order_relaxed);
+        }
+    }
+
+    void enqueue (const record_view& record) {
+        while (!try_enqueue (record))
+            std::this_thread::yield ();
+    }
+
+    bool try_dequeue (record_view& record) {
+        size_t pos = tail.load (std::memory_order_relaxed);
+
+        for (;;) {
+            auto& slot = slots [pos & (LOG_QUEUE_SIZE - 1)];
+
+            const size_t sequence = slot.sequence.load (
+                std::memory_order_acquire);
+            const intptr_t diff = intptr_t (sequence) - intptr_t (pos + 1);
+
+            if (0 == diff) {
+                if (tail.compare_exchange_weak (
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    record = std::move (slot.record);
+                    slot.record = record_view ();
+
+                    slot.sequence.store (pos + LOG_QUEUE_SIZE,
+                                         std::memory_order_release);
+
+                    return true;
+                }
+            }
+            else if (0 > diff)
+                return false;
+            else
+                pos = tail.load (std::memory_order_relaxed);
+        }
+    }
+
+    bool try_dequeue_ready (record_view& record) {
+        return try_dequeue (record);
+    }
+
+    //
+    // The timeout of the sleep bounds the delay of a record:
+    //
+    bool dequeue_ready (record_view& record) {
+        for (;;) {
+            if (try_dequeue (record))
+                return true;
+
+            if (interrupted.exchange (false, std::memory_order_acquire))
+                return false;
+
+            std::unique_lock< std::mutex > lock (m);
+            sleeping.store (true);
 
+            if (try_dequeue (record))
+                return sleeping.store (false), true;
+
+            if (!interrupted.load ())
+                cv.wait_for (lock, std::chrono::milliseconds (10));
+
+            sleeping.store (false);
+        }
+    }
+
+    void interrupt_dequeue () {
+        interrupted.store (true, std::memory_order_release);
+
+        std::lock_guard< std::mutex > lock (m);
+        cv.notify_one ();
+    }
+};
+
+using backend_type = sinks::text_ostream_backend;
+using sink_type = sinks::asynchronous_sink< backend_type, ring_queue_t >;
+
+boost::shared_ptr< sink_type > sink;
+boost::shared_ptr< std::ostream > stream;
+
+//
+// Records of the general channel at or above the threshold, and errors on any
+// channel:
+//
+filter
+make_filter (trivial::severity_level threshold) {
     using min_severity_filter = expressions::channel_severity_filter_actor<
         std::string, trivial::severity_level >;
 
-    min_severity_filter filter = expressions::channel_severity_filter (
+    min_severity_filter by_channel = expressions::channel_severity_filter (
         channel, severity);
 
-    filter ["general"] = trivial::warning;
+    by_channel ["general"] = threshold;
+
+    return by_channel || severity >= trivial::error;
+}
+
+//
+// Writes out the records still queued as the program exits; later records
+// are dropped:
+//
+void
+stop_sink () {
+    core::get ()->remove_sink (sink);
+
+    sink->stop ();
+    sink->flush ();
+}
+
+} // anonymous namespace
+
+BOOST_LOG_GLOBAL_LOGGER_INIT(pof_logger, pof_logger_type) {
+    pof_logger_type logger;
+
+    stream.reset (&std::clog, boost::null_deleter ());
+
+    auto backend = boost::make_shared< backend_type > ();
 
-    add_console_log (
-        std::clog,
-        keywords::filter = filter || severity >= trivial::error,
-        keywords::format = expressions::stream
+    backend->add_stream (stream);
+    backend->auto_flush (true);
+
+    sink = boost::make_shared< sink_type > (backend);
+
+    sink->set_filter (make_filter (
+        trivial::severity_level (pof_log_threshold.load ())));
+    sink->set_formatter (
+        expressions::stream
         << expressions::format_date_time< boost::posix_time::ptime > (
             "TimeStamp", "%Y%m%dT%H%M%S.%f") << ": ["
         << channel << "] "
         << expressions::attr< trivial::severity_level >("Severity") << ": "
-        << expressions::smessage );
+        << expressions::smessage);
+
+    core::get ()->add_sink (sink);
+    std::atexit (stop_sink);
 
     return add_common_attributes (), logger;
 }
+
+void
+pof_set_log_threshold (trivial::severity_level threshold) {
+    pof_logger::get ();
+
+    pof_log_threshold.store (threshold);
+    sink->set_filter (make_filter (threshold));
+}
+
+void
+pof_set_log_stream (std::ostream& s) {
+    pof_logger::get ();
+    sink->flush ();
+
+    auto backend = sink->locked_backend ();
+
+    backend->remove_stream (stream);
+    stream.reset (&s, boost::null_deleter ());
+    backend->add_stream (stream);
+}
@@ -5,6 +5,9 @@
 
 #define BOOST_LOG_DYN_LINK 1
 
+#include <atomic>
+#include <ostream>
+
 #include <boost/log/trivial.hpp>
 #include <boost/log/sources/global_logger_storage.hpp>
 #include <boost/log/sources/severity_channel_logger.hpp>
@@ -15,8 +18,50 @@ using pof_logger_type = boost::log::sources::severity_channel_logger_mt<
 
 BOOST_LOG_GLOBAL_LOGGER(pof_logger, pof_logger_type)
 
-#define FS2_LOG(channel, severity) BOOST_LOG_CHANNEL_SEV( \
-        pof_logger::get (), channel, boost::log::trivial::severity)
+//
+// Lowest severity the sink accepts on any channel. Records below it are
+// dropped before the logger opens them, which saves the filter and the lock
+// of the logger in the loops of the decoder. It is read here and set with
+// pof_set_log_threshold, which sets the filter of the sink along:
+//
+extern std::atomic< int > pof_log_threshold;
+
+void pof_set_log_threshold (boost::log::trivial::severity_level);
+
+//
+// Stream the sink writes the records to, std::clog by default; the records
+// queued so far are written out to the previous stream first:
+//
+void pof_set_log_stream (std::ostream&);
+
+//
+// Records below the minimum severity are compiled out, along with what they
+// would format; they cost nothing, not even the threshold check. The default
+// is to keep all records, and warnings and up in release (NDEBUG) builds, e.g.:
+//
+//   make CPPFLAGS="-I. -DPOF_LOG_MIN_SEVERITY=error"
+//
+#if !defined (POF_LOG_MIN_SEVERITY)
+#  if defined (NDEBUG)
+#    define POF_LOG_MIN_SEVERITY warning
+#  else
+#    define POF_LOG_MIN_SEVERITY trace
+#  endif // NDEBUG
+#endif // POF_LOG_MIN_SEVERITY
+
+#define POF_LOG_STRINGIFY_(x) #x
+#define POF_LOG_STRINGIFY(x) POF_LOG_STRINGIFY_(x)
+
+#define POF_LOG_MIN_SEVERITY_NAME POF_LOG_STRINGIFY (POF_LOG_MIN_SEVERITY)
+
+#define FS2_LOG(channel, severity)                                      \
+    for (bool pof_log_on_ = boost::log::trivial::severity >=            \
+             boost::log::trivial::POF_LOG_MIN_SEVERITY &&               \
+             boost::log::trivial::severity >=                           \
+             pof_log_threshold.load (std::memory_order_relaxed);        \
+         pof_log_on_; pof_log_on_ = false)                              \
+        BOOST_LOG_CHANNEL_SEV(                                          \
+            pof_logger::get (), channel, boost::log::trivial::severity)
 
 #define FS2_EE(channel) FS2_LOG (channel, error)
 #define FS2_WW(channel) FS2_LOG (channel, warning)
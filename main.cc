@@ -0,0 +1,1085 @@
+// -*- mode: c++; -*-
+
+#define BOOST_LOG_DYN_LINK 1
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+#include "arena.hh"
+#include "assert.hh"
+#include "bake.hh"
+#include "batch.hh"
+#include "bvh.hh"
+#include "hierarchy.hh"
+#include "lazy.hh"
+#include "lod.hh"
+#include "log.hh"
+#include "mesh.hh"
+#include "parser.hh"
+#include "pof.hh"
+#include "pool.hh"
+#include "quant.hh"
+#include "raster.hh"
+#include "shield.hh"
+#include "trace.hh"
+#include "vector.hh"
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+load_stream (const char* filename, pof_t& pof) {
+    ifstream s (filename, ios_base::in | ios_base::binary);
+    s.exceptions (ios_base::badbit | ios_base::failbit);
+
+    ASSERT (read (s, pof));
+}
+
+static void
+load_streaming (const char* filename, pof_t& pof) {
+    ifstream s (filename, ios_base::in | ios_base::binary);
+    s.exceptions (ios_base::badbit);
+
+    read_streaming (s, pof);
+}
+
+//
+// Repeatedly loads the file, at least 8 times and for at least 250 ms, and
+// returns the throughput in MB/s:
+//
+template< typename Loader >
+static double
+throughput (const char* filename, Loader loader) {
+    using clock_type = chrono::steady_clock;
+
+    size_t n = 0;
+    auto start = clock_type::now (), stop = start;
+
+    for (; n < 8 || stop - start < chrono::milliseconds (250); ++n) {
+        auto p = make_unique< pof_t > ();
+        loader (filename, *p);
+
+        stop = clock_type::now ();
+    }
+
+    chrono::duration< double > elapsed = stop - start;
+    return double (fs::file_size (filename)) * n / elapsed.count () / 1e6;
+}
+
+//
+// Loads all models under a directory and reports the aggregate throughput:
+//
+static int
+run_batch (const char* dirname, size_t nthreads) {
+    thread_pool_t pool (nthreads);
+
+    auto batch = load_directory (dirname, pool);
+    auto n = batch.items.size ();
+
+    cout << dirname << " : " << n << " files (" << batch.failures
+         << " failed), " << batch.bytes / 1e6 << " MB in " << batch.seconds
+         << " s on " << pool.size () << " threads : "
+         << n / batch.seconds << " files/s, "
+         << batch.bytes / batch.seconds / 1e6 << " MB/s" << endl;
+
+    return batch.failures ? 1 : 0;
+}
+
+//
+// Loads all models under a directory, then renders a thumbnail of each into
+// the output directory, named after the model, and reports the rate of each
+// step:
+//
+static int
+run_thumbnails (const char* dirname, const char* outdir,
+                const render_options_t& options, size_t nthreads) {
+    using clock_type = chrono::steady_clock;
+
+    thread_pool_t pool (nthreads);
+
+    auto batch = load_directory (dirname, pool);
+    fs::create_directories (outdir);
+
+    auto start = clock_type::now ();
+
+    pool.parallel_for (batch.items.size (), [&](size_t i) {
+        auto& item = batch.items [i];
+
+        if (!item.error.empty ())
+            return;
+
+        try {
+            image_t image;
+            render (item.pof, options, image);
+
+            auto path = fs::path (outdir) /
+                fs::path (item.filename).filename ().replace_extension (".ppm");
+
+            write_ppm (path.c_str (), image);
+        }
+        catch (const exception& e) {
+            WW << item.filename << " : " << e.what ();
+        }
+    });
+
+    chrono::duration< double > elapsed = clock_type::now () - start;
+    auto n = batch.items.size () - batch.failures;
+
+    cout << dirname << " : " << n << " thumbnails, " << options.width << "x"
+         << options.height << ", loaded at " << n / batch.seconds * 60
+         << " models/min, rendered at " << n / elapsed.count () * 60
+         << " models/min on " << pool.size () << " threads" << endl;
+
+    return batch.failures ? 1 : 0;
+}
+
+static size_t
+heap_in_use () {
+    auto info = mallinfo2 ();
+    return info.uordblks + info.hblkhd;
+}
+
+static size_t
+resident_set_size () {
+    size_t pages = 0, resident = 0;
+
+    ifstream s ("/proc/self/statm");
+    s >> pages >> resident;
+
+    return resident * size_t (sysconf (_SC_PAGESIZE));
+}
+
+//
+// Loads the file once and reports the load time and the memory the model
+// holds, as heap in use and as growth of the resident set:
+//
+static void
+report_memory (const char* filename) {
+    malloc_trim (0);
+
+    size_t heap = heap_in_use (), rss = resident_set_size ();
+
+    auto start = chrono::steady_clock::now ();
+
+    auto p = make_unique< pof_t > ();
+    load (filename, *p);
+
+    chrono::duration< double, milli > elapsed =
+        chrono::steady_clock::now () - start;
+
+    cout << filename << " : " << p->polys.size () << " polygons, "
+         << p->polys.corners () << " corners, loaded in " << elapsed.count ()
+         << " ms, heap " << (heap_in_use () - heap) / 1e6 << " MB, rss "
+         << (resident_set_size () - rss) / 1e6 << " MB" << endl;
+}
+
+//
+// Loads the file from the global heap, then into an arena, and reports the
+// number of allocations each model took and the time taken to free it:
+//
+static void
+report_allocations (const char* filename) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto report = [&](const char* name, const counting_resource_t& counter,
+                      ms_type load_time, ms_type free_time) {
+        cout << filename << " : " << name << " : " << counter.allocations
+             << " allocations, " << counter.bytes / 1e6 << " MB, load "
+             << load_time.count () << " ms, free " << free_time.count ()
+             << " ms" << endl;
+    };
+
+    {
+        counting_resource_t counter;
+
+        auto start = clock_type::now ();
+
+        auto p = make_unique< pof_t > (&counter);
+        load (filename, *p);
+
+        auto stop = clock_type::now ();
+        p.reset ();
+
+        report ("heap ", counter, stop - start, clock_type::now () - stop);
+    }
+
+    {
+        counting_resource_t counter;
+
+        auto start = clock_type::now ();
+
+        auto p = make_unique< pof_arena_t > (
+            size_t (fs::file_size (filename)), &counter);
+        load (filename, **p);
+
+        auto stop = clock_type::now ();
+        p.reset ();
+
+        report ("arena", counter, stop - start, clock_type::now () - stop);
+    }
+}
+
+//
+// Parses a comma-separated list of chunk ids, e.g., "HDR2,SPCL,EYE"; ids
+// shorter than four characters are padded with spaces:
+//
+static vector< int >
+parse_chunk_ids (const char* s) {
+    vector< int > ids;
+
+    for (string tok; *s; ) {
+        for (tok.clear (); *s && ',' != *s; ++s)
+            tok += *s;
+
+        if (*s)
+            ++s;
+
+        if (tok.empty ())
+            continue;
+
+        tok.resize (4, ' ');
+
+        int id = 0;
+        for (size_t i = 0; i < 4; ++i)
+            id = (id << 8) | (unsigned char)tok [i];
+
+        ids.push_back (id);
+    }
+
+    return ids;
+}
+
+//
+// Decodes the selected chunks through the chunk index, then the geometry on
+// first access, and compares the time and memory of each step against a full
+// load:
+//
+static void
+report_lazy (const char* filename, const vector< int >& ids) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto report = [&](const char* name, ms_type elapsed, size_t heap) {
+        cout << filename << " : " << name << " : " << elapsed.count ()
+             << " ms, heap " << (heap_in_use () - heap) / 1e6 << " MB"
+             << endl;
+    };
+
+    malloc_trim (0);
+
+    {
+        size_t heap = heap_in_use ();
+        auto start = clock_type::now ();
+
+        auto p = make_unique< lazy_pof_t > (filename, ids);
+        report ("chunks  ", clock_type::now () - start, heap);
+
+        start = clock_type::now ();
+        p->geometry ();
+
+        report ("geometry", clock_type::now () - start, heap);
+    }
+
+    malloc_trim (0);
+
+    {
+        size_t heap = heap_in_use ();
+        auto start = clock_type::now ();
+
+        auto p = make_unique< pof_t > ();
+        load (filename, *p);
+
+        report ("full    ", clock_type::now () - start, heap);
+    }
+}
+
+//
+// Drops the cached pages of a file, so that the next load reads it from disk:
+//
+static void
+evict (const char* filename) {
+    int fd = ::open (filename, O_RDONLY | O_CLOEXEC);
+
+    if (0 <= fd) {
+        ::fdatasync (fd);
+        ::posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close (fd);
+    }
+}
+
+//
+// Sums the vertex indices of all polygon corners, which touches the whole
+// polygon store:
+//
+template< typename Polys >
+static long
+touch (const Polys& polys) {
+    long sum = 0;
+
+    for (size_t i = 0; i < polys.size (); ++i)
+        for (auto j : polys [i].vertices)
+            sum += j;
+
+    return sum;
+}
+
+//
+// Compares the cold start of a model, from evicted files to a walk over its
+// polygons: decoding the POF, opening the baked cache after checking it
+// against the POF, and opening the baked cache alone. Reports the median of
+// a few runs of each:
+//
+static void
+report_cold_start (const char* filename, const char* cache) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    load_baked (filename, cache);
+
+    auto median = [&](auto f) {
+        vector< double > xs;
+
+        for (size_t i = 0; i < 5; ++i) {
+            evict (filename);
+            evict (cache);
+
+            auto start = clock_type::now ();
+            f ();
+
+            xs.push_back (ms_type (clock_type::now () - start).count ());
+        }
+
+        sort (xs.begin (), xs.end ());
+        return xs [xs.size () / 2];
+    };
+
+    long sum [3] = { };
+
+    double raw = median ([&] {
+        auto p = make_unique< pof_t > ();
+        load (filename, *p);
+        sum [0] = touch (p->polys);
+    });
+
+    double checked = median ([&] {
+        auto p = load_baked (filename, cache);
+        sum [1] = touch (p->polys ());
+    });
+
+    double baked = median ([&] {
+        auto p = make_unique< baked_pof_t > (cache);
+        sum [2] = touch (p->polys ());
+    });
+
+    ASSERT (sum [0] == sum [1] && sum [0] == sum [2]);
+
+    cout << filename << " : cold start, pof " << raw << " ms, baked "
+         << "(checked) " << checked << " ms, baked " << baked << " ms"
+         << endl;
+}
+
+//
+// Bakes the render-ready mesh of the model and reports its size and the time
+// taken to bake it, then optimizes it and splits it in meshlets, and reports
+// the average cache miss ratio before and after:
+//
+static void
+report_mesh (const char* filename) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto p = make_unique< pof_t > ();
+    load (filename, *p);
+
+    mesh_t mesh;
+
+    auto start = clock_type::now ();
+    bake_mesh (*p, mesh);
+    ms_type elapsed = clock_type::now () - start;
+
+    size_t wide = count_if (
+        mesh.batches.begin (), mesh.batches.end (), [](const auto& batch) {
+            return 4 == batch.index_size;
+        });
+
+    cout << filename << " : " << p->polys.size () << " polygons, "
+         << p->polys.corners () << " corners -> " << mesh.triangles ()
+         << " triangles, " << mesh.vertices.size () << " vertices in "
+         << mesh.batches.size () << " batches (" << wide << " 32-bit), "
+         << "vertex buffer " << mesh.vertices.size () * sizeof (mesh_vertex_t)
+         / 1e6 << " MB, index buffer " << mesh.indices.size () / 1e6
+         << " MB, baked in " << elapsed.count () << " ms" << endl;
+
+    const double before = acmr (mesh);
+
+    start = clock_type::now ();
+    optimize_mesh (mesh);
+    elapsed = clock_type::now () - start;
+
+    cout << filename << " : ACMR " << before << " -> " << acmr (mesh)
+         << ", optimized in " << elapsed.count () << " ms" << endl;
+
+    meshlets_t meshlets;
+
+    start = clock_type::now ();
+    build_meshlets (mesh, meshlets);
+    elapsed = clock_type::now () - start;
+
+    cout << filename << " : " << meshlets.meshlets.size () << " meshlets, "
+         << double (mesh.triangles ()) / meshlets.meshlets.size ()
+         << " triangles and " << double (meshlets.vertices.size ()) /
+        meshlets.meshlets.size () << " vertices each, built in "
+         << elapsed.count () << " ms" << endl;
+}
+
+//
+// Builds the hierarchies of the model and casts random rays at the subobjects
+// of a detail level, from a sphere around them towards points in their
+// bounds, and reports the rays cast per second, serially and on the pool:
+//
+static void
+report_rays (const char* filename, size_t nrays, int detail,
+             thread_pool_t& pool) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto p = make_unique< pof_t > ();
+    load (filename, *p, pool);
+
+    bvh_t bvh;
+
+    auto start = clock_type::now ();
+    build_bvh (*p, bvh);
+    ms_type serial = clock_type::now () - start;
+
+    start = clock_type::now ();
+    build_bvh (*p, bvh, &pool);
+    ms_type parallel = clock_type::now () - start;
+
+    cout << filename << " : " << bvh.triangles.size () << " triangles, "
+         << bvh.nodes.size () << " nodes (" << bvh.nodes.size () *
+        sizeof (bvh_t::node_t) / 1e6 << " MB), built in " << serial.count ()
+         << " ms, " << parallel.count () << " ms on " << pool.size ()
+         << " threads" << endl;
+
+    vector< int > subobjs;
+
+    for (size_t i = 0; i < p->subobjs.size (); ++i)
+        if (detail == p->subobjs [i].detail)
+            subobjs.push_back (int (i));
+
+    if (subobjs.empty ())
+        for (size_t i = 0; i < p->subobjs.size (); ++i)
+            if (9 != p->subobjs [i].detail)
+                subobjs.push_back (int (i));
+
+    //
+    // Bounds of the triangles cast at:
+    //
+    aabb_t box{
+        { { HUGE_VALF, HUGE_VALF, HUGE_VALF } },
+        { { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF } }
+    };
+
+    for (int i : subobjs) {
+        const auto& tree = bvh.trees [i];
+
+        if (tree.nodes) {
+            const auto& root = bvh.nodes [tree.first_node].box;
+
+            for (size_t k = 0; k < 3; ++k) {
+                box.lo.value [k] = min (box.lo.value [k], root.lo.value [k]);
+                box.hi.value [k] = max (box.hi.value [k], root.hi.value [k]);
+            }
+        }
+    }
+
+    if (box.hi.value [0] < box.lo.value [0]) {
+        cout << filename << " : no triangles to cast at" << endl;
+        return;
+    }
+
+    const vector3f_t center = (box.lo + box.hi) * .5f;
+    const float radius = sqrt (dot (box.hi - center, box.hi - center));
+
+    mt19937 g (1);
+    uniform_real_distribution< float > d (0.f, 1.f);
+    normal_distribution< float > n;
+
+    vector< ray_t > rays (nrays);
+
+    for (auto& ray : rays) {
+        vector3f_t origin, target;
+
+        for (size_t k = 0; k < 3; ++k) {
+            origin.value [k] = n (g);
+            target.value [k] = box.lo.value [k] +
+                d (g) * (box.hi.value [k] - box.lo.value [k]);
+        }
+
+        ray.origin = center + normalize (origin) * (2 * radius);
+        ray.direction = normalize (target - ray.origin);
+        ray.t = 4 * radius;
+    }
+
+    vector< hit_t > hits (nrays);
+
+    const span_t< const int > which{
+        subobjs.data (), subobjs.data () + subobjs.size () };
+
+    const span_t< const ray_t > all{ rays.data (), rays.data () + nrays };
+
+    start = clock_type::now ();
+    cast (bvh, which, all, hits.data ());
+    serial = clock_type::now () - start;
+
+    start = clock_type::now ();
+    cast (bvh, which, all, hits.data (), &pool);
+    parallel = clock_type::now () - start;
+
+    const size_t nhits = count_if (hits.begin (), hits.end (), [](auto& hit) {
+        return 0 <= hit.subobj;
+    });
+
+    cout << filename << " : " << nrays << " rays, " << nhits << " hits, "
+         << nrays / serial.count () / 1e3 << " Mrays/s, "
+         << nrays / parallel.count () / 1e3 << " Mrays/s on " << pool.size ()
+         << " threads" << endl;
+}
+
+//
+// Casts random rays at the shield, from a sphere around it towards points in
+// its bounds, and reports the queries answered per second: cold, without a
+// hint, and coherent, each ray a little off the previous one with the
+// previous hit as the hint, as for a beam; then swept spheres:
+//
+static void
+report_shield (const char* filename, size_t nrays, thread_pool_t& pool) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto p = make_unique< pof_t > ();
+    load (filename, *p, pool);
+
+    shield_mesh_t mesh;
+
+    auto start = clock_type::now ();
+    build_shield (*p, mesh);
+    ms_type elapsed = clock_type::now () - start;
+
+    if (mesh.faces.empty ()) {
+        cout << filename << " : no shield" << endl;
+        return;
+    }
+
+    cout << filename << " : " << mesh.faces.size () << " shield faces, "
+         << (mesh.convex ? "convex" : "not convex") << ", " << mesh.dims [0]
+         << "x" << mesh.dims [1] << "x" << mesh.dims [2] << " grid, built in "
+         << elapsed.count () << " ms" << endl;
+
+    const vector3f_t center = (mesh.box.lo + mesh.box.hi) * .5f;
+    const vector3f_t half = mesh.box.hi - center;
+    const float radius = sqrt (dot (half, half));
+
+    mt19937 g (1);
+    uniform_real_distribution< float > d (-1.f, 1.f);
+    normal_distribution< float > n;
+
+    auto target = [&] {
+        vector3f_t x;
+
+        for (size_t k = 0; k < 3; ++k)
+            x.value [k] = center.value [k] + d (g) * half.value [k];
+
+        return x;
+    };
+
+    vector< ray_t > cold (nrays), coherent (nrays);
+
+    for (auto& ray : cold) {
+        vector3f_t x{ { n (g), n (g), n (g) } };
+
+        ray.origin = center + normalize (x) * (2 * radius);
+        ray.direction = normalize (target () - ray.origin);
+        ray.t = 4 * radius;
+    }
+
+    //
+    // Beams of 64 rays whose target drifts by a small fraction of the
+    // shield's size from ray to ray:
+    //
+    for (size_t i = 0; i < nrays; i += 64) {
+        vector3f_t x{ { n (g), n (g), n (g) } }, at = target ();
+        const vector3f_t origin = center + normalize (x) * (2 * radius);
+
+        for (size_t j = i; j < min (i + 64, nrays); ++j) {
+            for (size_t k = 0; k < 3; ++k)
+                at.value [k] += d (g) * .01f * radius;
+
+            coherent [j] = { origin, normalize (at - origin), 4 * radius };
+        }
+    }
+
+    size_t nhits = 0;
+    shield_hit_t hit;
+
+    start = clock_type::now ();
+
+    for (const auto& ray : cold)
+        nhits += cast (mesh, ray, hit);
+
+    const ms_type cold_time = clock_type::now () - start;
+
+    int hint = -1;
+    start = clock_type::now ();
+
+    for (size_t i = 0; i < nrays; ++i) {
+        if (0 == i % 64)
+            hint = -1;
+
+        if (cast (mesh, coherent [i], hit, hint))
+            hint = hit.face;
+    }
+
+    const ms_type coherent_time = clock_type::now () - start;
+
+    hint = -1;
+    start = clock_type::now ();
+
+    for (size_t i = 0; i < nrays; ++i) {
+        if (0 == i % 64)
+            hint = -1;
+
+        if (sweep (mesh, coherent [i], .02f * radius, hit, hint))
+            hint = hit.face;
+    }
+
+    const ms_type sweep_time = clock_type::now () - start;
+
+    cout << filename << " : " << nrays << " rays, " << nhits << " hits, "
+         << nrays / cold_time.count () / 1e3 << " Mrays/s cold, "
+         << nrays / coherent_time.count () / 1e3 << " Mrays/s coherent, "
+         << nrays / sweep_time.count () / 1e3 << " M sweeps/s" << endl;
+}
+
+//
+// Generates the missing detail levels of the model and reports the triangles
+// of each level, detail0 included, and the time taken to generate them:
+//
+static void
+report_lods (const char* filename, const lod_options_t& options,
+             thread_pool_t& pool) {
+    auto p = make_unique< pof_t > ();
+    load (filename, *p, pool);
+
+    auto start = chrono::steady_clock::now ();
+    const size_t added = build_lods (*p, options, &pool);
+
+    chrono::duration< double, milli > elapsed =
+        chrono::steady_clock::now () - start;
+
+    vector< size_t > triangles (p->detail_subobj.size ());
+
+    for (const auto poly : p->polys) {
+        const int detail = p->subobjs [poly.subobj_index].detail;
+
+        if (0 <= detail && size_t (detail) < triangles.size ())
+            triangles [detail] += max (poly.vertices.size (), size_t (2)) - 2;
+    }
+
+    cout << filename << " : " << added << " detail levels added in "
+         << elapsed.count () << " ms on " << pool.size () << " threads :";
+
+    for (size_t i = 0; i < triangles.size (); ++i)
+        cout << " " << triangles [i];
+
+    cout << " triangles" << endl;
+}
+
+//
+// Quantizes the geometry of the model and reports its size against that of
+// the model, the errors of the decoded geometry and the time taken to decode
+// all of it:
+//
+static void
+report_quantized (const char* filename, size_t normal_bits) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto p = make_unique< pof_t > ();
+    load (filename, *p);
+
+    quantized_geometry_t q;
+
+    auto start = clock_type::now ();
+    quantize (*p, q, normal_bits);
+    ms_type elapsed = clock_type::now () - start;
+
+    //
+    // Decode everything, once, into a checksum which is printed so that the
+    // decoding is not optimized away:
+    //
+    start = clock_type::now ();
+
+    vector3f_t sum{ };
+    float uv = 0;
+
+    for (size_t i = 0; i < q.vertices.size (); ++i)
+        sum += q.vertex (i);
+
+    for (size_t i = 0; i < q.corners (); ++i) {
+        sum += q.normal (i);
+        uv += q.u (i) + q.v (i);
+    }
+
+    ms_type decode = clock_type::now () - start;
+
+    const float checksum = sum.value [0] + sum.value [1] + sum.value [2] + uv;
+
+    cout << filename << " : " << p->vertices.size () << " vertices, "
+         << p->normals.size () << " normals (" << q.distinct_normals ()
+         << " distinct), " << quantized_geometry_t::bytes (*p) / 1e6
+         << " MB -> " << q.bytes () / 1e6 << " MB, quantized in "
+         << elapsed.count () << " ms, decoded in " << decode.count ()
+         << " ms, checksum " << checksum << endl;
+
+    cout << filename << " : largest error, position " << q.error.position
+         << ", normal " << q.error.normal << " deg, uv " << q.error.uv
+         << endl;
+}
+
+//
+// Flattens the subobject hierarchy and poses it, the rotating subobjects
+// turned by an angle, in degrees, and reports the time taken by a pose and
+// how far the pose moved the vertices:
+//
+static void
+report_hierarchy (const char* filename, float degrees) {
+    using clock_type = chrono::steady_clock;
+    using ms_type = chrono::duration< double, milli >;
+
+    auto p = make_unique< pof_t > ();
+    load (filename, *p);
+
+    hierarchy_t h;
+    flatten (*p, h);
+
+    const size_t rotating = size_t (count_if (
+        h.axes.begin (), h.axes.end (), [](int axis) { return 0 <= axis; }));
+
+    vector< float > angles (h.size (), float (degrees * M_PI / 180));
+    vector< transform_t > ts (h.size ());
+
+    const transform_t identity{
+        { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }, { } };
+
+    //
+    // As many poses as fit in a tenth of a second, at least a thousand:
+    //
+    size_t n = 0;
+
+    const auto start = clock_type::now ();
+    ms_type elapsed;
+
+    do {
+        for (size_t i = 0; i < 1000; ++i, ++n)
+            pose (h, { angles.data (), angles.data () + angles.size () },
+                  identity, ts.data ());
+
+        elapsed = clock_type::now () - start;
+    } while (elapsed.count () < 100);
+
+    vector< vector3f_t > posed (p->vertices.size ());
+    pose_vertices (*p, h, ts.data (), posed.data ());
+
+    float moved = 0;
+
+    for (size_t i = 0; i < posed.size (); ++i) {
+        const vector3f_t d = posed [i] - p->vertices [i];
+        moved = max (moved, sqrt (dot (d, d)));
+    }
+
+    cout << filename << " : " << h.size () << " subobjects, " << h.depth ()
+         << " levels deep, " << rotating << " rotating, posed in "
+         << elapsed.count () * 1e6 / n << " ns, vertices moved up to "
+         << moved << endl;
+}
+
+//
+// Renders a thumbnail of the model and reports the time taken to render it:
+//
+static void
+run_thumbnail (const char* filename, const char* out,
+               const render_options_t& options, const lod_options_t* lods,
+               thread_pool_t& pool) {
+    auto p = make_unique< pof_t > ();
+    load (filename, *p, pool);
+
+    if (lods)
+        build_lods (*p, *lods, &pool);
+
+    image_t image;
+
+    auto start = chrono::steady_clock::now ();
+    render (*p, options, image, &pool);
+
+    chrono::duration< double, milli > elapsed =
+        chrono::steady_clock::now () - start;
+
+    write_ppm (out, image);
+
+    cout << filename << " : " << out << ", " << options.width << "x"
+         << options.height << ", rendered in " << elapsed.count () << " ms"
+         << endl;
+}
+
+static void
+usage () {
+    cerr << "Usage: pof [-s] [-t] [-m] [-a] [-r] [-c rays] [-k rays] "
+         << "[-l ids] [-b cache] [-o levels[xratio]] [-q bits] [-y angle] "
+         << "[-p out [-z WxH] [-d detail] [-g]] "
+         << "[-j threads] [-e trace] "
+         << "<file | directory | ->\n"
+         << "  -s  decode through the istream reader instead of mmap\n"
+         << "  -t  report the throughput of the readers, in MB/s\n"
+         << "  -m  report the load time and the memory held by the model\n"
+         << "  -a  count the allocations of a model, on the heap and in an "
+         << "arena\n"
+         << "  -r  bake, optimize and split the render-ready mesh and "
+         << "report its size\n"
+         << "  -c  cast random rays at the subobjects of the detail level "
+         << "and report\n      the rays cast per second\n"
+         << "  -k  cast random rays and sweep spheres at the shield and "
+         << "report the\n      queries per second\n"
+         << "  -l  decode only the chunks in the comma-separated list, e.g., "
+         << "HDR2,SPCL,DOCK,\n      and compare against a full load\n"
+         << "  -b  bake the model into a cache file, if stale, and compare "
+         << "the cold start\n      of the model and of the cache\n"
+         << "  -o  generate the missing detail levels, each with a ratio "
+         << "of the triangles\n      of the one above (default: 0.5), "
+         << "and report their size,\n      or render them with -p and -d\n"
+         << "  -q  quantize the geometry, with normals of 16 or 32 bits, "
+         << "and report its\n      size and errors\n"
+         << "  -y  pose the subobject hierarchy, the rotating subobjects "
+         << "turned by an angle,\n      in degrees, and report the time "
+         << "taken by a pose\n"
+         << "  -p  render a thumbnail to a PPM file, or, for a directory, "
+         << "one for each\n      model to a directory\n"
+         << "  -z  thumbnail size (default: 256x256)\n"
+         << "  -d  detail level rendered or cast at (default: 0)\n"
+         << "  -g  Gouraud shading\n"
+         << "  -j  number of loader threads (default: number of cores)\n"
+         << "  -e  write a Chrome trace of the run to a file, in builds "
+         << "with TRACE=1\n"
+         << "  -   decode standard input as it is read, e.g., from a pipe\n";
+}
+
+int main (int argc, char** argv) {
+    bool stream = false, timing = false, memory = false, arena = false,
+        mesh = false;
+    size_t nthreads = thread::hardware_concurrency ();
+
+    vector< int > lazy_ids;
+    const char* cache = 0;
+
+    render_options_t render_options;
+    const char* thumbnail = 0;
+
+    lod_options_t lod_options;
+    bool lods = false;
+
+    size_t normal_bits = 0;
+    const char* angle = 0;
+
+    size_t rays = 0, shield_rays = 0;
+    const char* trace = 0;
+
+    const char* options = "stmarc:k:l:b:o:q:y:p:z:d:gj:e:";
+
+    for (int c; -1 != (c = getopt (argc, argv, options));) {
+        switch (c) {
+        case 's': stream = true; break;
+        case 't': timing = true; break;
+        case 'm': memory = true; break;
+        case 'a': arena = true; break;
+        case 'r': mesh = true; break;
+        case 'c': rays = size_t (atol (optarg)); break;
+        case 'k': shield_rays = size_t (atol (optarg)); break;
+        case 'l': lazy_ids = parse_chunk_ids (optarg); break;
+        case 'b': cache = optarg; break;
+        case 'o':
+            if (1 > sscanf (optarg, "%zux%f", &lod_options.levels,
+                            &lod_options.ratio))
+                return usage (), 1;
+            lods = true;
+            break;
+        case 'q': normal_bits = size_t (atoi (optarg)); break;
+        case 'y': angle = optarg; break;
+        case 'p': thumbnail = optarg; break;
+        case 'z':
+            if (2 != sscanf (optarg, "%zux%zu", &render_options.width,
+                             &render_options.height))
+                return usage (), 1;
+            break;
+        case 'd': render_options.detail = atoi (optarg); break;
+        case 'g': render_options.gouraud = true; break;
+        case 'j': nthreads = size_t (atoi (optarg)); break;
+        case 'e': trace = optarg; break;
+        default:
+            return usage (), 1;
+        }
+    }
+
+    if (optind + 1 != argc)
+        return usage (), 1;
+
+    const char* filename = argv [optind];
+
+    //
+    // One mode at a time, but for -o, whose levels -p can render:
+    //
+    const int modes = timing + memory + arena + mesh + !!rays + !!shield_rays +
+        !lazy_ids.empty () + !!normal_bits + !!angle + !!cache +
+        (lods && !thumbnail) + !!thumbnail;
+
+    if (1 < modes)
+        return usage (), 1;
+
+    if (trace && !trace_start (trace))
+        WW << "no trace to " << trace << ", tracing compiled out or "
+           << "file not writable";
+
+    //
+    // The trace is written as main returns:
+    //
+    struct trace_guard_t {
+        ~trace_guard_t () {
+            if (!trace_stop ())
+                EE << "cannot write the trace";
+        }
+    } trace_guard;
+
+    //
+    // Standard input, which may be a pipe, is decoded as it is read:
+    //
+    if (0 == strcmp (filename, "-")) {
+        try {
+            auto p = make_unique< pof_t > ();
+            read_streaming (cin, *p);
+        }
+        catch (const exception& e) {
+            EE << "stdin : " << e.what ();
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (fs::is_directory (filename)) {
+        if (modes > !!thumbnail || lods)
+            return usage (), 1;
+
+        try {
+            return thumbnail
+                ? run_thumbnails (filename, thumbnail, render_options, nthreads)
+                : run_batch (filename, nthreads);
+        }
+        catch (const exception& e) {
+            EE << filename << " : " << e.what ();
+            return 1;
+        }
+    }
+    else if (fs::exists (filename) && fs::is_regular_file (filename)) {
+        try {
+            thread_pool_t pool (nthreads);
+
+            auto load_serial = [](const char* filename, pof_t& pof) {
+                load (filename, pof);
+            };
+
+            auto load_parallel = [&](const char* filename, pof_t& pof) {
+                load (filename, pof, pool);
+            };
+
+            if (timing) {
+                cout << filename << " : mmap "
+                     << throughput (filename, load_serial) << " MB/s, "
+                     << "mmap on " << pool.size () << " threads "
+                     << throughput (filename, load_parallel) << " MB/s, "
+                     << "istream "
+                     << throughput (filename, load_stream) << " MB/s, "
+                     << "streaming "
+                     << throughput (filename, load_streaming) << " MB/s"
+                     << endl;
+            }
+            else if (memory) {
+                report_memory (filename);
+            }
+            else if (arena) {
+                report_allocations (filename);
+            }
+            else if (mesh) {
+                report_mesh (filename);
+            }
+            else if (rays) {
+                report_rays (filename, rays, render_options.detail, pool);
+            }
+            else if (shield_rays) {
+                report_shield (filename, shield_rays, pool);
+            }
+            else if (!lazy_ids.empty ()) {
+                report_lazy (filename, lazy_ids);
+            }
+            else if (normal_bits) {
+                report_quantized (filename, normal_bits);
+            }
+            else if (angle) {
+                report_hierarchy (filename, float (atof (angle)));
+            }
+            else if (lods && !thumbnail) {
+                report_lods (filename, lod_options, pool);
+            }
+            else if (cache) {
+                report_cold_start (filename, cache);
+            }
+            else if (thumbnail) {
+                run_thumbnail (filename, thumbnail, render_options,
+                               lods ? &lod_options : 0, pool);
+            }
+            else {
+                auto p = make_unique< pof_t > ();
+                stream
+                    ? load_stream (filename, *p)
+                    : load_parallel (filename, *p);
+            }
+        }
+        catch (const exception& e) {
+            EE << filename << " : " << e.what ();
+            return 1;
+        }
+
+        return 0;
+    }
+    else {
+        EE << "missing file : " << filename;
+        return 1;
+    }
+}
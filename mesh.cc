@@ -0,0 +1,646 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "mesh.hh"
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+static inline bool
+operator== (const mesh_vertex_t& lhs, const mesh_vertex_t& rhs) {
+    return 0 == memcmp (&lhs, &rhs, sizeof lhs);
+}
+
+//
+// The four words of the vertex are multiplied independently and then mixed,
+// which keeps the multiplications off a single dependency chain:
+//
+static_assert (32 == sizeof (mesh_vertex_t), "packed mesh vertex");
+
+static inline size_t
+hash_of (const mesh_vertex_t& x) {
+    uint64_t w [sizeof x / sizeof (uint64_t)];
+    memcpy (w, &x, sizeof w);
+
+    uint64_t h = (w [0] * 0x9e3779b97f4a7c15ULL) ^
+        (w [1] * 0xc2b2ae3d27d4eb4fULL) ^
+        (w [2] * 0x165667b19e3779f9ULL) ^
+        (w [3] * 0xff51afd7ed558ccdULL);
+
+    return size_t (h ^ (h >> 29) ^ (h >> 47));
+}
+
+namespace {
+
+//
+// Open-addressing table of the vertices of a batch, by value, that maps each
+// distinct vertex to its index in the batch:
+//
+struct vertex_table_t {
+    static constexpr uint32_t none = ~uint32_t (0);
+
+    vector< uint32_t > slots;
+    size_t mask;
+
+    void reset (size_t n) {
+        size_t size = 16;
+
+        for (; size < 2 * n; size <<= 1) ;
+
+        slots.assign (size, none);
+        mask = size - 1;
+    }
+
+    //
+    // Returns the index of the vertex, appending it to the batch's vertices
+    // in xs, which start at first, if it is not there:
+    //
+    uint32_t insert (const mesh_vertex_t& x, vector< mesh_vertex_t >& xs,
+                     size_t first) {
+        for (size_t i = hash_of (x) & mask;; i = (i + 1) & mask) {
+            if (none == slots [i]) {
+                slots [i] = uint32_t (xs.size () - first);
+                xs.push_back (x);
+
+                return slots [i];
+            }
+
+            if (xs [first + slots [i]] == x)
+                return slots [i];
+        }
+    }
+};
+
+} // anonymous namespace
+
+template< typename T >
+static void
+put_indices (const vector< uint32_t >& src, vector< char >& dst) {
+    const size_t off = dst.size ();
+    dst.resize (off + src.size () * sizeof (T));
+
+    T* p = reinterpret_cast< T* > (dst.data () + off);
+
+    for (size_t i = 0; i < src.size (); ++i)
+        p [i] = T (src [i]);
+}
+
+void
+bake_mesh (const pof_t& pof, mesh_t& mesh) {
+    const auto& polys = pof.polys;
+
+    mesh.vertices.clear ();
+    mesh.indices.clear ();
+    mesh.batches.clear ();
+
+    mesh.vertices.reserve (polys.corners ());
+    mesh.indices.reserve (3 * polys.corners () * sizeof (uint16_t));
+
+    //
+    // Polygons with three or more corners, grouped by batch, each batch in
+    // the order of the model. The key of a batch packs the subobject, the type
+    // and the color; a model has few, so the polygons are bucketed by key
+    // rather than sorted:
+    //
+    auto key_of = [&](size_t i) {
+        return uint64_t (polys.subobj_index [i]) << 33 |
+            uint64_t (TEXTPOLY_DEF == polys.type [i]) << 32 |
+            uint32_t (polys.color [i]);
+    };
+
+    vector< uint32_t > bucket (polys.size ());
+    vector< pair< uint64_t, size_t > > keys;
+
+    {
+        unordered_map< uint64_t, uint32_t > ids;
+
+        for (size_t i = 0; i < polys.size (); ++i) {
+            ensure (0 <= polys.subobj_index [i],
+                    "mesh: polygon subobject out of range");
+
+            auto iter = ids.try_emplace (key_of (i), uint32_t (ids.size ()));
+            bucket [i] = iter.first->second;
+        }
+
+        keys.resize (ids.size ());
+
+        for (const auto& [key, id] : ids)
+            keys [id] = { key, id };
+
+        sort (keys.begin (), keys.end ());
+    }
+
+    //
+    // Rank of each bucket in key order, then the start of each in order:
+    //
+    vector< size_t > start (keys.size () + 1);
+
+    {
+        vector< uint32_t > rank (keys.size ());
+
+        for (size_t i = 0; i < keys.size (); ++i)
+            rank [keys [i].second] = uint32_t (i);
+
+        for (auto& x : bucket)
+            x = rank [x];
+    }
+
+    for (size_t i = 0; i < polys.size (); ++i)
+        if (2 < polys.offsets [i + 1] - polys.offsets [i])
+            ++start [bucket [i] + 1];
+
+    for (size_t i = 0; i < keys.size (); ++i)
+        start [i + 1] += start [i];
+
+    vector< uint32_t > order (start.back ());
+
+    {
+        vector< size_t > at (start.begin (), start.end () - 1);
+
+        for (size_t i = 0; i < polys.size (); ++i)
+            if (2 < polys.offsets [i + 1] - polys.offsets [i])
+                order [at [bucket [i]]++] = uint32_t (i);
+    }
+
+    vertex_table_t table;
+    vector< uint32_t > indices;
+
+    for (size_t b = 0; b < keys.size (); ++b) {
+        const size_t first = start [b], last = start [b + 1];
+
+        if (first == last)
+            continue;
+
+        size_t corners = 0;
+
+        for (size_t k = first; k < last; ++k) {
+            const size_t i = order [k];
+            corners += size_t (polys.offsets [i + 1] - polys.offsets [i]);
+        }
+
+        const size_t i = order [first];
+
+        mesh_t::batch_t batch{
+            polys.subobj_index [i], polys.type [i], polys.color [i],
+            mesh.vertices.size (), 0, 0, 0, 0
+        };
+
+        table.reset (corners);
+        indices.clear ();
+
+        for (size_t k = first; k < last; ++k) {
+            const auto poly = polys [order [k]];
+            const size_t n = poly.vertices.size ();
+
+            uint32_t fan [3];
+
+            for (size_t j = 0; j < n; ++j) {
+                const int a = poly.vertices [j], b = poly.normals [j];
+
+                ensure (0 <= a && size_t (a) < pof.vertices.size (),
+                        "mesh: polygon vertex out of range");
+                ensure (0 <= b && size_t (b) < pof.normals.size (),
+                        "mesh: polygon normal out of range");
+
+                mesh_vertex_t x{ pof.vertices [a], pof.normals [b], 0, 0 };
+
+                if (!poly.u.empty ())
+                    x.u = poly.u [j], x.v = poly.v [j];
+
+                const uint32_t index = table.insert (
+                    x, mesh.vertices, batch.first_vertex);
+
+                //
+                // Fan around the first corner:
+                //
+                if (0 == j)
+                    fan [0] = index;
+                else if (1 == j)
+                    fan [2] = index;
+                else {
+                    fan [1] = fan [2];
+                    fan [2] = index;
+
+                    indices.insert (indices.end (), fan, fan + 3);
+                }
+            }
+        }
+
+        batch.vertices = mesh.vertices.size () - batch.first_vertex;
+        batch.indices = indices.size ();
+        batch.index_size = batch.vertices <= 65536 ? 2 : 4;
+
+        mesh.indices.resize ((mesh.indices.size () + 3) & ~size_t (3));
+        batch.offset = mesh.indices.size ();
+
+        if (2 == batch.index_size)
+            put_indices< uint16_t > (indices, mesh.indices);
+        else
+            put_indices< uint32_t > (indices, mesh.indices);
+
+        mesh.batches.push_back (batch);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+get_indices (const mesh_t& mesh, const mesh_t::batch_t& batch,
+             vector< uint32_t >& dst) {
+    dst.resize (batch.indices);
+
+    const char* p = mesh.indices.data () + batch.offset;
+
+    if (2 == batch.index_size) {
+        const uint16_t* q = reinterpret_cast< const uint16_t* > (p);
+        copy (q, q + batch.indices, dst.begin ());
+    }
+    else {
+        const uint32_t* q = reinterpret_cast< const uint32_t* > (p);
+        copy (q, q + batch.indices, dst.begin ());
+    }
+}
+
+static void
+set_indices (mesh_t& mesh, const mesh_t::batch_t& batch,
+             const vector< uint32_t >& src) {
+    char* p = mesh.indices.data () + batch.offset;
+
+    if (2 == batch.index_size) {
+        uint16_t* q = reinterpret_cast< uint16_t* > (p);
+        transform (src.begin (), src.end (), q, [](auto x) {
+            return uint16_t (x);
+        });
+    }
+    else {
+        uint32_t* q = reinterpret_cast< uint32_t* > (p);
+        copy (src.begin (), src.end (), q);
+    }
+}
+
+double
+acmr (const mesh_t& mesh, size_t cache_size) {
+    size_t misses = 0;
+
+    vector< uint32_t > indices;
+    vector< size_t > stamps;
+
+    for (const auto& batch : mesh.batches) {
+        get_indices (mesh, batch, indices);
+
+        //
+        // A vertex is in the FIFO cache if it entered it less than cache_size
+        // misses ago:
+        //
+        stamps.assign (batch.vertices, 0);
+
+        size_t clock = cache_size + 1;
+
+        for (auto i : indices) {
+            if (clock - stamps [i] > cache_size)
+                stamps [i] = clock++, ++misses;
+        }
+    }
+
+    const size_t triangles = mesh.triangles ();
+    return triangles ? double (misses) / triangles : 0;
+}
+
+namespace {
+
+//
+// Forsyth's vertex scoring, for a cache of 32 vertices: the three vertices
+// of the last triangle score a fixed amount, the others less the older they
+// are, and vertices with few triangles left get a boost, to finish them off:
+//
+struct forsyth_t {
+    static constexpr size_t cache_size = 32;
+    static constexpr size_t max_valence = 32;
+
+    float cache_score [cache_size];
+    float valence_score [max_valence];
+
+    forsyth_t () {
+        for (size_t i = 0; i < cache_size; ++i)
+            cache_score [i] = i < 3 ? 0.75f : powf (
+                1.f - float (i - 3) / (cache_size - 3), 1.5f);
+
+        valence_score [0] = 0;
+
+        for (size_t i = 1; i < max_valence; ++i)
+            valence_score [i] = 2.f / sqrtf (float (i));
+    }
+
+    float score (int cache_pos, size_t valence) const {
+        if (0 == valence)
+            return -1.f;
+
+        return (0 <= cache_pos ? cache_score [cache_pos] : 0.f) +
+            (valence < max_valence
+             ? valence_score [valence] : 2.f / sqrtf (float (valence)));
+    }
+};
+
+} // anonymous namespace
+
+//
+// Reorders the triangles of indices, which refer to n vertices:
+//
+static void
+optimize_triangles (vector< uint32_t >& indices, size_t n) {
+    static const forsyth_t forsyth;
+
+    const size_t ntris = indices.size () / 3;
+    constexpr size_t cache_size = forsyth_t::cache_size;
+
+    //
+    // The triangles of each vertex, in CSR form; valence is the number of
+    // triangles of a vertex not yet emitted, which are the first in its list:
+    //
+    vector< uint32_t > offsets (n + 1), valence (n), tris (indices.size ());
+
+    for (auto i : indices)
+        ++offsets [i + 1];
+
+    for (size_t i = 0; i < n; ++i)
+        offsets [i + 1] += offsets [i];
+
+    for (size_t t = 0; t < ntris; ++t)
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t i = indices [3 * t + k];
+            tris [offsets [i] + valence [i]++] = uint32_t (t);
+        }
+
+    vector< int > cache_pos (n, -1);
+    vector< float > vertex_score (n), tri_score (ntris);
+    vector< char > emitted (ntris);
+
+    for (size_t i = 0; i < n; ++i)
+        vertex_score [i] = forsyth.score (-1, valence [i]);
+
+    for (size_t t = 0; t < ntris; ++t)
+        tri_score [t] = vertex_score [indices [3 * t]] +
+            vertex_score [indices [3 * t + 1]] +
+            vertex_score [indices [3 * t + 2]];
+
+    vector< uint32_t > result;
+    result.reserve (indices.size ());
+
+    uint32_t cache [cache_size + 3], next [cache_size + 3];
+    size_t cache_n = 0;
+
+    size_t best = ntris ? size_t (max_element (
+        tri_score.begin (), tri_score.end ()) - tri_score.begin ()) : 0;
+
+    //
+    // Fallback when no cached vertex has triangles left: the next triangle,
+    // in input order, that is not emitted:
+    //
+    size_t cursor = 0;
+
+    for (size_t emitted_n = 0; emitted_n < ntris; ++emitted_n) {
+        if (best >= ntris) {
+            for (; emitted [cursor]; ++cursor) ;
+            best = cursor;
+        }
+
+        const size_t t = best;
+        emitted [t] = 1;
+
+        const uint32_t* tri = &indices [3 * t];
+        result.insert (result.end (), tri, tri + 3);
+
+        //
+        // Remove the triangle from its vertices' lists:
+        //
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t i = tri [k];
+            uint32_t* p = &tris [offsets [i]];
+
+            swap (*find (p, p + valence [i], uint32_t (t)),
+                  p [--valence [i]]);
+        }
+
+        //
+        // New cache: the triangle's vertices in front of the others:
+        //
+        size_t next_n = 0;
+
+        for (size_t k = 0; k < 3; ++k)
+            next [next_n++] = tri [k];
+
+        for (size_t j = 0; j < cache_n; ++j) {
+            const uint32_t i = cache [j];
+
+            if (i != tri [0] && i != tri [1] && i != tri [2])
+                next [next_n++] = i;
+        }
+
+        for (size_t j = 0; j < next_n; ++j) {
+            const uint32_t i = next [j];
+
+            cache_pos [i] = j < cache_size ? int (j) : -1;
+            vertex_score [i] = forsyth.score (cache_pos [i], valence [i]);
+        }
+
+        cache_n = min (next_n, cache_size);
+        copy (next, next + cache_n, cache);
+
+        //
+        // Rescore the triangles of the cached vertices, and of those that fell
+        // out of the cache, and pick the best among them:
+        //
+        best = ntris;
+        float best_score = -1.f;
+
+        for (size_t j = 0; j < next_n; ++j) {
+            const uint32_t i = next [j];
+
+            for (size_t k = offsets [i]; k < offsets [i] + valence [i]; ++k) {
+                const uint32_t u = tris [k];
+                const uint32_t* v = &indices [3 * u];
+
+                tri_score [u] = vertex_score [v [0]] + vertex_score [v [1]] +
+                    vertex_score [v [2]];
+
+                if (best_score < tri_score [u])
+                    best = u, best_score = tri_score [u];
+            }
+        }
+    }
+
+    indices.swap (result);
+}
+
+void
+optimize_mesh (mesh_t& mesh) {
+    vector< uint32_t > indices, remap;
+    vector< mesh_vertex_t > vertices;
+
+    for (const auto& batch : mesh.batches) {
+        get_indices (mesh, batch, indices);
+
+        optimize_triangles (indices, batch.vertices);
+
+        //
+        // Number the vertices in the order of first use:
+        //
+        remap.assign (batch.vertices, ~uint32_t (0));
+
+        uint32_t n = 0;
+
+        for (auto& i : indices) {
+            if (~uint32_t (0) == remap [i])
+                remap [i] = n++;
+
+            i = remap [i];
+        }
+
+        for (auto& i : remap)
+            if (~uint32_t (0) == i)
+                i = n++;
+
+        auto first = mesh.vertices.begin () + batch.first_vertex;
+
+        vertices.assign (first, first + batch.vertices);
+
+        for (size_t i = 0; i < batch.vertices; ++i)
+            first [remap [i]] = vertices [i];
+
+        set_indices (mesh, batch, indices);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Bounding sphere and normal cone of a meshlet, whose vertices and triangles
+// are the last in the lists:
+//
+static void
+bound_meshlet (const mesh_t& mesh, meshlets_t& meshlets) {
+    auto& m = meshlets.meshlets.back ();
+
+    const auto& batch = mesh.batches [m.batch];
+    const uint32_t* vs = &meshlets.vertices [m.first_vertex];
+
+    auto pos = [&](size_t i) -> const vector3f_t& {
+        return mesh.vertices [batch.first_vertex + vs [i]].pos;
+    };
+
+    vector3f_t center{ };
+
+    for (size_t i = 0; i < m.vertices; ++i)
+        center += pos (i);
+
+    m.center = center * (1.f / m.vertices);
+    m.radius = 0;
+
+    for (size_t i = 0; i < m.vertices; ++i) {
+        const auto d = pos (i) - m.center;
+        m.radius = max (m.radius, sqrtf (dot (d, d)));
+    }
+
+    vector< vector3f_t > normals;
+    normals.reserve (m.triangles);
+
+    vector3f_t axis{ };
+
+    for (size_t t = 0; t < m.triangles; ++t) {
+        const uint8_t* tri = &meshlets.triangles [3 * (m.first_triangle + t)];
+
+        const auto n = normalize (cross (
+            pos (tri [1]) - pos (tri [0]), pos (tri [2]) - pos (tri [0])));
+
+        normals.push_back (n);
+        axis += n;
+    }
+
+    m.axis = normalize (axis);
+    m.cutoff = 1.f;
+
+    for (const auto& n : normals)
+        m.cutoff = min (m.cutoff, dot (m.axis, n));
+}
+
+void
+build_meshlets (const mesh_t& mesh, meshlets_t& meshlets,
+                size_t max_vertices, size_t max_triangles) {
+    ensure (3 <= max_vertices && max_vertices <= 256 && 0 < max_triangles,
+            "meshlets: limits out of range");
+
+    meshlets.meshlets.clear ();
+    meshlets.vertices.clear ();
+    meshlets.triangles.clear ();
+
+    vector< uint32_t > indices;
+
+    //
+    // Position of a batch vertex in the current meshlet, if it is there:
+    //
+    vector< int > local;
+
+    for (size_t b = 0; b < mesh.batches.size (); ++b) {
+        const auto& batch = mesh.batches [b];
+
+        get_indices (mesh, batch, indices);
+        local.assign (batch.vertices, -1);
+
+        auto flush = [&]() {
+            auto& m = meshlets.meshlets.back ();
+
+            for (size_t i = 0; i < m.vertices; ++i)
+                local [meshlets.vertices [m.first_vertex + i]] = -1;
+
+            bound_meshlet (mesh, meshlets);
+        };
+
+        for (size_t t = 0; t < indices.size (); t += 3) {
+            const uint32_t* tri = &indices [t];
+
+            auto& ms = meshlets.meshlets;
+
+            if (ms.empty () || ms.back ().batch != b ||
+                ms.back ().triangles == max_triangles ||
+                ms.back ().vertices + (0 > local [tri [0]]) +
+                (0 > local [tri [1]]) + (0 > local [tri [2]]) >
+                max_vertices) {
+                if (!ms.empty () && ms.back ().batch == b)
+                    flush ();
+
+                ms.push_back ({
+                    b, meshlets.vertices.size (), 0,
+                    meshlets.triangles.size () / 3, 0, { }, 0, { }, 0
+                });
+            }
+
+            auto& m = ms.back ();
+
+            for (size_t k = 0; k < 3; ++k) {
+                if (0 > local [tri [k]]) {
+                    local [tri [k]] = int (m.vertices++);
+                    meshlets.vertices.push_back (tri [k]);
+                }
+
+                meshlets.triangles.push_back (uint8_t (local [tri [k]]));
+            }
+
+            ++m.triangles;
+        }
+
+        if (!meshlets.meshlets.empty () && meshlets.meshlets.back ().batch == b)
+            flush ();
+    }
+}
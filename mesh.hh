@@ -0,0 +1,107 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_MESH_HH
+#define POF_MESH_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "pof.hh"
+#include "vector.hh"
+
+struct mesh_vertex_t {
+    vector3f_t pos, normal;
+    float u, v;
+};
+
+//
+// Render-ready mesh of a model: the polygons, fan-triangulated, in one
+// interleaved vertex buffer and one index buffer, each uploaded at once. The
+// triangles are grouped in batches, one for each subobject and texture, or
+// color for flat-shaded polygons, in the order of the subobjects. Vertices
+// with the same position, normal and texture coordinates are shared within a
+// batch.
+//
+// A batch's vertices are [first_vertex, first_vertex + vertices) in the
+// vertex buffer. Its indices, relative to first_vertex, start at byte offset
+// in the index buffer, aligned to 4 bytes, and are 16-bit if the batch has no
+// more than 65536 vertices, 32-bit otherwise:
+//
+struct mesh_t {
+    struct batch_t {
+        int subobj, type, color;
+
+        size_t first_vertex, vertices;
+        size_t offset, indices, index_size;
+    };
+
+    vector< mesh_vertex_t > vertices;
+    vector< char > indices;
+
+    vector< batch_t > batches;
+
+    size_t triangles () const {
+        size_t n = 0;
+
+        for (const auto& batch : batches)
+            n += batch.indices / 3;
+
+        return n;
+    }
+};
+
+//
+// Builds the mesh of a decoded model; throws out_of_range if a polygon refers
+// to a vertex or a normal the model does not have:
+//
+void bake_mesh (const pof_t&, mesh_t&);
+
+//
+// Average cache miss ratio: the number of vertices a FIFO post-transform
+// cache of the given size misses, per triangle, over all batches:
+//
+double acmr (const mesh_t&, size_t = 32);
+
+//
+// Reorders the triangles of each batch for post-transform cache locality
+// (Forsyth's linear-speed algorithm), then the batch's vertices in the order
+// the triangles first use them, for fetch locality:
+//
+void optimize_mesh (mesh_t&);
+
+//
+// Meshlets of a mesh: runs of consecutive triangles of a batch that use at
+// most a fixed number of vertices, for cluster culling. A meshlet's vertices,
+// in the shared vertex list, are indices in its batch's vertices and its
+// triangles are three 8-bit indices into its vertices each.
+//
+// The bounding sphere encloses the meshlet's vertices. The normal cone
+// contains the normals of its triangles: axis is their normalized average
+// and cutoff the cosine of the widest angle between the axis and a normal,
+// so that a cutoff that is not positive leaves a cone that cannot be culled:
+//
+struct meshlets_t {
+    struct meshlet_t {
+        size_t batch;
+
+        size_t first_vertex, vertices;
+        size_t first_triangle, triangles;
+
+        vector3f_t center;
+        float radius;
+
+        vector3f_t axis;
+        float cutoff;
+    };
+
+    vector< meshlet_t > meshlets;
+
+    vector< uint32_t > vertices;
+    vector< uint8_t > triangles;
+};
+
+void build_meshlets (const mesh_t&, meshlets_t&,
+                     size_t max_vertices = 64, size_t max_triangles = 124);
+
+#endif // POF_MESH_HH
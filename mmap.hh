@@ -0,0 +1,68 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_MMAP_HH
+#define POF_MMAP_HH
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.hh"
+
+//
+// Read-only, private mapping of a whole file; unmapped on destruction. The
+// advice tells the kernel how the mapping will be accessed, e.g., MADV_RANDOM
+// when only a few chunks of the file are read:
+//
+struct mapped_file_t {
+    const char* data = 0;
+    size_t size = 0;
+
+    explicit mapped_file_t (const char* filename, int advice = MADV_WILLNEED) {
+        TRACE_ZONE ("open", filename);
+
+        int fd = ::open (filename, O_RDONLY | O_CLOEXEC);
+
+        if (0 > fd)
+            throw system_error (errno, system_category (), filename);
+
+        struct stat st;
+
+        if (0 > ::fstat (fd, &st)) {
+            int err = errno;
+            ::close (fd);
+            throw system_error (err, system_category (), filename);
+        }
+
+        size = size_t (st.st_size);
+
+        if (size) {
+            void* p = ::mmap (0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (MAP_FAILED == p) {
+                int err = errno;
+                ::close (fd);
+                throw system_error (err, system_category (), filename);
+            }
+
+            ::madvise (p, size, advice);
+            data = static_cast< const char* > (p);
+        }
+
+        ::close (fd);
+    }
+
+    mapped_file_t (const mapped_file_t&) = delete;
+    mapped_file_t& operator= (const mapped_file_t&) = delete;
+
+    ~mapped_file_t () {
+        if (data)
+            ::munmap (const_cast< char* > (data), size);
+    }
+};
+
+#endif // POF_MMAP_HH
@@ -0,0 +1,161 @@
+// -*- mode: c++; -*-
+
+#define BOOST_LOG_DYN_LINK 1
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <boost/endian/conversion.hpp>
+using namespace boost::endian;
+
+#include "assert.hh"
+#include "cursor.hh"
+#include "log.hh"
+#include "parser.hh"
+#include "trace.hh"
+#include "util.hh"
+
+#define PARSER_BLOCK_SIZE 65536 // bytes read at a time by read_streaming
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b) throw out_of_range (what);
+}
+
+pof_parser_t::pof_parser_t (pof_t& pof, callback_type callback)
+    : pof (pof), callback (move (callback)), ctx{ }
+{ }
+
+void
+pof_parser_t::feed (const char* p, size_t n) {
+    ctx.file_size += n;
+
+    while (n) {
+        //
+        // A part that is whole in the block is parsed in place:
+        //
+        if (buffer.empty () && n >= need) {
+            const char* q = p;
+
+            p += need;
+            n -= need;
+
+            parse (q);
+            continue;
+        }
+
+        if (buffer.empty ())
+            buffer.reserve (need);
+
+        const size_t k = min (need - buffer.size (), n);
+        buffer.insert (buffer.end (), p, p + k);
+
+        p += k;
+        n -= k;
+
+        if (buffer.size () == need) {
+            parse (buffer.data ());
+            buffer.clear ();
+        }
+    }
+}
+
+//
+// Parses the part of the input the parser is waiting for, need bytes at p:
+//
+void
+pof_parser_t::parse (const char* p) {
+    cursor_t s (p, need);
+
+    switch (state) {
+    case header: {
+        int file_id = 0;
+        read (s, file_id);
+
+        endian_reverse_inplace (file_id);
+        ensure (file_id == 'PSPO', "not a POF file");
+
+        read (s, ctx.file_version);
+
+        II << " --> file_id : " << string_from (file_id) << ", file version : "
+           << hex << ctx.file_version;
+
+        state = chunk_header;
+        need = 8;
+    }
+        break;
+
+    case chunk_header: {
+        read (s, id);
+        endian_reverse_inplace (id);
+
+        int len = 0;
+        read (s, len);
+
+        II << "  --> id : " << hex << string_from (id) << " ("
+           << dec << len << ")";
+
+        ensure (0 <= len, "negative chunk length");
+
+        state = chunk_body;
+        need = size_t (len);
+
+        //
+        // An empty chunk is complete with its header:
+        //
+        if (0 == need)
+            parse (p);
+    }
+        break;
+
+    case chunk_body:
+        read_chunk (ctx, id, p, need, pof);
+
+        //
+        // The staged BSP data refers to the block or to the buffer, neither
+        // of which outlives this call, and is decoded right away:
+        //
+        if (!ctx.bsps.empty ()) {
+            read_geometry (ctx, pof);
+            ctx.bsps.clear ();
+        }
+
+        if (callback)
+            callback (id, pof);
+
+        state = chunk_header;
+        need = 8;
+
+        break;
+    }
+}
+
+void
+pof_parser_t::finish () {
+    ensure (chunk_header == state && buffer.empty (),
+            "input ends within the header or a chunk");
+
+    postprocess (pof);
+}
+
+istream&
+read_streaming (istream& s, pof_t& pof) {
+    TRACE_ZONE ("read streaming");
+
+    pof_parser_t parser (pof);
+    vector< char > block (PARSER_BLOCK_SIZE);
+
+    //
+    // Reads through the buffer, which does not fail the stream at its end:
+    //
+    auto* buf = s.rdbuf ();
+
+    for (streamsize n; 0 < (n = buf->sgetn (block.data (), block.size ()));)
+        parser.feed (block.data (), size_t (n));
+
+    return parser.finish (), s;
+}
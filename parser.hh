@@ -0,0 +1,68 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_PARSER_HH
+#define POF_PARSER_HH
+
+#include <functional>
+#include <vector>
+
+#include "pof.hh"
+
+//
+// Push decoder, for inputs that cannot seek or that arrive piecewise, e.g.,
+// a pipe, a decompressor or a download. Bytes are fed in blocks of any size,
+// as they come, and each chunk is decoded into the model as soon as its last
+// byte is in, then passed to the callback, if any, with its id. The BSP data
+// of a subobject is decoded along with its chunk. A chunk that arrives whole
+// within a block is decoded in place; the parser only buffers the chunk that
+// straddles blocks, so what it holds is bounded by the largest chunk.
+//
+// finish completes the model once the input is exhausted, and throws if the
+// input ended within the header or a chunk. Errors in the data are reported
+// by exceptions from feed, and leave the parser unusable:
+//
+struct pof_parser_t {
+    using callback_type = function< void (int, const pof_t&) >;
+
+    explicit pof_parser_t (pof_t&, callback_type = { });
+
+    pof_parser_t (const pof_parser_t&) = delete;
+    pof_parser_t& operator= (const pof_parser_t&) = delete;
+
+    void feed (const char*, size_t);
+    void finish ();
+
+    //
+    // Bytes fed so far, and bytes buffered now:
+    //
+    size_t consumed () const { return ctx.file_size; }
+    size_t buffered () const { return buffer.size (); }
+
+private:
+    void parse (const char*);
+
+    enum state_t { header, chunk_header, chunk_body };
+
+    pof_t& pof;
+    callback_type callback;
+
+    pof_context_t ctx;
+
+    state_t state = header;
+    int id = 0;
+
+    //
+    // Size of the part being parsed, and the bytes of it in so far, if it
+    // straddles blocks:
+    //
+    size_t need = 8;
+    vector< char > buffer;
+};
+
+//
+// Decodes a POF model from a stream that need not seek, read in blocks
+// through a push decoder:
+//
+istream& read_streaming (istream&, pof_t&);
+
+#endif // POF_PARSER_HH
@@ -18,32 +18,32 @@ namespace fs = std::filesystem;
 
 #include <GL/gl.h>
 
-#ifdef NDEBUG
-#  define BOOST_DISABLE_ASSERTS
-#  define ASSERT(x) x
-#else
-#  define ASSERT BOOST_ASSERT
-#endif // NDEBUG
-
-#include <boost/assert.hpp>
 #include <boost/endian/arithmetic.hpp>
+#include <boost/endian/conversion.hpp>
 using namespace boost::endian;
 
 #include "algorithm.hh"
+#include "assert.hh"
+#include "cursor.hh"
+#include "endian.hh"
 #include "log.hh"
+#include "mmap.hh"
 #include "pof.hh"
+#include "pool.hh"
+#include "simd.hh"
 #include "stream.hh"
+#include "trace.hh"
 #include "util.hh"
 #include "vector.hh"
 
-static int file_size = 0;
-static int file_version = 0;
-
 ////////////////////////////////////////////////////////////////////////
 
+//
+// BSP fields are little-endian and need not be aligned:
+//
 template< typename T >
-inline const T& ref (const char& c) {
-    return reinterpret_cast< const T& > (c);
+inline T ref (const char& c) {
+    return load_little< T > (&c);
 }
 
 #define ref_i(x)   ref< int > (x)
@@ -54,128 +54,232 @@ inline const T& ref (const char& c) {
 #define ref_v3f(x) ref< vector3f_t > (x)
 #define ref_v3i(x) ref< vector3i_t > (x)
 
-struct bsp_t {
-    vector< vector3f_t > vertices, normals;
-    vector< pof_t::poly_t > polys;
-    vector< pof_t::box_t > boxes;
-};
+using bsp_count_t = pof_context_t::count_t;
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b) throw out_of_range (what);
+}
 
+//
+// Visits the nodes of the BSP data in [p, end) in the order a depth-first
+// traversal would: the front list of a BSP_DEF node, then its back list, then
+// the nodes following it. The traversal is iterative, over an explicit stack
+// of the lists pending a visit:
+//
+template< typename Visitor >
 static void
-read (const char* p, bsp_t& bsp) {
-    while (ref_i (p [0])) {
+walk (const char* p, const char* end, Visitor visit) {
+    vector< const char* > stack;
 
-        int id = ref_i (p [0]);
-        int size = ref_i (p [4]);
+    stack.reserve (64);
+    stack.push_back (p);
 
-        switch (id) {
-        case POINT_DEF: {
-            int n = ref_i (p [8]);  // vertices
+    while (!stack.empty ()) {
+        p = stack.back ();
+        stack.pop_back ();
 
-            const char* s = p;
-            s += ref_i (p [16]);
+        for (;;) {
+            ensure (8 <= end - p, "bsp: truncated node header");
 
-            vector< int > normal_counts (size_t (n), { });
+            int id = ref_i (p [0]);
+            int size = ref_i (p [4]);
 
-            for (int i = 0; i < n; ++i)
-                normal_counts [i] = p [20 + i];
+            if (0 == id)
+                break;
 
-            for (int i = 0; i < n; ++i) {
-                //
-                // Add vertex and set its subobject:
-                //
-                bsp.vertices.push_back (ref_v3f (s [0]));
-                s += 12;
+            ensure (8 <= size && size <= end - p,
+                    "bsp: node size out of bounds");
+
+            if (BSP_DEF == id) {
+                ensure (44 <= size, "bsp: truncated BSP_DEF");
+
+                stack.push_back (p + size);
 
                 //
-                // For each vertex, store a set of normals:
+                // A zero offset marks an empty front or back list:
                 //
-                for (int j = 0; j < normal_counts [i]; ++j) {
-                    bsp.normals.push_back (ref_v3f (s [0]));
-                    s += 12;
+                for (int off : { ref_i (p [40]), ref_i (p [36]) }) {
+                    if (off) {
+                        ensure (0 < off && off < end - p,
+                                "bsp: BSP_DEF offset");
+                        stack.push_back (p + off);
+                    }
                 }
+
+                break;
             }
+
+            visit (id, p, size);
+            p += size;
         }
-            break;
+    }
+}
 
-        case FLATPOLY_DEF: {
-            bsp.polys.push_back ({ });
-            auto& poly = bsp.polys.back ();
+//
+// First pass: validates the BSP data, checking every node and every field a
+// node refers to against the bounds of the node, and counts what the data
+// decodes into:
+//
+static bsp_count_t
+count_bsp (const char* p, const char* end) {
+    bsp_count_t count{ };
 
-            poly.type = FLATPOLY_DEF;
+    walk (p, end, [&](int id, const char* p, int size) {
+        switch (id) {
+        case POINT_DEF: {
+            ensure (20 <= size, "bsp: truncated POINT_DEF");
+
+            int n = ref_i (p [8]);  // vertices
+            ensure (0 <= n && n <= size - 20, "bsp: POINT_DEF count");
+
+            int off = ref_i (p [16]);
+            ensure (0 <= off && off <= size, "bsp: POINT_DEF data offset");
+
+            size_t normals = 0;
+
+            for (int i = 0; i < n; ++i) {
+                if (0 < p [20 + i])
+                    normals += size_t (p [20 + i]);
+            }
+
+            ensure (12 * (n + normals) <= size_t (size - off),
+                    "bsp: POINT_DEF data past end of node");
 
-            poly.normal = ref_v3f (p [8]);
-            poly.center = ref_v3f (p [20]);
-            poly.radius = ref_f   (p [32]);
+            count.vertices += size_t (n);
+            count.normals += normals;
+        }
+            break;
+
+        case FLATPOLY_DEF:
+        case TEXTPOLY_DEF: {
+            ensure (44 <= size, "bsp: truncated polygon");
 
             int n = ref_i (p [36]); // number of vertices
+            ensure (0 <= n && n <= (size - 44) / (id == FLATPOLY_DEF ? 4 : 12),
+                    "bsp: polygon vertex count");
+
+            ++count.polys;
+            count.corners += size_t (n);
+        }
+            break;
 
-            poly.vertices.resize (n, { });
-            poly.normals. resize (n, { });
+        case BOX_DEF:
+            ensure (32 <= size, "bsp: truncated BOX_DEF");
+            break;
 
-            poly.color = ref_i (p [40]);
+        default:
+            ASSERT (0);
+            break;
+        }
+    });
+
+    return count;
+}
+
+//
+// Second pass: decodes the BSP data validated by the first pass straight into
+// the model arrays, already sized, starting at the positions in at. Vertices
+// are offset by the subobject offset, all at once after decoding, and polygon
+// vertex and normal indices are made absolute:
+//
+static void
+decode_bsp (const char* p, const char* end, bsp_count_t at,
+            int subobj_index, pof_t& pof) {
+    const auto& off = pof.subobjs [subobj_index].off;
+    const int base_vertex = int (at.vertices);
+    const int base_normal = int (at.normals);
+
+    auto& polys = pof.polys;
+    const size_t first_vertex = at.vertices;
+
+    walk (p, end, [&](int id, const char* p, int) {
+        switch (id) {
+        case POINT_DEF: {
+            int n = ref_i (p [8]);  // vertices
+
+            const char* s = p;
+            s += ref_i (p [16]);
 
             for (int i = 0; i < n; ++i) {
-                poly.vertices [i] = ref_s (p [44 + (i * 4)]);
-                poly.normals  [i] = ref_s (p [46 + (i * 4)]);
+                //
+                // Add vertex and set its subobject:
+                //
+                pof.vertices [at.vertices] = ref_v3f (s [0]);
+                pof.subobj_indices [at.vertices++] = subobj_index;
+
+                s += 12;
+
+                //
+                // For each vertex, store a set of normals:
+                //
+                for (int j = 0; j < p [20 + i]; ++j) {
+                    pof.normals [at.normals++] = ref_v3f (s [0]);
+                    s += 12;
+                }
             }
         }
             break;
 
+        case FLATPOLY_DEF:
         case TEXTPOLY_DEF: {
-            bsp.polys.push_back ({ });
-            auto& poly = bsp.polys.back ();
+            const bool textured = TEXTPOLY_DEF == id;
+            const int stride = textured ? 12 : 4;
 
-            poly.type = TEXTPOLY_DEF;
+            size_t k = at.polys++;
 
-            poly.normal = ref_v3f (p [8]);
-            poly.center = ref_v3f (p [20]);
-            poly.radius = ref_f   (p [32]);
-
-            int n = ref_i (p [36]); // number of vertices
+            polys.type [k] = id;
+            polys.subobj_index [k] = subobj_index;
 
-            poly.vertices.resize (n, { });
-            poly.normals. resize (n, { });
+            polys.normal [k] = ref_v3f (p [8]);
+            polys.center [k] = ref_v3f (p [20]);
+            polys.radius [k] = ref_f   (p [32]);
 
-            poly.u.resize (n, { });
-            poly.v.resize (n, { });
+            int n = ref_i (p [36]); // number of vertices
 
             //
             // For textured polygons this is a texture map index
             //
-            poly.color = ref_i (p [40]);
+            polys.color [k] = ref_i (p [40]);
 
-            for (int i = 0; i < n; ++i) {
-                poly.vertices [i] = ref_s (p [44 + (i * 12)]);
-                poly.normals  [i] = ref_s (p [46 + (i * 12)]);
+            size_t first = at.corners;
+
+            at.corners += size_t (n);
+            polys.offsets [k + 1] = int (at.corners);
 
-                poly.u [i] = ref_f (p [48 + (i * 12)]);
-                poly.v [i] = ref_f (p [52 + (i * 12)]);
+            int* vertices = polys.vertices.data () + first;
+            int* normals  = polys.normals.data ()  + first;
+
+            for (int i = 0; i < n; ++i) {
+                vertices [i] = ref_s (p [44 + (i * stride)]) + base_vertex;
+                normals  [i] = ref_s (p [46 + (i * stride)]) + base_normal;
             }
-        }
-            break;
 
-        case BSP_DEF: {
-            read (p + ref_i (p [36]), bsp);
-            read (p + ref_i (p [40]), bsp);
-        }
-            break;
+            if (textured) {
+                float* u = polys.u.data () + first;
+                float* v = polys.v.data () + first;
 
-        case BOX_DEF: {
-            bsp.boxes.push_back ({ ref_v3f (p [8]), ref_v3f (p [20]) });
+                for (int i = 0; i < n; ++i) {
+                    u [i] = ref_f (p [48 + (i * 12)]);
+                    v [i] = ref_f (p [52 + (i * 12)]);
+                }
+            }
         }
             break;
 
         default:
-            ASSERT (0);
             break;
         }
+    });
 
-        p += size;
-    }
+    vector3f_t* vertices = pof.vertices.data ();
+    translate ({ vertices + first_vertex, vertices + at.vertices }, off);
 }
 
-static void
+void
 postprocess (pof_t& pof) {
+    TRACE_ZONE ("postprocess");
+
     //
     // Reset all subobjects detail:
     //
@@ -189,601 +293,656 @@ postprocess (pof_t& pof) {
         //
         int detail = 0;
 
-        for (auto i : pof.detail_subobj)
+        for (auto i : pof.detail_subobj) {
+            ensure (0 <= i && size_t (i) < pof.subobjs.size (),
+                    "detail sub-object out of range");
             pof.subobjs [i].detail = detail++;
+        }
     }
 
     //
     // Each debris subobject gets a detail level of 9:
     //
-    for (auto i : pof.debris_subobj)
+    for (auto i : pof.debris_subobj) {
+        ensure (0 <= i && size_t (i) < pof.subobjs.size (),
+                "debris sub-object out of range");
         pof.subobjs [i].detail = 9;
+    }
 
+    //
+    // Children borrow the detail level of their parent, which comes first and
+    // has borrowed its root's, in one pass:
+    //
     for (size_t i = 0; i < pof.subobjs.size (); ++i) {
-        if (0 <= pof.subobjs [i].parent) {
-            //
-            // For each child object ...:
-            //
-            int j = i;
+        auto& subobj = pof.subobjs [i];
 
-            //
-            // ... traverse to root subobject ...:
-            //
-            while (0 <= pof.subobjs [j].parent)
-                j = pof.subobjs [j].parent;
+        ensure (subobj.parent < int (i), "sub-object parent out of range");
 
-            //
-            // ... and borrow the detail level from root:
-            //
-            ASSERT (0 > pof.subobjs [j].parent);
-            pof.subobjs [i].detail = pof.subobjs [j].detail;
-        }
+        if (0 <= subobj.parent)
+            subobj.detail = pof.subobjs [subobj.parent].detail;
     }
 }
 
-static void
-postprocess (pof_t& pof, bsp_t& bsp) {
-    auto& subobj = pof.subobjs.back ();
-
-    int base_subobj = pof.subobjs.size () - 1;
-    int base_vertex = pof.vertices.size ();
-
-    for (auto& v : bsp.vertices)
-        v += subobj.off;
+//
+// Decodes the BSP data of all subobjects once all chunks are read, in two
+// passes over each subobject's data which run in parallel when the context has
+// a pool. In between, a serial stitch assigns each subobject its range of the
+// model arrays, in subobject order, and sizes the arrays once, exactly; the
+// result does not depend on whether or how the passes ran in parallel:
+//
+void
+read_geometry (pof_context_t& ctx, pof_t& pof) {
+    TRACE_ZONE ("geometry");
+
+    auto& bsps = ctx.bsps;
+
+    auto for_each_bsp = [&](auto f) {
+        if (ctx.pool && 1 < bsps.size ())
+            ctx.pool->parallel_for (bsps.size (), f);
+        else
+            for (size_t i = 0; i < bsps.size (); ++i) f (i);
+    };
+
+    for_each_bsp ([&](size_t i) {
+        auto& bsp = bsps [i];
+        TRACE_ZONE ("count bsp", to_string (bsp.subobj));
+
+        bsp.count = count_bsp (bsp.data, bsp.data + bsp.size);
+    });
+
+    vector< bsp_count_t > at (bsps.size () + 1);
+
+    at [0] = {
+        pof.vertices.size (), pof.normals.size (),
+        pof.polys.size (), pof.polys.corners ()
+    };
+
+    for (size_t i = 0; i < bsps.size (); ++i) {
+        const auto& count = bsps [i].count;
+
+        at [i + 1].vertices = at [i].vertices + count.vertices;
+        at [i + 1].normals  = at [i].normals  + count.normals;
+        at [i + 1].polys    = at [i].polys    + count.polys;
+        at [i + 1].corners  = at [i].corners  + count.corners;
+    }
 
-    pof.vertices.insert (
-        pof.vertices.end (),
-        bsp.vertices.begin (), bsp.vertices.end ());
+    const auto& total = at.back ();
 
-    pof.subobj_indices.resize (
-        pof.subobj_indices.size () + bsp.vertices.size (),
-        base_subobj);
+    pof.vertices.resize (total.vertices);
+    pof.normals.resize (total.normals);
+    pof.subobj_indices.resize (total.vertices);
 
-    pof.normals.insert (
-        pof.normals.end (),
-        bsp.normals.begin (), bsp.normals.end ());
+    pof.polys.resize (total.polys, total.corners);
 
-    for (auto& p : bsp.polys) {
-        p.subobj_index = base_subobj;
+    for_each_bsp ([&](size_t i) {
+        auto& bsp = bsps [i];
+        TRACE_ZONE ("decode bsp", to_string (bsp.subobj));
 
-        for (auto& v : p.vertices)
-            v += base_vertex;
-    }
+        decode_bsp (bsp.data, bsp.data + bsp.size, at [i], bsp.subobj, pof);
+    });
+}
 
-    pof.polys.insert (
-        pof.polys.end (),
-        bsp.polys.begin (), bsp.polys.end ());
+//
+// Stages a subobject's BSP data, which is decoded once all chunks are read.
+// The stream decoder keeps a copy of the data, the cursor one refers to it in
+// place:
+//
+static void
+stage_bsp (pof_context_t& ctx, const char* p, size_t n, int subobj) {
+    ctx.bsps.push_back ({ p, n, subobj, { } });
 }
 
 static istream&
-read (istream& s, pof_t& pof) {
-    s.seekg (0, ios_base::end);
+read_bsp (pof_context_t& ctx, istream& s, size_t n, int subobj) {
+    ctx.buffers.emplace_back (n, 0);
+    auto& arr = ctx.buffers.back ();
 
-    file_size = s.tellg ();
-    s.seekg (0, ios_base::beg);
+    ASSERT (read (s, arr));
 
-    II << " --> file size : " << file_size;
+    return stage_bsp (ctx, arr.data (), n, subobj), s;
+}
 
-    int file_id = 0;
-    ASSERT (read (s, file_id));
+static cursor_t&
+read_bsp (pof_context_t& ctx, cursor_t& s, size_t n, int subobj) {
+    return stage_bsp (ctx, s.take (n), n, subobj), s;
+}
 
-    big_to_native_inplace (file_id);
-    ASSERT (file_id == 'PSPO');
+template< typename Stream >
+static void
+read_chunk (pof_context_t& ctx, Stream& s, int id, int len, pof_t& pof) {
+    TRACE_ZONE ("chunk", string_from (id));
 
-    ASSERT (read (s, file_version));
+    streamoff next = streamoff (s.tellg ()) + len;
 
-    II << " --> file_id : " << string_from (file_id) << ", file version : "
-       << hex << file_version;
+    switch (id) {
+    case 'OHDR':
+        ASSERT (0);
 
-    while (s.tellg () < file_size) {
-        int id{ };
-        ASSERT (read (s, id));
+    case 'HDR2': {
+        ASSERT (read (s, pof.radius));
+        ASSERT (read (s, pof.flags));
 
-        big_to_native_inplace (id);
+        {
+            int n{ };
+            ASSERT (read (s, n));
 
-        int len = 0;
-        ASSERT (read (s, len));
+            II << "    --> sub-objects : " << n;
+        }
 
-        II << "  --> id : " << hex << string_from (id) << " ("
-           << dec << len << ")";
+        ASSERT (read (s, pof.minbox));
+        ASSERT (read (s, pof.maxbox));
 
-        streamoff fpos = s.tellg ();
-        streamoff next = fpos + len;
+        {
+            int n{ };
+            ASSERT (read (s, n));
 
-        ASSERT (next <= file_size);
+            II << "    --> details : " << n;
 
-        switch (id) {
-        case 'OHDR':
-            ASSERT (0);
+            if (n) {
+                pof.detail_subobj.resize (size_t (n), { });
+                ASSERT (read (s, pof.detail_subobj));
+            }
+        }
 
-        case 'HDR2': {
-            ASSERT (read (s, pof.radius));
-            ASSERT (read (s, pof.flags));
+        {
+            int n{ };
+            ASSERT (read (s, n));
 
-            {
-                int n{ };
-                ASSERT (read (s, n));
+            II << "    --> debris : " << n;
 
-                II << "    --> sub-objects : " << n;
+            if (n) {
+                pof.debris_subobj.resize (size_t (n), { });
+                ASSERT (read (s, pof.debris_subobj));
             }
+        }
 
-            ASSERT (read (s, pof.minbox));
-            ASSERT (read (s, pof.maxbox));
+        if (ctx.file_version >= 1903) {
+            float scale = 1.0f;
 
-            {
-                int n{ };
-                ASSERT (read (s, n));
-
-                II << "    --> details : " << n;
+            ASSERT (read (s, pof.mass));
+            ASSERT (read (s, pof.mass_center));
 
-                if (n) {
-                    pof.detail_subobj.resize (size_t (n), { });
+            if (ctx.file_version < 2009) {
+                double v = pof.mass;
+                double a = 4.65 * pow (pof.mass, 2 / 3);
+                scale = float (v / a);
+                pof.mass = a;
+            }
 
-                    for (auto& detail : pof.detail_subobj)
-                        ASSERT (read (s, detail));
+            for (int j = 0; j < 3; ++j) {
+                for (int i = 0; i < 3; ++i) {
+                    float value;
+                    ASSERT (read (s, value));
+                    pof.inertia_tensor [i][j] = value * scale;
                 }
             }
+        }
+        else {
+            pof.mass = 1.0;
 
-            {
-                int n{ };
-                ASSERT (read (s, n));
-
-                II << "    --> debris : " << n;
+            pof.mass_center.value [0] = 0.0;
+            pof.mass_center.value [1] = 0.0;
+            pof.mass_center.value [2] = 0.0;
 
-                if (n) {
-                    pof.debris_subobj.resize (size_t (n), { });
+            auto& x = pof.inertia_tensor;
+            fill (&x[0][0], &x[0][0] + sizeof x / sizeof **x, 0);
+        }
 
-                    for (auto& debris : pof.debris_subobj)
-                        ASSERT (read (s, debris));
-                }
-            }
+        II << "    --> mass : " << pof.mass;
+        II << "    --> mass center : " << pof.mass_center;
 
-            if (file_version >= 1903) {
-                float scale = 1.0f;
+        if (ctx.file_version >= 2014) {
+            int n{ };
+            ASSERT (read (s, n));
 
-                ASSERT (read (s, pof.mass));
-                ASSERT (read (s, pof.mass_center));
+            II << "    --> cross-sections : " << n;
 
-                if (file_version < 2009) {
-                    double v = pof.mass;
-                    double a = 4.65 * pow (pof.mass, 2 / 3);
-                    scale = float (v / a);
-                    pof.mass = a;
-                }
+            if (0 < n) {
+                pof.cross_sections.resize (size_t (n), { });
 
-                for (int j = 0; j < 3; ++j) {
-                    for (int i = 0; i < 3; ++i) {
-                        float value;
-                        ASSERT (read (s, value));
-                        pof.inertia_tensor [i][j] = value * scale;
-                    }
+                for (auto& x : pof.cross_sections) {
+                    ASSERT (read (s, x.depth));
+                    ASSERT (read (s, x.radius));
                 }
             }
-            else {
-                pof.mass = 1.0;
-
-                pof.mass_center.value [0] = 0.0;
-                pof.mass_center.value [1] = 0.0;
-                pof.mass_center.value [2] = 0.0;
-
-                auto& x = pof.inertia_tensor;
-                fill (&x[0][0], &x[0][0] + sizeof x / sizeof **x, 0);
-            }
+        }
 
-            II << "    --> mass : " << pof.mass;
-            II << "    --> mass center : " << pof.mass_center;
+        if (ctx.file_version >= 2007) {
+            int n{ };
 
-            if (file_version >= 2014) {
-                int n{ };
-                ASSERT (read (s, n));
+            ASSERT (read (s, n));
+            ASSERT (n != 'SOBJ' && n != 'OBJ2');
 
-                II << "    --> cross-sections : " << n;
+            pof.lights.resize (size_t (n), { });
 
-                if (0 < n) {
-                    pof.cross_sections.resize (size_t (n), { });
+            II << "    --> lights : " << n;
 
-                    for (auto& x : pof.cross_sections) {
-                        ASSERT (read (s, x.depth));
-                        ASSERT (read (s, x.radius));
-                    }
-                }
+            for (auto& light : pof.lights) {
+                ASSERT (read (s, light.pos));
+                ASSERT (read (s, light.type));
+                ASSERT (1 == light.type || 2 == light.type);
             }
+        }
+    }
+        break;
 
-            if (file_version >= 2007) {
-                int n{ };
+    case 'TXTR': {
+        int n{ };
+        ASSERT (read (s, n));
 
-                ASSERT (read (s, n));
-                ASSERT (n != 'SOBJ' && n != 'OBJ2');
+        pof.textures.resize (size_t (n), { });
 
-                pof.lights.resize (size_t (n), { });
+        for (auto& text : pof.textures) {
+            ASSERT (read (s, text.name));
+            II << "    --> " << text.name;
+        }
+    }
+        break;
 
-                II << "    --> lights : " << n;
+    case 'SHLD': {
+        {
+            int n{ };
+            ASSERT (read (s, n));
 
-                for (auto& light : pof.lights) {
-                    ASSERT (read (s, light.pos));
-                    ASSERT (read (s, light.type));
-                    ASSERT (1 == light.type || 2 == light.type);
-                }
-            }
+            pof.shield.vertices.resize (size_t (n), { });
+            ASSERT (read (s, pof.shield.vertices));
         }
-            break;
 
-        case 'TXTR': {
+        {
             int n{ };
             ASSERT (read (s, n));
 
-            pof.textures.resize (size_t (n), { });
+            pof.shield.faces.resize (size_t (n), { });
 
-            for (auto& text : pof.textures) {
-                ASSERT (read (s, text.name));
-                II << "    --> " << text.name;
-            }
+            //
+            // A face is a normal, three vertices and three neighbors, all
+            // 4-byte scalars, laid out as in the file:
+            //
+            using face_type = pof_t::shield_t::face_t;
+            static_assert (36 == sizeof (face_type), "shield face layout");
+
+            auto* first = reinterpret_cast< int* > (pof.shield.faces.data ());
+            ASSERT (read (s, span_t< int >{ first, first + 9 * n }));
         }
-            break;
+    }
+        break;
 
-        case 'SHLD': {
-            {
-                int n{ };
-                ASSERT (read (s, n));
+    case 'SOBJ':
+    case 'OBJ2': {
+        pof.subobjs.emplace_back ();
+        auto& subobj = pof.subobjs.back ();
 
-                pof.shield.vertices.resize (size_t (n), { });
+        ASSERT (read (s, subobj.number));
+        II << "    --> sub-object : " << subobj.number;
 
-                for (auto& v : pof.shield.vertices)
-                    ASSERT (read (s, v));
-            }
+        if (id == 'OBJ2')
+            ASSERT (read (s, subobj.radius));
 
-            {
-                int n{ };
-                ASSERT (read (s, n));
+        ASSERT (read (s, subobj.parent));   // parent
+        ASSERT (read (s, subobj.real_off)); // offset
 
-                pof.shield.faces.resize (size_t (n), { });
+        subobj.off = subobj.real_off;
 
-                for (auto& f : pof.shield.faces) {
-                    ASSERT (read (s, f.normal));
+        //
+        // Parents precede their children, which also keeps the hierarchy
+        // free of cycles:
+        //
+        ensure (-1 <= subobj.parent &&
+                subobj.parent < int (pof.subobjs.size ()) - 1,
+                "sub-object parent out of range");
 
-                    ASSERT (read (s, f.vertices [0]));
-                    ASSERT (read (s, f.vertices [1]));
-                    ASSERT (read (s, f.vertices [2]));
+        if (subobj.parent != -1)
+            subobj.off += pof.subobjs [subobj.parent].off;
 
-                    ASSERT (read (s, f.neighbors [0]));
-                    ASSERT (read (s, f.neighbors [1]));
-                    ASSERT (read (s, f.neighbors [2]));
-                }
-            }
-        }
-            break;
+        if (id == 'SOBJ')
+            ASSERT (read (s, subobj.radius)); //rad
 
-        case 'SOBJ':
-        case 'OBJ2': {
-            pof.subobjs.push_back ({ });
-            auto& subobj = pof.subobjs.back ();
+        ASSERT (read (s, subobj.center));
+        ASSERT (read (s, subobj.minbox));
+        ASSERT (read (s, subobj.maxbox));
 
-            ASSERT (read (s, subobj.number));
-            II << "    --> sub-object : " << subobj.number;
+        ASSERT (read (s, subobj.name));
+        ASSERT (read (s, subobj.properties));
 
-            if (id == 'OBJ2')
-                ASSERT (read (s, subobj.radius));
+        II << "    --> name : " << subobj.name;
+        II << "    --> prop : " << subobj.properties;
 
-            ASSERT (read (s, subobj.parent));   // parent
-            ASSERT (read (s, subobj.real_off)); // offset
+        ASSERT (read (s, subobj.movement.type));
+        ASSERT (read (s, subobj.movement.axis));
 
-            subobj.off = subobj.real_off;
+        int ignore;
 
-            if (subobj.parent != -1)
-                subobj.off += pof.subobjs [subobj.parent].off;
+        ASSERT (read (s, ignore));
+        ASSERT (0 == ignore);
 
-            if (id == 'SOBJ')
-                ASSERT (read (s, subobj.radius)); //rad
+        int n = 0;
+        ASSERT (read (s, n));
 
-            ASSERT (read (s, subobj.center));
-            ASSERT (read (s, subobj.minbox));
-            ASSERT (read (s, subobj.maxbox));
+        II << "    --> BSP data : " << n << " bytes";
 
-            ASSERT (read (s, subobj.name));
-            ASSERT (read (s, subobj.properties));
+        int subobj_index = int (pof.subobjs.size ()) - 1;
+        ASSERT (read_bsp (ctx, s, size_t (n), subobj_index));
+    }
+        break;
+
+    case 'GPNT':
+    case 'MPNT': {
+        int guntype = id == 'GPNT' ? 0 : 1;
 
-            II << "    --> name : " << subobj.name;
-            II << "    --> prop : " << subobj.properties;
+        auto& guns = pof.guns[guntype];
 
-            ASSERT (read (s, subobj.movement.type));
-            ASSERT (read (s, subobj.movement.axis));
+        int n{ };
+        ASSERT (read (s, n));
 
-            int ignore;
+        guns.resize (size_t (n), { });
 
-            ASSERT (read (s, ignore));
-            ASSERT (0 == ignore);
+        for (int i = 0; i < n; ++i) {
+            auto& slot = guns [i];
 
-            int n = 0;
+            int n{ };
             ASSERT (read (s, n));
 
-            II << "    --> BSP data : " << n << " bytes";
+            slot.resize (size_t (n), { });
 
-            vector< char > arr (size_t (n), 0);
-            ASSERT (read (s, arr));
+            for (int j = 0; j < n; ++j) {
+                //
+                // One normal per gun:
+                //
+                ASSERT (read (s, slot [j].pos));
+                ASSERT (read (s, slot [j].normal));
+
+                //
+                // Store the guns defined here in the global gun directory:
+                //
+                pof.weapons.push_back ({ });
+                auto& weapon = pof.weapons.back ();
+
+                weapon.type = id == 'GPNT' ? GUN_TYPE : MISSILE_TYPE;
 
-            bsp_t bsp{ };
-            read (arr.data (), bsp);
+                weapon.pos = slot [j].pos;
+                weapon.normal = slot [j].normal;
 
-            postprocess (pof, bsp);
+                weapon.subobj = 0;
+                weapon.bank = i;
+            }
         }
-            break;
+    }
+        break;
 
-        case 'GPNT':
-        case 'MPNT': {
-            int guntype = id == 'GPNT' ? 0 : 1;
+    case 'TGUN':
+    case 'TMIS': {
+        int guntype = id == 'TGUN' ? 0 : 1;
 
-            auto& guns = pof.guns[guntype];
+        auto& turret_banks = pof.turret_banks [guntype];
 
-            int n{ };
-            ASSERT (read (s, n));
+        int n{ };
+        ASSERT (read (s, n));
 
-            guns.resize (size_t (n), { });
+        turret_banks.resize (size_t (n), { });
 
-            for (int i = 0; i < n; ++i) {
-                auto& slot = guns [i];
+        for (int i = 0; i < n; ++i) {
+            auto& bank = turret_banks [i];
 
-                int n{ };
-                ASSERT (read (s, n));
+            ASSERT (read (s, bank.barrel_subobj));
+            ASSERT (read (s, bank.mount_subobj));
+
+            //
+            // One normal, only:
+            //
+            ASSERT (read (s, bank.normal));
+
+            int n{ };
+            ASSERT (read (s, n));
 
-                slot.resize (size_t (n), { });
+            bank.pos.resize (size_t (n), { });
 
-                for (int j = 0; j < n; ++j) {
-                    //
-                    // One normal per gun:
-                    //
-                    ASSERT (read (s, slot [j].pos));
-                    ASSERT (read (s, slot [j].normal));
+            for (int j = 0; j < n; ++j) {
+                ASSERT (read (s, bank.pos [j]));
 
-                    //
-                    // Store the guns defined here in the global gun directory:
-                    //
-                    pof.weapons.push_back ({ });
-                    auto& weapon = pof.weapons.back ();
+                //
+                // Store the guns defined here in the global gun directory:
+                //
+                pof.weapons.push_back ({ });
+                auto& weapon = pof.weapons.back ();
 
-                    weapon.type = id == 'GPNT' ? GUN_TYPE : MISSILE_TYPE;
+                weapon.type = id == 'TGUN'
+                    ? GUN_TURRET_TYPE : MISSILE_TURRET_TYPE;
 
-                    weapon.pos = slot [j].pos;
-                    weapon.normal = slot [j].normal;
+                weapon.pos = bank.pos [j];
+                weapon.normal = bank.normal;
 
-                    weapon.subobj = 0;
-                    weapon.bank = i;
-                }
+                weapon.subobj = 0;
+                weapon.bank = i;
             }
         }
-            break;
+    }
+        break;
 
-        case 'TGUN':
-        case 'TMIS': {
-            int guntype = id == 'TGUN' ? 0 : 1;
+    case 'SPCL': {
+        int n{ };
+        ASSERT (read (s, n));
 
-            auto& turret_banks = pof.turret_banks [guntype];
+        pof.subsys.resize (size_t (n), { });
 
-            int n{ };
-            ASSERT (read (s, n));
+        for (int i = 0; i < n; ++i) {
+            auto& subsys = pof.subsys [i];
 
-            turret_banks.resize (size_t (n), { });
+            ASSERT (read (s, subsys.name));
+            ASSERT (read (s, subsys.properties));
+            ASSERT (read (s, subsys.pos));
+            ASSERT (read (s, subsys.radius));
+        }
+    }
+        break;
 
-            for (int i = 0; i < n; ++i) {
-                auto& bank = turret_banks [i];
+    case 'DOCK': {
+        int n{ };
+        ASSERT (read (s, n));
 
-                ASSERT (read (s, bank.barrel_subobj));
-                ASSERT (read (s, bank.mount_subobj));
+        pof.docks.resize (size_t (n), { });
 
-                //
-                // One normal, only:
-                //
-                ASSERT (read (s, bank.normal));
+        for (int i = 0; i < n; ++i) {
+            auto& dock = pof.docks [i];
+
+            ASSERT (read (s, dock.properties));
 
+            {
                 int n{ };
                 ASSERT (read (s, n));
 
-                bank.pos.resize (size_t (n), { });
-
-                for (int j = 0; j < n; ++j) {
-                    ASSERT (read (s, bank.pos [j]));
+                dock.splines.resize (size_t (n), { });
 
-                    //
-                    // Store the guns defined here in the global gun directory:
-                    //
-                    pof.weapons.push_back ({ });
-                    auto& weapon = pof.weapons.back ();
-
-                    weapon.type = id == 'TGUN'
-                        ? GUN_TURRET_TYPE : MISSILE_TURRET_TYPE;
-
-                    weapon.pos = bank.pos [j];
-                    weapon.normal = bank.normal;
-
-                    weapon.subobj = 0;
-                    weapon.bank = i;
-                }
+                for (int j = 0; j < n; ++j)
+                    ASSERT (read (s, dock.splines [j]));
             }
-        }
-            break;
 
-        case 'SPCL': {
-            int n{ };
-            ASSERT (read (s, n));
+            {
+                int n{ };
+                ASSERT (read (s, n));
 
-            pof.subsys.resize (size_t (n), { });
+                dock.pos.resize (size_t (n), { });
+                dock.normal.resize (size_t (n), { });
 
-            for (int i = 0; i < n; ++i) {
-                auto& subsys = pof.subsys [i];
-
-                ASSERT (read (s, subsys.name));
-                ASSERT (read (s, subsys.properties));
-                ASSERT (read (s, subsys.pos));
-                ASSERT (read (s, subsys.radius));
+                for (int j = 0; j < n; j++) {
+                    ASSERT (read (s, dock.pos [j]));
+                    ASSERT (read (s, dock.normal [j]));
+                }
             }
         }
-            break;
+    }
+        break;
 
-        case 'DOCK': {
-            int n{ };
-            ASSERT (read (s, n));
+    case 'PATH': {
+        //
+        // Ignored
+        //
+        int num_paths = 0;
+        ASSERT (read (s, num_paths));
 
-            pof.docks.resize (size_t (n), { });
+        for (int i = 0; i < num_paths; ++i) {
+            string y, z;
 
-            for (int i = 0; i < n; ++i) {
-                auto& dock = pof.docks [i];
+            ASSERT (read (s, y));
+            ASSERT (read (s, z));
 
-                ASSERT (read (s, dock.properties));
+            int num_verts = 0;
+            ASSERT (read (s, num_verts));
 
+            for (int j = 0; j < num_verts; j++) {
                 {
-                    int n{ };
-                    ASSERT (read (s, n));
-
-                    dock.splines.resize (size_t (n), { });
-
-                    for (int j = 0; j < n; ++j)
-                        ASSERT (read (s, dock.splines [j]));
+                    vector3f_t ignore;
+                    ASSERT (read (s, ignore));
                 }
 
                 {
-                    int n{ };
-                    ASSERT (read (s, n));
+                    float ignore;
+                    ASSERT (read (s, ignore));
+                }
 
-                    dock.pos.resize (size_t (n), { });
-                    dock.normal.resize (size_t (n), { });
+                int ignore = 0;
+                ASSERT (read (s, ignore));
 
-                    for (int j = 0; j < n; j++) {
-                        ASSERT (read (s, dock.pos [j]));
-                        ASSERT (read (s, dock.normal [j]));
-                    }
+                for (int k = 0; k < ignore; k++) {
+                    int ignore = 0;
+                    ASSERT (read (s, ignore));
                 }
             }
         }
-            break;
+    }
+        break;
 
-        case 'PATH': {
-            //
-            // Ignored
-            //
-            int num_paths = 0;
-            ASSERT (read (s, num_paths));
+    case 'FUEL': {
+        int n{ };
+        ASSERT (read (s, n));
 
-            for (int i = 0; i < num_paths; ++i) {
-                string y, z;
+        II << "    --> thrusters : " << n;
+        pof.thrusters.resize (size_t (n), { });
 
-                ASSERT (read (s, y));
-                ASSERT (read (s, z));
+        for (int i = 0; i < n; ++i) {
+            auto& thruster = pof.thrusters [i];
 
-                int num_verts = 0;
-                ASSERT (read (s, num_verts));
+            int n{ };
+            ASSERT (read (s, n));
 
-                for (int j = 0; j < num_verts; j++) {
-                    {
-                        vector3f_t ignore;
-                        ASSERT (read (s, ignore));
-                    }
+            II << "      --> glows : " << n;
+            thruster.glows.resize (size_t (n), { });
 
-                    {
-                        float ignore;
-                        ASSERT (read (s, ignore));
-                    }
+            if (ctx.file_version >= 2117)
+                ASSERT (read (s, thruster.properties));
 
-                    int ignore = 0;
-                    ASSERT (read (s, ignore));
+            for (int j = 0; j < n; ++j) {
+                auto& glow = thruster.glows[j];
 
-                    for (int k = 0; k < ignore; k++) {
-                        int ignore = 0;
-                        ASSERT (read (s, ignore));
-                    }
-                }
+                ASSERT (read (s, glow.pos));
+                ASSERT (read (s, glow.normal));
+                ASSERT (read (s, glow.radius));
             }
         }
-            break;
+    }
+        break;
 
-        case 'FUEL': {
-            int n{ };
-            ASSERT (read (s, n));
+    case 'PINF': {
+        vector< char > buf (size_t (next - s.tellg ()), 0);
 
-            II << "    --> thrusters : " << n;
-            pof.thrusters.resize (size_t (n), { });
+        if (!buf.empty ())
+            ASSERT (read (s, buf));
 
-            for (int i = 0; i < n; ++i) {
-                auto& thruster = pof.thrusters [i];
+        string text;
 
-                int n{ };
-                ASSERT (read (s, n));
+        for (auto c : buf) {
+            if (0 == c)
+                c = '\n';
 
-                II << "      --> glows : " << n;
-                thruster.glows.resize (size_t (n), { });
+            text += c;
+        }
 
-                if (file_version >= 2117)
-                    ASSERT (read (s, thruster.properties));
+        II << "    --> Compilation data : \n\"" << text << "\"";
+    }
+        break;
 
-                for (int j = 0; j < n; ++j) {
-                    auto& glow = thruster.glows[j];
+    case 'EYE ': {
+        int n{ };
 
-                    ASSERT (read (s, glow.pos));
-                    ASSERT (read (s, glow.normal));
-                    ASSERT (read (s, glow.radius));
-                }
-            }
+        ASSERT (read (s, n));
+        ASSERT (0 == n || 1 == n);
+
+        II << "    --> eyes : " << n;
+
+        if (n) {
+            pof.eyes.resize (size_t (n), { });
+
+            ASSERT (read (s, pof.eyes [0].subobj_index));
+            // ASSERT (pof.eyes [0].subobj_index < pof.nsubobjs);
+
+            II << "    --> subobj : " << pof.eyes [0].subobj_index;
+
+            ASSERT (read (s, pof.eyes [0].off));
+            ASSERT (read (s, pof.eyes [0].normal));
         }
-            break;
+    }
 
-        case 'PINF': {
-            vector< char > buf (size_t (next - s.tellg ()), 0);
+        break;
 
-            if (!buf.empty ())
-                ASSERT (read (s, buf));
+    case 'INSG': {
+        int tmp = 0;
+        ASSERT (read (s, tmp));
 
-            string text;
+        s.seekg (-4, ios_base::cur);
+    }
+        break;
 
-            for (auto c : buf) {
-                if (0 == c)
-                    c = '\n';
+    case 'ACEN':
+        ASSERT (len == 12);
+        ASSERT (read (s, pof.autocenter_point));
 
-                text += c;
-            }
+        break;
 
-            II << "    --> Compilation data : \n\"" << text << "\"";
-        }
-            break;
+    default:
+        ASSERT (0);
+        break;
+    }
+}
 
-        case 'EYE ': {
-            int n{ };
+static istream&
+read (pof_context_t& ctx, istream& s, pof_t& pof) {
+    TRACE_ZONE ("read stream");
 
-            ASSERT (read (s, n));
-            ASSERT (0 == n || 1 == n);
+    s.seekg (0, ios_base::end);
 
-            II << "    --> eyes : " << n;
+    ctx.file_size = s.tellg ();
+    s.seekg (0, ios_base::beg);
 
-            if (n) {
-                pof.eyes.resize (size_t (n), { });
+    II << " --> file size : " << ctx.file_size;
 
-                ASSERT (read (s, pof.eyes [0].subobj_index));
-                // ASSERT (pof.eyes [0].subobj_index < pof.nsubobjs);
+    int file_id = 0;
+    ASSERT (read (s, file_id));
 
-                II << "    --> subobj : " << pof.eyes [0].subobj_index;
+    endian_reverse_inplace (file_id);
+    ASSERT (file_id == 'PSPO');
 
-                ASSERT (read (s, pof.eyes [0].off));
-                ASSERT (read (s, pof.eyes [0].normal));
-            }
-        }
+    ASSERT (read (s, ctx.file_version));
 
-            break;
+    II << " --> file_id : " << string_from (file_id) << ", file version : "
+       << hex << ctx.file_version;
 
-        case 'INSG': {
-            int tmp = 0;
-            ASSERT (read (s, tmp));
+    while (s.tellg () < streamoff (ctx.file_size)) {
+        int id{ };
+        ASSERT (read (s, id));
 
-            s.seekg (-4, ios_base::cur);
-        }
-            break;
+        endian_reverse_inplace (id);
 
-        case 'ACEN':
-            ASSERT (len == 12);
-            ASSERT (read (s, pof.autocenter_point));
+        int len = 0;
+        ASSERT (read (s, len));
 
-            break;
+        II << "  --> id : " << hex << string_from (id) << " ("
+           << dec << len << ")";
 
-        default:
-            ASSERT (0);
-            break;
-        }
+        streamoff fpos = s.tellg ();
+        streamoff next = fpos + len;
+
+        ASSERT (next <= streamoff (ctx.file_size));
+
+        read_chunk (ctx, s, id, len, pof);
 
         streamoff off = s.tellg ();
         ASSERT (off <= next);
@@ -794,27 +953,115 @@ read (istream& s, pof_t& pof) {
         }
     }
 
+    read_geometry (ctx, pof);
+
     return postprocess (pof), s;
 }
 
-////////////////////////////////////////////////////////////////////////
+vector< pof_chunk_t >
+read_chunks (pof_context_t& ctx, const char* p, size_t n) {
+    TRACE_ZONE ("chunk table");
+
+    cursor_t s (p, n);
+
+    ctx.file_size = s.size ();
 
-int main (int, char** argv) {
-    ASSERT (argv [1] && argv [1][0]);
+    II << " --> file size : " << ctx.file_size;
 
-    if (fs::exists (argv [1]) && fs::is_regular_file (argv [1])) {
-        file_size = fs::file_size (argv [1]);
+    int file_id = 0;
+    ASSERT (read (s, file_id));
+
+    endian_reverse_inplace (file_id);
+    ASSERT (file_id == 'PSPO');
 
-        ifstream s (argv [1], ios_base::in | ios_base::binary);
-        s.exceptions (ios_base::badbit | ios_base::failbit);
+    ASSERT (read (s, ctx.file_version));
 
-        auto p = make_unique< pof_t > ();
-        ASSERT (read (s, *p));
+    II << " --> file_id : " << string_from (file_id) << ", file version : "
+       << hex << ctx.file_version;
 
-        return 0;
-    }
-    else {
-        EE << "missing file : " << argv [1];
-        return 1;
+    vector< pof_chunk_t > chunks;
+
+    while (s.avail ()) {
+        int id{ };
+        ASSERT (read (s, id));
+
+        endian_reverse_inplace (id);
+
+        int len = 0;
+        ASSERT (read (s, len));
+
+        II << "  --> id : " << hex << string_from (id) << " ("
+           << dec << len << ")";
+
+        ensure (0 <= len && size_t (len) <= s.avail (),
+                "chunk extends past end of file");
+
+        chunks.push_back ({ id, size_t (s.tellg ()), size_t (len) });
+        s.take (size_t (len));
     }
+
+    return chunks;
+}
+
+//
+// Every chunk is decoded through its own cursor, so that no chunk can read
+// past its length:
+//
+void
+read_chunk (pof_context_t& ctx, int id, const char* p, size_t n, pof_t& pof) {
+    cursor_t chunk (p, n);
+    read_chunk (ctx, chunk, id, int (n), pof);
+
+    if (chunk.avail ())
+        WW << "offset : " << chunk.tellg () << " < " << n;
+}
+
+//
+// Decodes a whole POF image held in memory, e.g., a mapped file:
+//
+static void
+read (pof_context_t& ctx, const char* p, size_t n, pof_t& pof) {
+    TRACE_ZONE ("read");
+
+    for (const auto& chunk : read_chunks (ctx, p, n))
+        read_chunk (ctx, chunk.id, p + chunk.offset, chunk.size, pof);
+
+    read_geometry (ctx, pof);
+    postprocess (pof);
+}
+
+istream&
+read (istream& s, pof_t& pof) {
+    pof_context_t ctx{ };
+    return read (ctx, s, pof);
+}
+
+void
+read (const char* p, size_t n, pof_t& pof) {
+    pof_context_t ctx{ };
+    read (ctx, p, n, pof);
+}
+
+void
+read (const char* p, size_t n, pof_t& pof, thread_pool_t& pool) {
+    pof_context_t ctx{ };
+    ctx.pool = &pool;
+
+    read (ctx, p, n, pof);
+}
+
+void
+load (const char* filename, pof_t& pof) {
+    TRACE_ZONE ("load", filename);
+
+    mapped_file_t file (filename);
+    read (file.data, file.size, pof);
+}
+
+void
+load (const char* filename, pof_t& pof, thread_pool_t& pool) {
+    TRACE_ZONE ("load", filename);
+
+    mapped_file_t file (filename);
+    read (file.data, file.size, pof, pool);
 }
@@ -3,6 +3,12 @@
 #ifndef POF_POF_HH
 #define POF_POF_HH
 
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "span.hh"
 #include "vector.hh"
 
 ////////////////////////////////////////////////////////////////////////
@@ -18,6 +24,16 @@
 #define GUN_TURRET_TYPE      3
 #define MISSILE_TURRET_TYPE  4
 
+#define MOVEMENT_TYPE_NONE        -1
+#define MOVEMENT_TYPE_POS          0 // translates, unused
+#define MOVEMENT_TYPE_ROT          1 // rotates about its axis
+#define MOVEMENT_TYPE_ROT_SPECIAL  2 // rotates about its axis, as a turret
+
+#define MOVEMENT_AXIS_NONE        -1
+#define MOVEMENT_AXIS_X            0
+#define MOVEMENT_AXIS_Z            1 // sic, Z before Y
+#define MOVEMENT_AXIS_Y            2
+
 #define MAX_BLOCKS           8192
 #define MAX_BOXES            320000
 #define MAX_CROSSSECTIONS    256
@@ -50,144 +66,530 @@
 
 ////////////////////////////////////////////////////////////////////////
 
+//
+// All containers in a model allocate from the memory resource the model is
+// constructed with, the default resource if none. Nested types that own
+// memory are allocator-aware, so that containers of them construct their
+// elements with the container's resource:
+//
 struct pof_t {
-    int flags;
+    using allocator_type = pmr::polymorphic_allocator< byte >;
 
-    vector3f_t minbox, maxbox;
-    float radius;
+    int flags{ };
+
+    vector3f_t minbox{ }, maxbox{ };
+    float radius{ };
 
     struct box_t {
         vector3f_t minbox, maxbox;
     };
 
-    vector< box_t > boxes;
+    pmr::vector< box_t > boxes;
 
-    float mass;
-    vector3f_t mass_center;
-    float inertia_tensor [3][3];
+    float mass{ };
+    vector3f_t mass_center{ };
+    float inertia_tensor [3][3]{ };
 
-    vector3f_t autocenter_point;
+    vector3f_t autocenter_point{ };
 
     struct cross_section_t {
         float depth, radius;
     };
 
-    vector< cross_section_t > cross_sections;
+    pmr::vector< cross_section_t > cross_sections;
 
     struct light_t {
         vector3f_t pos;
         int type;
     };
 
-    vector< light_t > lights;
+    pmr::vector< light_t > lights;
 
     struct eye_t {
         vector3f_t off, normal;
         int subobj_index;
     };
 
-    vector< eye_t > eyes;
+    pmr::vector< eye_t > eyes;
 
     struct subobj_t {
-        int number, parent, detail;
-        string name, properties;
+        using allocator_type = pof_t::allocator_type;
 
-        vector3f_t center, off, real_off;
+        int number{ }, parent{ }, detail{ };
+        pmr::string name, properties;
 
-        vector3f_t minbox, maxbox;
-        float radius;
+        vector3f_t center{ }, off{ }, real_off{ };
+
+        vector3f_t minbox{ }, maxbox{ };
+        float radius{ };
 
         struct {
             int type, axis;
-        } movement;
+        } movement{ };
+
+        subobj_t (const allocator_type& a = { })
+            : name (a), properties (a)
+            { }
+
+        subobj_t (const subobj_t& other, const allocator_type& a = { })
+            : subobj_t (a)
+            { *this = other; }
+
+        subobj_t (subobj_t&&) = default;
+
+        subobj_t (subobj_t&& other, const allocator_type& a)
+            : subobj_t (a)
+            { *this = move (other); }
+
+        subobj_t& operator= (const subobj_t&) = default;
+        subobj_t& operator= (subobj_t&&) = default;
     };
 
-    vector< subobj_t > subobjs;
-    vector< int > detail_subobj, debris_subobj;
+    pmr::vector< subobj_t > subobjs;
+    pmr::vector< int > detail_subobj, debris_subobj;
 
-    vector< vector3f_t > vertices, normals;
-    vector< int > subobj_indices;
+    pmr::vector< vector3f_t > vertices, normals;
+    pmr::vector< int > subobj_indices;
 
+    //
+    // Read-only view of a polygon in the polygon store; u and v are empty for
+    // flat-shaded polygons:
+    //
     struct poly_t {
         int type, color, subobj_index;
         vector3f_t center, normal;
         float radius;
-        vector< int > vertices, normals;
-        vector< float > u, v;
+        span_t< const int > vertices, normals;
+        span_t< const float > u, v;
     };
 
-    vector< poly_t > polys;
+    //
+    // Polygon store, in a structure-of-arrays layout: per-polygon attributes
+    // in parallel arrays, per-corner attributes in contiguous arrays, with
+    // polygon i owning the corners in [offsets [i], offsets [i + 1]):
+    //
+    struct polys_t {
+        using allocator_type = pof_t::allocator_type;
+
+        pmr::vector< int > type, color, subobj_index;
+        pmr::vector< vector3f_t > center, normal;
+        pmr::vector< float > radius;
+
+        pmr::vector< int > offsets;
+        pmr::vector< int > vertices, normals;
+        pmr::vector< float > u, v;
+
+        polys_t (const allocator_type& a = { })
+            : type (a), color (a), subobj_index (a),
+              center (a), normal (a), radius (a),
+              offsets (1, 0, a), vertices (a), normals (a), u (a), v (a)
+            { }
+
+        polys_t (const polys_t& other, const allocator_type& a = { })
+            : polys_t (a)
+            { *this = other; }
+
+        polys_t (polys_t&&) = default;
+
+        polys_t (polys_t&& other, const allocator_type& a)
+            : polys_t (a)
+            { *this = move (other); }
+
+        polys_t& operator= (const polys_t&) = default;
+        polys_t& operator= (polys_t&&) = default;
+
+        size_t size () const { return type.size (); }
+        bool empty () const { return type.empty (); }
+
+        size_t corners () const { return vertices.size (); }
+
+        poly_t operator[] (size_t i) const {
+            const int* a = &offsets [i];
+
+            const bool textured = TEXTPOLY_DEF == type [i];
+            const int n = textured ? a [1] - a [0] : 0;
+
+            return {
+                type [i], color [i], subobj_index [i],
+                center [i], normal [i], radius [i],
+                { vertices.data () + a [0], vertices.data () + a [1] },
+                { normals.data () + a [0], normals.data () + a [1] },
+                { u.data () + a [0], u.data () + a [0] + n },
+                { v.data () + a [0], v.data () + a [0] + n }
+            };
+        }
+
+        struct const_iterator {
+            using iterator_category = forward_iterator_tag;
+            using value_type = poly_t;
+            using difference_type = ptrdiff_t;
+            using pointer = const poly_t*;
+            using reference = poly_t;
+
+            const polys_t* polys;
+            size_t i;
+
+            poly_t operator* () const { return (*polys) [i]; }
+            const_iterator& operator++ () { return ++i, *this; }
+
+            bool operator== (const const_iterator& other) const {
+                return i == other.i;
+            }
+
+            bool operator!= (const const_iterator& other) const {
+                return i != other.i;
+            }
+        };
+
+        const_iterator begin () const { return { this, 0 }; }
+        const_iterator end () const { return { this, size () }; }
+
+        void reserve (size_t npolys, size_t ncorners) {
+            for (auto* p : { &type, &color, &subobj_index })
+                p->reserve (npolys);
+
+            center.reserve (npolys);
+            normal.reserve (npolys);
+            radius.reserve (npolys);
+
+            offsets.reserve (npolys + 1);
+
+            for (auto* p : { &vertices, &normals })
+                p->reserve (ncorners);
+
+            u.reserve (ncorners);
+            v.reserve (ncorners);
+        }
+
+        //
+        // Appends a polygon with n zeroed corners and returns its index; the
+        // caller fills in its attributes:
+        //
+        size_t append (size_t n) {
+            size_t i = size (), m = corners () + n;
+
+            for (auto* p : { &type, &color, &subobj_index })
+                p->push_back ({ });
+
+            center.push_back ({ });
+            normal.push_back ({ });
+            radius.push_back ({ });
+
+            offsets.push_back (int (m));
+
+            for (auto* p : { &vertices, &normals })
+                p->resize (m, { });
+
+            u.resize (m, { });
+            v.resize (m, { });
+
+            return i;
+        }
+
+        //
+        // Resizes the store to n polygons and m corners, the caller fills in
+        // the attributes and the offsets of the new polygons:
+        //
+        void resize (size_t n, size_t m) {
+            for (auto* p : { &type, &color, &subobj_index })
+                p->resize (n);
+
+            center.resize (n);
+            normal.resize (n);
+            radius.resize (n);
+
+            offsets.resize (n + 1);
+
+            for (auto* p : { &vertices, &normals })
+                p->resize (m);
+
+            u.resize (m);
+            v.resize (m);
+        }
+    };
+
+    polys_t polys;
 
     struct texture_t {
-        string name;
-        size_t x, y, x2, y2;
-        int detail;
+        using allocator_type = pof_t::allocator_type;
+
+        pmr::string name;
+        size_t x{ }, y{ }, x2{ }, y2{ };
+        int detail{ };
+
+        texture_t (const allocator_type& a = { })
+            : name (a)
+            { }
+
+        texture_t (const texture_t& other, const allocator_type& a = { })
+            : texture_t (a)
+            { *this = other; }
+
+        texture_t (texture_t&&) = default;
+
+        texture_t (texture_t&& other, const allocator_type& a)
+            : texture_t (a)
+            { *this = move (other); }
+
+        texture_t& operator= (const texture_t&) = default;
+        texture_t& operator= (texture_t&&) = default;
     };
 
-    vector< texture_t > textures;
+    pmr::vector< texture_t > textures;
 
     struct shield_t {
-        vector< vertex3f_t > vertices;
+        using allocator_type = pof_t::allocator_type;
+
+        pmr::vector< vertex3f_t > vertices;
 
         struct face_t {
             vector3f_t normal;
             int vertices [3];
             int neighbors [3];
         };
-        vector< face_t > faces;
+        pmr::vector< face_t > faces;
+
+        shield_t (const allocator_type& a = { })
+            : vertices (a), faces (a)
+            { }
+
+        shield_t (const shield_t& other, const allocator_type& a = { })
+            : shield_t (a)
+            { *this = other; }
+
+        shield_t (shield_t&&) = default;
+
+        shield_t (shield_t&& other, const allocator_type& a)
+            : shield_t (a)
+            { *this = move (other); }
+
+        shield_t& operator= (const shield_t&) = default;
+        shield_t& operator= (shield_t&&) = default;
     };
 
     shield_t shield;
 
     struct thruster_t {
-        string properties;
+        using allocator_type = pof_t::allocator_type;
+
+        pmr::string properties;
 
         struct glow_t {
             vector3f_t pos, normal;
             float radius;
         };
 
-        vector< glow_t > glows;
+        pmr::vector< glow_t > glows;
+
+        thruster_t (const allocator_type& a = { })
+            : properties (a), glows (a)
+            { }
+
+        thruster_t (const thruster_t& other, const allocator_type& a = { })
+            : thruster_t (a)
+            { *this = other; }
+
+        thruster_t (thruster_t&&) = default;
+
+        thruster_t (thruster_t&& other, const allocator_type& a)
+            : thruster_t (a)
+            { *this = move (other); }
+
+        thruster_t& operator= (const thruster_t&) = default;
+        thruster_t& operator= (thruster_t&&) = default;
     };
 
-    vector< thruster_t > thrusters;
+    pmr::vector< thruster_t > thrusters;
 
     struct dock_t {
-        string properties;
-        vector< int > splines;
-        vector< vector3f_t > pos, normal;
+        using allocator_type = pof_t::allocator_type;
+
+        pmr::string properties;
+        pmr::vector< int > splines;
+        pmr::vector< vector3f_t > pos, normal;
+
+        dock_t (const allocator_type& a = { })
+            : properties (a), splines (a), pos (a), normal (a)
+            { }
+
+        dock_t (const dock_t& other, const allocator_type& a = { })
+            : dock_t (a)
+            { *this = other; }
+
+        dock_t (dock_t&&) = default;
+
+        dock_t (dock_t&& other, const allocator_type& a)
+            : dock_t (a)
+            { *this = move (other); }
+
+        dock_t& operator= (const dock_t&) = default;
+        dock_t& operator= (dock_t&&) = default;
     };
 
-    vector< dock_t > docks;
+    pmr::vector< dock_t > docks;
 
     struct subsys_t {
-        string name, properties;
-        vertex3f_t pos;
-        float radius;
+        using allocator_type = pof_t::allocator_type;
+
+        pmr::string name, properties;
+        vertex3f_t pos{ };
+        float radius{ };
+
+        subsys_t (const allocator_type& a = { })
+            : name (a), properties (a)
+            { }
+
+        subsys_t (const subsys_t& other, const allocator_type& a = { })
+            : subsys_t (a)
+            { *this = other; }
+
+        subsys_t (subsys_t&&) = default;
+
+        subsys_t (subsys_t&& other, const allocator_type& a)
+            : subsys_t (a)
+            { *this = move (other); }
+
+        subsys_t& operator= (const subsys_t&) = default;
+        subsys_t& operator= (subsys_t&&) = default;
     };
 
-    vector< subsys_t > subsys;
+    pmr::vector< subsys_t > subsys;
 
     struct weapon_t {
         vector3f_t pos, normal;
         int subobj, type, bank;
     };
 
-    vector< weapon_t > weapons;
+    pmr::vector< weapon_t > weapons;
 
     struct gun_t {
         vector3f_t pos, normal;
     };
 
-    vector< vector< gun_t > > guns [2];
+    using gun_slots_t = pmr::vector< pmr::vector< gun_t > >;
+    gun_slots_t guns [2];
 
     struct turret_bank_t {
-        int barrel_subobj, mount_subobj;
-        vector< vector3f_t > pos; // firing positions
-        vector3f_t normal;
+        using allocator_type = pof_t::allocator_type;
+
+        int barrel_subobj{ }, mount_subobj{ };
+        pmr::vector< vector3f_t > pos; // firing positions
+        vector3f_t normal{ };
+
+        turret_bank_t (const allocator_type& a = { })
+            : pos (a)
+            { }
+
+        turret_bank_t (const turret_bank_t& other,
+                       const allocator_type& a = { })
+            : turret_bank_t (a)
+            { *this = other; }
+
+        turret_bank_t (turret_bank_t&&) = default;
+
+        turret_bank_t (turret_bank_t&& other, const allocator_type& a)
+            : turret_bank_t (a)
+            { *this = move (other); }
+
+        turret_bank_t& operator= (const turret_bank_t&) = default;
+        turret_bank_t& operator= (turret_bank_t&&) = default;
     };
 
-    vector< turret_bank_t > turret_banks [2];
+    using turret_banks_t = pmr::vector< turret_bank_t >;
+    turret_banks_t turret_banks [2];
+
+    pof_t (const allocator_type& a = { })
+        : boxes (a), cross_sections (a), lights (a), eyes (a),
+          subobjs (a), detail_subobj (a), debris_subobj (a),
+          vertices (a), normals (a), subobj_indices (a), polys (a),
+          textures (a), shield (a), thrusters (a), docks (a), subsys (a),
+          weapons (a), guns { gun_slots_t (a), gun_slots_t (a) },
+          turret_banks { turret_banks_t (a), turret_banks_t (a) }
+        { }
+
+    pof_t (const pof_t&) = default;
+    pof_t (pof_t&&) = default;
+
+    pof_t& operator= (const pof_t&) = default;
+    pof_t& operator= (pof_t&&) = default;
+
+    allocator_type get_allocator () const {
+        return boxes.get_allocator ();
+    }
 };
 
+//
+// Per-file decoder state. The decoder keeps no other state, a context lives
+// for the duration of a single decode, and any number of files can be decoded
+// concurrently:
+//
+struct thread_pool_t;
+
+struct pof_context_t {
+    size_t file_size;
+    int file_version;
+
+    //
+    // If set, the subobjects' BSP data is decoded in parallel on this pool:
+    //
+    thread_pool_t* pool;
+
+    //
+    // What the BSP data of a subobject decodes into:
+    //
+    struct count_t {
+        size_t vertices, normals, polys, corners;
+    };
+
+    //
+    // Subobject BSP data, staged as the chunks are read and decoded once all
+    // are; the stream decoder owns copies of the data:
+    //
+    struct bsp_t {
+        const char* data;
+        size_t size;
+
+        int subobj;
+        count_t count;
+    };
+
+    vector< bsp_t > bsps;
+    vector< vector< char > > buffers;
+};
+
+//
+// Decode a POF model from a (seekable) stream, from an in-memory image, or
+// from a file, through a memory mapping; errors are reported by exceptions:
+//
+istream& read (istream&, pof_t&);
+void read (const char*, size_t, pof_t&);
+
+void load (const char*, pof_t&);
+
+//
+// Same, decoding the subobjects' BSP data in parallel on a pool; the result is
+// identical to that of a serial decode:
+//
+void read (const char*, size_t, pof_t&, thread_pool_t&);
+void load (const char*, pof_t&, thread_pool_t&);
+
+//
+// Chunk-level decoding of an in-memory image, for callers that pick or frame
+// the chunks themselves. read_chunks reads the file header into the context
+// and returns the table of the chunks in the image; read_chunk decodes the
+// body of one chunk, staging the subobjects' BSP data in the context, where
+// it must remain valid until read_geometry decodes it. postprocess completes
+// the subobjects once their chunks and HDR2 are decoded:
+//
+struct pof_chunk_t {
+    int id;
+    size_t offset, size;
+};
+
+vector< pof_chunk_t > read_chunks (pof_context_t&, const char*, size_t);
+void read_chunk (pof_context_t&, int, const char*, size_t, pof_t&);
+
+void read_geometry (pof_context_t&, pof_t&);
+void postprocess (pof_t&);
+
 #endif // POF_POF_HH
@@ -0,0 +1,117 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+using namespace std;
+
+#include "pool.hh"
+
+//
+// Index of the worker in the pool that runs on the current thread, if any:
+//
+static thread_local const thread_pool_t* self_pool = 0;
+static thread_local size_t self_index = 0;
+
+thread_pool_t::thread_pool_t (size_t n) {
+    n = max (n, size_t (1));
+
+    for (size_t i = 0; i < n; ++i)
+        queues.emplace_back (make_unique< queue_t > ());
+
+    for (size_t i = 0; i < n; ++i)
+        threads.emplace_back ([this, i] { run (i); });
+}
+
+thread_pool_t::~thread_pool_t () {
+    {
+        lock_guard< mutex > lock (m);
+        done = true;
+    }
+
+    cv.notify_all ();
+
+    for (auto& t : threads)
+        t.join ();
+}
+
+void
+thread_pool_t::submit (function< void () > f) {
+    size_t i = self_pool == this
+        ? self_index : next.fetch_add (1) % queues.size ();
+
+    ++queued;
+
+    {
+        lock_guard< mutex > lock (queues [i]->m);
+        queues [i]->tasks.push_back (move (f));
+    }
+
+    //
+    // Taking the lock orders the wake-up after a worker's predicate check:
+    //
+    { lock_guard< mutex > lock (m); }
+    cv.notify_one ();
+}
+
+bool
+thread_pool_t::pop (size_t i, function< void () >& f) {
+    auto& q = *queues [i];
+    lock_guard< mutex > lock (q.m);
+
+    if (q.tasks.empty ())
+        return false;
+
+    f = move (q.tasks.back ());
+    q.tasks.pop_back ();
+
+    return --queued, true;
+}
+
+bool
+thread_pool_t::steal (size_t i, function< void () >& f) {
+    for (size_t j = 1; j < queues.size (); ++j) {
+        auto& q = *queues [(i + j) % queues.size ()];
+        lock_guard< mutex > lock (q.m);
+
+        if (!q.tasks.empty ()) {
+            f = move (q.tasks.front ());
+            q.tasks.pop_front ();
+
+            return --queued, true;
+        }
+    }
+
+    return false;
+}
+
+bool
+thread_pool_t::run_one () {
+    size_t i = self_pool == this ? self_index : 0;
+
+    function< void () > f;
+
+    if (pop (i, f) || steal (i, f))
+        return f (), true;
+
+    return false;
+}
+
+void
+thread_pool_t::run (size_t i) {
+    self_pool = this;
+    self_index = i;
+
+    for (;;) {
+        function< void () > f;
+
+        if (pop (i, f) || steal (i, f)) {
+            f ();
+            continue;
+        }
+
+        unique_lock< mutex > lock (m);
+        cv.wait (lock, [this] { return done || queued; });
+
+        if (done && 0 == queued)
+            break;
+    }
+}
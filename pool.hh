@@ -0,0 +1,99 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_POOL_HH
+#define POF_POOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Work-stealing thread pool. Each worker owns a deque; it pops its own tasks
+// from the back and, when idle, steals from the front of the other deques.
+// Tasks submitted from a worker go to that worker's deque, other tasks are
+// spread round-robin:
+//
+struct thread_pool_t {
+    explicit thread_pool_t (size_t = thread::hardware_concurrency ());
+    ~thread_pool_t ();
+
+    thread_pool_t (const thread_pool_t&) = delete;
+    thread_pool_t& operator= (const thread_pool_t&) = delete;
+
+    size_t size () const { return threads.size (); }
+
+    void submit (function< void () >);
+
+    //
+    // Runs one pending task, if any, on the calling thread:
+    //
+    bool run_one ();
+
+    //
+    // Runs f (0) ... f (n - 1) on the pool and returns when all are done. The
+    // calling thread executes pending tasks while it waits, so the call may be
+    // nested in a task. The first exception thrown by f is rethrown:
+    //
+    template< typename F >
+    void parallel_for (size_t n, F f);
+
+private:
+    struct queue_t {
+        mutex m;
+        deque< function< void () > > tasks;
+    };
+
+    bool pop (size_t, function< void () >&);
+    bool steal (size_t, function< void () >&);
+
+    void run (size_t);
+
+private:
+    vector< unique_ptr< queue_t > > queues;
+    vector< thread > threads;
+
+    mutex m;
+    condition_variable cv;
+
+    atomic< size_t > queued{ }, next{ };
+    bool done = false;
+};
+
+template< typename F >
+inline void
+thread_pool_t::parallel_for (size_t n, F f) {
+    atomic< size_t > remaining{ n };
+
+    mutex err_mutex;
+    exception_ptr err;
+
+    for (size_t i = 0; i < n; ++i) {
+        submit ([&, i] {
+            try {
+                f (i);
+            }
+            catch (...) {
+                lock_guard< mutex > lock (err_mutex);
+                if (!err) err = current_exception ();
+            }
+
+            --remaining;
+        });
+    }
+
+    while (remaining) {
+        if (!run_one ())
+            this_thread::yield ();
+    }
+
+    if (err)
+        rethrow_exception (err);
+}
+
+#endif // POF_POOL_HH
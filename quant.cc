@@ -0,0 +1,270 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "quant.hh"
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+uint16_t
+to_half (float f) {
+    uint32_t x;
+    memcpy (&x, &f, sizeof x);
+
+    const uint16_t sign = uint16_t ((x >> 16) & 0x8000);
+    x &= 0x7fffffff;
+
+    //
+    // Infinities and NaNs, then what rounds past the largest half, 65504:
+    //
+    if (0x7f800000 <= x)
+        return sign | 0x7c00 | (0x7f800000 < x ? 0x200 : 0);
+
+    if (0x477ff000 <= x)
+        return sign | 0x7c00;
+
+    //
+    // Below the smallest normal half, 2^-14, in units of 2^-24:
+    //
+    if (0x38800000 > x) {
+        float a;
+        memcpy (&a, &x, sizeof a);
+
+        return sign | uint16_t (lrintf (a * 16777216.f));
+    }
+
+    //
+    // Rebias the exponent and round the mantissa to 10 bits, to even:
+    //
+    return sign | uint16_t ((x + 0xc8000fff + ((x >> 13) & 1)) >> 13);
+}
+
+namespace {
+
+inline float
+sign_of (float x) {
+    return 0 > x ? -1.f : 1.f;
+}
+
+inline uint32_t
+pack_octahedral (int x, int y, size_t bits) {
+    return 32 == bits
+        ? uint32_t (uint16_t (x)) | uint32_t (uint16_t (y)) << 16
+        : uint32_t (uint8_t (x)) | uint32_t (uint8_t (y)) << 8;
+}
+
+//
+// Octahedral code of a unit vector: of the four codes around the projection
+// of the vector on the octahedron, the one that decodes closest to it. A zero
+// vector has no projection and takes the code of +z:
+//
+uint32_t
+encode_octahedral (const vector3f_t& n, size_t bits) {
+    const float l1 = fabs (n.value [0]) + fabs (n.value [1]) +
+        fabs (n.value [2]);
+
+    if (0 == l1)
+        return pack_octahedral (0, 0, bits);
+
+    float x = n.value [0] / l1, y = n.value [1] / l1;
+
+    if (0 > n.value [2]) {
+        const float a = (1 - fabs (y)) * sign_of (x);
+        const float b = (1 - fabs (x)) * sign_of (y);
+
+        x = a, y = b;
+    }
+
+    const float scale = 32 == bits ? 32767.f : 127.f;
+
+    uint32_t best = 0;
+    float closest = -2;
+
+    for (float fx : { floor (x * scale), ceil (x * scale) }) {
+        for (float fy : { floor (y * scale), ceil (y * scale) }) {
+            const uint32_t code = pack_octahedral (
+                int (clamp (fx, -scale, scale)),
+                int (clamp (fy, -scale, scale)), bits);
+
+            const float d = dot (decode_octahedral (code, bits), n);
+
+            if (d > closest)
+                best = code, closest = d;
+        }
+    }
+
+    return best;
+}
+
+} // anonymous namespace
+
+void
+quantize (const pof_t& pof, quantized_geometry_t& q, size_t normal_bits) {
+    ensure (16 == normal_bits || 32 == normal_bits,
+            "quantize: normals are 16 or 32 bits");
+
+    const size_t nsubobjs = pof.subobjs.size ();
+    const size_t nvertices = pof.vertices.size ();
+
+    ensure (nsubobjs <= 0xffff, "quantize: too many subobjects");
+
+    //
+    // Bounds of the vertices of each subobject:
+    //
+    const float inf = HUGE_VALF;
+
+    vector< vector3f_t > lo (nsubobjs, { { inf, inf, inf } });
+    vector< vector3f_t > hi (nsubobjs, { { -inf, -inf, -inf } });
+
+    for (size_t i = 0; i < nvertices; ++i) {
+        const int subobj = pof.subobj_indices [i];
+
+        ensure (0 <= subobj && size_t (subobj) < nsubobjs,
+                "quantize: vertex subobject out of range");
+
+        for (size_t k = 0; k < 3; ++k) {
+            const float x = pof.vertices [i].value [k];
+
+            lo [subobj].value [k] = min (lo [subobj].value [k], x);
+            hi [subobj].value [k] = max (hi [subobj].value [k], x);
+        }
+    }
+
+    q.ranges.assign (nsubobjs, { });
+
+    for (size_t i = 0; i < nsubobjs; ++i) {
+        if (hi [i].value [0] < lo [i].value [0])
+            continue;
+
+        for (size_t k = 0; k < 3; ++k)
+            q.ranges [i].scale.value [k] =
+                (hi [i].value [k] - lo [i].value [k]) / 65535;
+
+        q.ranges [i].lo = lo [i];
+    }
+
+    q.error = { };
+
+    q.vertices.resize (nvertices);
+
+    for (size_t i = 0; i < nvertices; ++i) {
+        const int subobj = pof.subobj_indices [i];
+        const auto& r = q.ranges [subobj];
+
+        uint16_t c [3];
+
+        for (size_t k = 0; k < 3; ++k) {
+            const float s = r.scale.value [k];
+            const float x = pof.vertices [i].value [k] - r.lo.value [k];
+
+            c [k] = 0 < s ? uint16_t (clamp (lrintf (x / s), 0L, 65535L)) : 0;
+        }
+
+        q.vertices [i] = { c [0], c [1], c [2], uint16_t (subobj) };
+
+        const vector3f_t d = q.vertex (i) - pof.vertices [i];
+        q.error.position = max (q.error.position, sqrt (dot (d, d)));
+    }
+
+    //
+    // Distinct codes of the normals the corners refer to, in the order the
+    // corners first do:
+    //
+    const auto& polys = pof.polys;
+
+    q.normal_bits = normal_bits;
+    const size_t stride = normal_bits / 8;
+
+    q.normals.clear ();
+
+    unordered_map< uint32_t, uint32_t > ids;
+    vector< uint32_t > indices (polys.corners ());
+
+    for (size_t i = 0; i < polys.corners (); ++i) {
+        const int j = polys.normals [i];
+
+        ensure (0 <= j && size_t (j) < pof.normals.size (),
+                "quantize: polygon normal out of range");
+
+        const uint32_t code = encode_octahedral (
+            normalize (pof.normals [j]), normal_bits);
+
+        auto iter = ids.try_emplace (code, uint32_t (q.distinct_normals ()));
+
+        if (iter.second) {
+            q.normals.resize (q.normals.size () + stride);
+            char* p = q.normals.data () + q.normals.size () - stride;
+
+            if (16 == normal_bits) {
+                const uint16_t x = uint16_t (code);
+                memcpy (p, &x, sizeof x);
+            }
+            else
+                memcpy (p, &code, sizeof code);
+        }
+
+        indices [i] = iter.first->second;
+    }
+
+    q.index_size = q.distinct_normals () <= 65536 ? 2 : 4;
+    q.corner_normals.resize (indices.size () * q.index_size);
+
+    float cosine = 1;
+
+    for (size_t i = 0; i < indices.size (); ++i) {
+        char* p = q.corner_normals.data () + i * q.index_size;
+
+        if (2 == q.index_size) {
+            const uint16_t x = uint16_t (indices [i]);
+            memcpy (p, &x, sizeof x);
+        }
+        else
+            memcpy (p, &indices [i], sizeof indices [i]);
+
+        const vector3f_t n = normalize (pof.normals [polys.normals [i]]);
+
+        if (0 < dot (n, n))
+            cosine = min (cosine, dot (q.normal (i), n));
+    }
+
+    q.error.normal = float (acos (min (max (cosine, -1.f), 1.f)) * 180 / M_PI);
+
+    q.uvs.resize (2 * polys.corners ());
+
+    for (size_t i = 0; i < polys.corners (); ++i) {
+        q.uvs [2 * i] = to_half (polys.u [i]);
+        q.uvs [2 * i + 1] = to_half (polys.v [i]);
+
+        q.error.uv = max (q.error.uv, max (fabs (q.u (i) - polys.u [i]),
+                                           fabs (q.v (i) - polys.v [i])));
+    }
+}
+
+size_t
+quantized_geometry_t::bytes () const {
+    return ranges.size () * sizeof (range_t) +
+        vertices.size () * sizeof (packed_vertex_t) +
+        normals.size () +
+        corner_normals.size () +
+        uvs.size () * sizeof (uint16_t);
+}
+
+size_t
+quantized_geometry_t::bytes (const pof_t& pof) {
+    return pof.vertices.size () * sizeof (vector3f_t) +
+        pof.subobj_indices.size () * sizeof (int) +
+        pof.normals.size () * sizeof (vector3f_t) +
+        pof.polys.normals.size () * sizeof (int) +
+        (pof.polys.u.size () + pof.polys.v.size ()) * sizeof (float);
+}
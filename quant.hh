@@ -0,0 +1,188 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_QUANT_HH
+#define POF_QUANT_HH
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "pof.hh"
+#include "vector.hh"
+
+//
+// Half float of a float, rounded to nearest even, and back:
+//
+uint16_t to_half (float);
+
+inline float
+from_half (uint16_t h) {
+    const uint32_t sign = uint32_t (h & 0x8000) << 16;
+    const uint32_t e = (h >> 10) & 0x1f, m = h & 0x3ff;
+
+    if (0 == e) {
+        const float x = float (m) * (1.f / 16777216.f);
+        return sign ? -x : x;
+    }
+
+    const uint32_t x = sign | (31 == e
+        ? 0x7f800000 | m << 13
+        : (e + 112) << 23 | m << 13);
+
+    float f;
+    return memcpy (&f, &x, sizeof f), f;
+}
+
+//
+// Unit vector of an octahedral code, two signed components of bits / 2 bits
+// each, the first in the low half:
+//
+inline vector3f_t
+decode_octahedral (uint32_t code, size_t bits) {
+    float x, y;
+
+    if (32 == bits) {
+        x = float (int16_t (code & 0xffff)) * (1.f / 32767);
+        y = float (int16_t (code >> 16)) * (1.f / 32767);
+    }
+    else {
+        x = float (int8_t (code & 0xff)) * (1.f / 127);
+        y = float (int8_t (code >> 8)) * (1.f / 127);
+    }
+
+    const float z = 1 - fabs (x) - fabs (y);
+
+    if (0 > z) {
+        const float a = (1 - fabs (y)) * (0 > x ? -1 : 1);
+        const float b = (1 - fabs (x)) * (0 > y ? -1 : 1);
+
+        x = a, y = b;
+    }
+
+    return normalize (vector3f_t{ { x, y, z } });
+}
+
+//
+// Compact copy of the geometry of a model, decoded on access:
+//
+// Positions are 16-bit fixed point over the bounds of the vertices of their
+// subobject, which are those its minbox and maxbox should be but are not
+// always, with the subobject of the vertex in the fourth word.
+//
+// Normals are deduplicated and octahedral-encoded in 16 or 32 bits, packed
+// normal_bits / 8 bytes apart; a zero normal encodes as +z. Each polygon
+// corner refers to its normal in the distinct ones by a 16-bit index if there
+// are no more than 65536 of them, 32-bit otherwise.
+//
+// Texture coordinates of the polygon corners are half floats, u and v
+// interleaved, zero for flat-shaded polygons.
+//
+// Vertex i of the copy is vertex i of the model, and corner j is corner j of
+// its polygon store, which the copy leaves to the model. Once quantized, the
+// model's vertices, normals and texture coordinates can be released:
+//
+struct quantized_geometry_t {
+    struct packed_vertex_t {
+        uint16_t x, y, z, subobj;
+    };
+
+    //
+    // A subobject's coordinates decode to lo + q * scale:
+    //
+    struct range_t {
+        vector3f_t lo, scale;
+    };
+
+    vector< range_t > ranges;
+    vector< packed_vertex_t > vertices;
+
+    size_t normal_bits = 32;
+    vector< char > normals;
+
+    size_t index_size = 2;
+    vector< char > corner_normals;
+
+    vector< uint16_t > uvs;
+
+    //
+    // Largest errors of the decoded geometry, measured against the model as
+    // it was quantized: of a position, in model units, of a normal, as an
+    // angle in degrees, and of a texture coordinate:
+    //
+    struct error_t {
+        float position, normal, uv;
+    } error{ };
+
+    vector3f_t vertex (size_t i) const {
+        const auto& x = vertices [i];
+        const auto& r = ranges [x.subobj];
+
+        return { {
+            r.lo.value [0] + float (x.x) * r.scale.value [0],
+            r.lo.value [1] + float (x.y) * r.scale.value [1],
+            r.lo.value [2] + float (x.z) * r.scale.value [2]
+        } };
+    }
+
+    int subobj_index (size_t i) const { return vertices [i].subobj; }
+
+    size_t corners () const { return corner_normals.size () / index_size; }
+
+    size_t distinct_normals () const {
+        return normals.size () / (normal_bits / 8);
+    }
+
+    //
+    // Code of a distinct normal:
+    //
+    uint32_t normal_code (size_t i) const {
+        const char* p = normals.data () + i * (normal_bits / 8);
+
+        if (16 == normal_bits) {
+            uint16_t x;
+            return memcpy (&x, p, sizeof x), x;
+        }
+
+        uint32_t x;
+        return memcpy (&x, p, sizeof x), x;
+    }
+
+    //
+    // Normal and texture coordinates of a corner:
+    //
+    size_t normal_index (size_t i) const {
+        const char* p = corner_normals.data () + i * index_size;
+
+        if (2 == index_size) {
+            uint16_t x;
+            return memcpy (&x, p, sizeof x), x;
+        }
+
+        uint32_t x;
+        return memcpy (&x, p, sizeof x), x;
+    }
+
+    vector3f_t normal (size_t i) const {
+        return decode_octahedral (normal_code (normal_index (i)), normal_bits);
+    }
+
+    float u (size_t i) const { return from_half (uvs [2 * i]); }
+    float v (size_t i) const { return from_half (uvs [2 * i + 1]); }
+
+    //
+    // Bytes held, and bytes the model holds for the same geometry:
+    //
+    size_t bytes () const;
+    static size_t bytes (const pof_t&);
+};
+
+//
+// Quantizes the geometry of a decoded model, with normals of 16 or 32 bits,
+// and measures the errors; throws out_of_range if a vertex has no subobject
+// or a polygon refers to a normal the model does not have:
+//
+void quantize (const pof_t&, quantized_geometry_t&, size_t = 32);
+
+#endif // POF_QUANT_HH
@@ -0,0 +1,442 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+#if defined (__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#include "pool.hh"
+#include "raster.hh"
+#include "vector.hh"
+
+#define TILE_SIZE  64
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+//
+// A triangle set up for rasterization: its edge functions, scaled by the
+// inverse of its area so that at a pixel they are its barycentric weights,
+// the planes of depth and intensity, and its bounds in pixels:
+//
+struct triangle_t {
+    float a [3], b [3], c [3];
+
+    float za, zb, zc;
+    float ia, ib, ic;
+
+    float rgb [3];
+    int x0, y0, x1, y1;
+};
+
+//
+// Color and depth of the image, padded to a whole number of tiles:
+//
+struct target_t {
+    size_t stride, rows;
+
+    vector< float > depth;
+    vector< uint32_t > color;
+};
+
+} // anonymous namespace
+
+static bool
+setup (const vector3f_t (&v) [3], const float (&i) [3], uint32_t color,
+       size_t width, size_t height, triangle_t& t) {
+    const float area =
+        (v [1].value [0] - v [0].value [0]) *
+        (v [2].value [1] - v [0].value [1]) -
+        (v [1].value [1] - v [0].value [1]) *
+        (v [2].value [0] - v [0].value [0]);
+
+    if (fabsf (area) < 1e-8f)
+        return false;
+
+    const float r = 1.f / area;
+
+    for (size_t k = 0; k < 3; ++k) {
+        //
+        // Edge opposite to vertex k:
+        //
+        const auto& p = v [(k + 1) % 3];
+        const auto& q = v [(k + 2) % 3];
+
+        t.a [k] = (p.value [1] - q.value [1]) * r;
+        t.b [k] = (q.value [0] - p.value [0]) * r;
+        t.c [k] = (p.value [0] * q.value [1] - p.value [1] * q.value [0]) * r;
+    }
+
+    t.za = t.a [0] * v [0].value [2] + t.a [1] * v [1].value [2] +
+        t.a [2] * v [2].value [2];
+    t.zb = t.b [0] * v [0].value [2] + t.b [1] * v [1].value [2] +
+        t.b [2] * v [2].value [2];
+    t.zc = t.c [0] * v [0].value [2] + t.c [1] * v [1].value [2] +
+        t.c [2] * v [2].value [2];
+
+    t.ia = t.a [0] * i [0] + t.a [1] * i [1] + t.a [2] * i [2];
+    t.ib = t.b [0] * i [0] + t.b [1] * i [1] + t.b [2] * i [2];
+    t.ic = t.c [0] * i [0] + t.c [1] * i [1] + t.c [2] * i [2];
+
+    t.rgb [0] = float (color & 0xff);
+    t.rgb [1] = float ((color >> 8) & 0xff);
+    t.rgb [2] = float ((color >> 16) & 0xff);
+
+    auto lo = [&](size_t k) {
+        return min ({ v [0].value [k], v [1].value [k], v [2].value [k] });
+    };
+
+    auto hi = [&](size_t k) {
+        return max ({ v [0].value [k], v [1].value [k], v [2].value [k] });
+    };
+
+    t.x0 = max (0, int (floorf (lo (0))));
+    t.y0 = max (0, int (floorf (lo (1))));
+    t.x1 = min (int (width), int (ceilf (hi (0))) + 1);
+    t.y1 = min (int (height), int (ceilf (hi (1))) + 1);
+
+    return t.x0 < t.x1 && t.y0 < t.y1;
+}
+
+//
+// Rasterizes the binned triangles over a tile, which owns its pixels in the
+// target; spans start at a multiple of four pixels, as tiles do:
+//
+static void
+raster_tile (const vector< triangle_t >& tris, const vector< uint32_t >& bin,
+             int tx0, int ty0, target_t& target) {
+    const int tx1 = tx0 + TILE_SIZE, ty1 = ty0 + TILE_SIZE;
+
+    for (auto index : bin) {
+        const auto& t = tris [index];
+
+        const int x0 = max (t.x0, tx0) & ~3, x1 = min (t.x1, tx1);
+        const int y0 = max (t.y0, ty0), y1 = min (t.y1, ty1);
+
+        for (int y = y0; y < y1; ++y) {
+            const float py = y + .5f;
+
+            const float r0 = t.b [0] * py + t.c [0];
+            const float r1 = t.b [1] * py + t.c [1];
+            const float r2 = t.b [2] * py + t.c [2];
+
+            const float rz = t.zb * py + t.zc, ri = t.ib * py + t.ic;
+
+            float* depth = target.depth.data () + y * target.stride;
+            uint32_t* color = target.color.data () + y * target.stride;
+
+#if defined (__SSE2__)
+            const __m128 zero = _mm_setzero_ps ();
+            const __m128 top = _mm_set1_ps (255.f);
+
+            const __m128 a0 = _mm_set1_ps (t.a [0]), a1 = _mm_set1_ps (t.a [1]);
+            const __m128 a2 = _mm_set1_ps (t.a [2]);
+            const __m128 za = _mm_set1_ps (t.za), ia = _mm_set1_ps (t.ia);
+
+            for (int x = x0; x < x1; x += 4) {
+                const __m128 px = _mm_add_ps (
+                    _mm_set1_ps (x + .5f), _mm_setr_ps (0, 1, 2, 3));
+
+                const __m128 w0 = _mm_add_ps (
+                    _mm_mul_ps (a0, px), _mm_set1_ps (r0));
+                const __m128 w1 = _mm_add_ps (
+                    _mm_mul_ps (a1, px), _mm_set1_ps (r1));
+                const __m128 w2 = _mm_add_ps (
+                    _mm_mul_ps (a2, px), _mm_set1_ps (r2));
+
+                __m128 mask = _mm_and_ps (
+                    _mm_and_ps (_mm_cmpge_ps (w0, zero),
+                                _mm_cmpge_ps (w1, zero)),
+                    _mm_cmpge_ps (w2, zero));
+
+                const __m128 z = _mm_add_ps (
+                    _mm_mul_ps (za, px), _mm_set1_ps (rz));
+                const __m128 d = _mm_loadu_ps (depth + x);
+
+                mask = _mm_and_ps (mask, _mm_cmplt_ps (z, d));
+
+                if (0 == _mm_movemask_ps (mask))
+                    continue;
+
+                _mm_storeu_ps (depth + x, _mm_or_ps (
+                    _mm_and_ps (mask, z), _mm_andnot_ps (mask, d)));
+
+                const __m128 i = _mm_max_ps (zero, _mm_min_ps (
+                    _mm_set1_ps (1.f), _mm_add_ps (
+                        _mm_mul_ps (ia, px), _mm_set1_ps (ri))));
+
+                __m128i rgb = _mm_setzero_si128 ();
+
+                for (int k = 0; k < 3; ++k) {
+                    const __m128i c = _mm_cvttps_epi32 (_mm_min_ps (
+                        top, _mm_mul_ps (i, _mm_set1_ps (t.rgb [k]))));
+                    rgb = _mm_or_si128 (rgb, _mm_slli_epi32 (c, 8 * k));
+                }
+
+                const __m128i m = _mm_castps_si128 (mask);
+                __m128i* p = reinterpret_cast< __m128i* > (color + x);
+
+                _mm_storeu_si128 (p, _mm_or_si128 (
+                    _mm_and_si128 (m, rgb),
+                    _mm_andnot_si128 (m, _mm_loadu_si128 (p))));
+            }
+#else
+            for (int x = x0; x < x1; ++x) {
+                const float px = x + .5f;
+
+                if (t.a [0] * px + r0 < 0 || t.a [1] * px + r1 < 0 ||
+                    t.a [2] * px + r2 < 0)
+                    continue;
+
+                const float z = t.za * px + rz;
+
+                if (!(z < depth [x]))
+                    continue;
+
+                depth [x] = z;
+
+                const float i = max (0.f, min (1.f, t.ia * px + ri));
+                uint32_t rgb = 0;
+
+                for (int k = 0; k < 3; ++k)
+                    rgb |= uint32_t (min (255.f, i * t.rgb [k])) << (8 * k);
+
+                color [x] = rgb;
+            }
+#endif // __SSE2__
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Colors of the textured polygons, by texture:
+//
+static const uint32_t palette [] = {
+    0xb0b0b0, 0x8cb4d2, 0xa0c88c, 0xd2b48c, 0xb48cc8, 0x8cc8c8, 0xc8a0a0,
+    0xc8c88c
+};
+
+#define BACKGROUND  0x202020
+
+void
+render (const pof_t& pof, const render_options_t& options, image_t& image,
+        thread_pool_t* pool) {
+    const size_t width = options.width, height = options.height;
+    ensure (0 < width && 0 < height, "render: empty image");
+
+    //
+    // The subobjects of the detail level; vertices are decoded in the model's
+    // frame, already offset by their subobject's and its ancestors' offsets:
+    //
+    const size_t nsubobjs = pof.subobjs.size ();
+
+    vector< char > chosen (nsubobjs);
+
+    for (size_t i = 0; i < nsubobjs; ++i)
+        chosen [i] = options.detail == pof.subobjs [i].detail;
+
+    if (chosen.end () == find (chosen.begin (), chosen.end (), 1)) {
+        for (size_t i = 0; i < nsubobjs; ++i)
+            chosen [i] = 9 != pof.subobjs [i].detail;
+    }
+
+    const auto& vertices = pof.vertices;
+
+    //
+    // Bounds of the rendered vertices, which the view fits:
+    //
+    vector3f_t lo{ { 1e30f, 1e30f, 1e30f } }, hi{ { -1e30f, -1e30f, -1e30f } };
+
+    for (size_t i = 0; i < vertices.size (); ++i) {
+        if (!chosen [pof.subobj_indices [i]])
+            continue;
+
+        const auto& p = vertices [i];
+
+        for (size_t k = 0; k < 3; ++k) {
+            lo.value [k] = min (lo.value [k], p.value [k]);
+            hi.value [k] = max (hi.value [k], p.value [k]);
+        }
+    }
+
+    const vector3f_t center = (lo + hi) * .5f;
+    float radius = 0;
+
+    for (size_t i = 0; i < vertices.size (); ++i) {
+        if (chosen [pof.subobj_indices [i]]) {
+            const auto d = vertices [i] - center;
+            radius = max (radius, dot (d, d));
+        }
+    }
+
+    radius = max (sqrtf (radius), 1e-6f);
+
+    //
+    // Three-quarter view: the model turned by a yaw and a pitch, seen from
+    // +z; the model is left-handed, so x grows to the left of the image:
+    //
+    const float yaw = 2.5f, pitch = .45f;
+
+    const float cy = cosf (yaw), sy = sinf (yaw);
+    const float cp = cosf (pitch), sp = sinf (pitch);
+
+    auto rotate = [&](const vector3f_t& p) -> vector3f_t {
+        const float x = cy * p.value [0] + sy * p.value [2];
+        const float z = cy * p.value [2] - sy * p.value [0];
+
+        return { { x, cp * p.value [1] - sp * z, sp * p.value [1] + cp * z } };
+    };
+
+    const float scale = .48f * min (width, height) / radius;
+
+    vector< vector3f_t > screen (vertices.size ());
+
+    for (size_t i = 0; i < vertices.size (); ++i) {
+        const auto p = rotate (vertices [i] - center);
+
+        screen [i] = { {
+            width * .5f - scale * p.value [0],
+            height * .5f - scale * p.value [1],
+            -p.value [2]
+        } };
+    }
+
+    const vector3f_t light = normalize (vector3f_t{ { .5f, .6f, .8f } });
+
+    auto shade = [&](const vector3f_t& n) {
+        return .2f + .8f * max (0.f, dot (normalize (rotate (n)), light));
+    };
+
+    //
+    // Triangle setup:
+    //
+    vector< triangle_t > tris;
+    tris.reserve (pof.polys.corners ());
+
+    for (const auto poly : pof.polys) {
+        if (!chosen [poly.subobj_index])
+            continue;
+
+        const uint32_t color = TEXTPOLY_DEF == poly.type
+            ? palette [size_t (poly.color) % size (palette)]
+            : uint32_t (poly.color) & 0xffffff;
+
+        const float flat = shade (poly.normal);
+        const size_t n = poly.vertices.size ();
+
+        auto intensity = [&](size_t j) {
+            if (!options.gouraud)
+                return flat;
+
+            const int k = poly.normals [j];
+            ensure (0 <= k && size_t (k) < pof.normals.size (),
+                    "render: polygon normal out of range");
+
+            return shade (pof.normals [k]);
+        };
+
+        for (size_t j = 0; j < n; ++j) {
+            const int k = poly.vertices [j];
+            ensure (0 <= k && size_t (k) < vertices.size (),
+                    "render: polygon vertex out of range");
+        }
+
+        for (size_t j = 2; j < n; ++j) {
+            const vector3f_t v [3] = {
+                screen [poly.vertices [0]],
+                screen [poly.vertices [j - 1]],
+                screen [poly.vertices [j]]
+            };
+
+            const float i [3] = { intensity (0), intensity (j - 1),
+                                  intensity (j) };
+
+            triangle_t t;
+
+            if (setup (v, i, color, width, height, t))
+                tris.push_back (t);
+        }
+    }
+
+    //
+    // Binning:
+    //
+    const size_t nx = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t ny = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    vector< vector< uint32_t > > bins (nx * ny);
+
+    for (size_t k = 0; k < tris.size (); ++k) {
+        const auto& t = tris [k];
+
+        for (int y = t.y0 / TILE_SIZE; y <= (t.y1 - 1) / TILE_SIZE; ++y)
+            for (int x = t.x0 / TILE_SIZE; x <= (t.x1 - 1) / TILE_SIZE; ++x)
+                bins [y * nx + x].push_back (uint32_t (k));
+    }
+
+    target_t target;
+
+    target.stride = nx * TILE_SIZE;
+    target.rows = ny * TILE_SIZE;
+
+    target.depth.assign (target.stride * target.rows,
+                         numeric_limits< float >::infinity ());
+    target.color.assign (target.stride * target.rows, BACKGROUND);
+
+    auto raster = [&](size_t k) {
+        raster_tile (tris, bins [k], int (k % nx) * TILE_SIZE,
+                     int (k / nx) * TILE_SIZE, target);
+    };
+
+    if (pool && 1 < bins.size ())
+        pool->parallel_for (bins.size (), raster);
+    else
+        for (size_t k = 0; k < bins.size (); ++k) raster (k);
+
+    image.width = width;
+    image.height = height;
+
+    image.pixels.resize (width * height);
+
+    for (size_t y = 0; y < height; ++y) {
+        const uint32_t* p = target.color.data () + y * target.stride;
+        copy (p, p + width, image.pixels.begin () + y * width);
+    }
+}
+
+void
+write_ppm (const char* filename, const image_t& image) {
+    ofstream s (filename, ios_base::out | ios_base::binary);
+    s.exceptions (ios_base::badbit | ios_base::failbit);
+
+    s << "P6\n" << image.width << " " << image.height << "\n255\n";
+
+    vector< char > row (3 * image.width);
+
+    for (size_t y = 0; y < image.height; ++y) {
+        const uint32_t* p = image.pixels.data () + y * image.width;
+
+        for (size_t x = 0; x < image.width; ++x) {
+            row [3 * x]     = char (p [x] & 0xff);
+            row [3 * x + 1] = char ((p [x] >> 8) & 0xff);
+            row [3 * x + 2] = char ((p [x] >> 16) & 0xff);
+        }
+
+        s.write (row.data (), streamsize (row.size ()));
+    }
+}
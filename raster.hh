@@ -0,0 +1,55 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_RASTER_HH
+#define POF_RASTER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "pof.hh"
+
+struct thread_pool_t;
+
+//
+// RGB image, one 0x00bbggrr word per pixel, row by row:
+//
+struct image_t {
+    size_t width, height;
+    vector< uint32_t > pixels;
+};
+
+struct render_options_t {
+    size_t width = 256, height = 256;
+
+    //
+    // The detail level rendered; if no subobject has it, all subobjects but
+    // the debris are:
+    //
+    int detail = 0;
+
+    //
+    // Gouraud shading with the model's vertex normals, flat shading with the
+    // polygons' normals otherwise:
+    //
+    bool gouraud = false;
+};
+
+//
+// Renders a thumbnail of a model: an orthographic three-quarter view that
+// fits the rendered subobjects, depth-buffered and lit by a directional
+// light. Flat-shaded polygons have their own color, textured ones a color
+// for each texture.
+//
+// The image is cut in tiles, which are rasterized in parallel on the pool,
+// if one is given, four pixels at a time where SSE2 is available:
+//
+void render (const pof_t&, const render_options_t&, image_t&,
+             thread_pool_t* = 0);
+
+//
+// Writes the image as a binary PPM; errors are reported by exceptions:
+//
+void write_ppm (const char*, const image_t&);
+
+#endif // POF_RASTER_HH
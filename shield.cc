@@ -0,0 +1,605 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "shield.hh"
+
+#define SHIELD_CELLS_PER_FACE 2
+#define SHIELD_MAX_DIM        64
+#define SHIELD_MAX_WALK       256
+#define SHIELD_CONVEX_CHECK   (1 << 20) // most face-vertex pairs checked
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+inline vector3f_t
+position (const vertex3f_t& v) {
+    return { { v.x, v.y, v.z } };
+}
+
+//
+// The cell of a coordinate along an axis, clamped to the grid:
+//
+inline size_t
+cell_of (const shield_mesh_t& mesh, float x, size_t k) {
+    const float y = (x - mesh.box.lo.value [k]) / mesh.cell.value [k];
+    return 0 < y ? min (size_t (y), mesh.dims [k] - 1) : 0;
+}
+
+inline size_t
+cell_index (const shield_mesh_t& mesh, const size_t (&i) [3]) {
+    return i [0] + mesh.dims [0] * (i [1] + mesh.dims [1] * i [2]);
+}
+
+//
+// Moller-Trumbore, both sides of the face; the barycentric coordinates are
+// returned whether the ray's line hits inside the face or not:
+//
+inline bool
+intersect (const shield_mesh_t::face_t& face, const ray_t& ray,
+           float& t, float& u, float& v) {
+    const vector3f_t p = cross (ray.direction, face.e2);
+    const float det = dot (face.e1, p);
+
+    if (fabs (det) < 1e-20f)
+        return false;
+
+    const float inv = 1.f / det;
+    const vector3f_t s = ray.origin - face.p;
+    const vector3f_t q = cross (s, face.e1);
+
+    u = dot (s, p) * inv;
+    v = dot (ray.direction, q) * inv;
+    t = dot (face.e2, q) * inv;
+
+    return true;
+}
+
+inline void
+intersect (const shield_mesh_t& mesh, uint32_t i, const ray_t& ray,
+           shield_hit_t& hit) {
+    float t, u, v;
+
+    if (intersect (mesh.faces [i], ray, t, u, v) &&
+        0 <= u && 0 <= v && u + v <= 1 && 0 < t && t < hit.t)
+        hit = { int (i), t, u, v };
+}
+
+//
+// Walks from the hint across the edges towards the point where the ray's line
+// meets the plane of the face. On a convex shield, a front-facing face the
+// ray hits is where it enters the shield, i.e., its only hit in front of the
+// origin. Returns 1 for a hit, 0 for a miss and -1 if the walk cannot tell:
+//
+int
+walk (const shield_mesh_t& mesh, const ray_t& ray, int hint,
+      shield_hit_t& hit) {
+    int i = hint;
+
+    for (size_t step = 0; step < SHIELD_MAX_WALK && 0 <= i; ++step) {
+        const auto& face = mesh.faces [i];
+
+        float t, u, v;
+
+        if (!(dot (ray.direction, face.normal) < 0) ||
+            !intersect (face, ray, t, u, v))
+            return -1;
+
+        const float w = 1 - u - v;
+
+        if (0 <= u && 0 <= v && 0 <= w) {
+            if (!(0 < t))
+                return -1;
+
+            if (!(t < ray.t))
+                return 0;
+
+            hit = { i, t, u, v };
+            return 1;
+        }
+
+        //
+        // Across the edge opposite the corner with the lowest weight:
+        //
+        const int corner = w < u ? (w < v ? 0 : 2) : (u < v ? 1 : 2);
+        i = face.neighbors [(corner + 1) % 3];
+    }
+
+    return -1;
+}
+
+//
+// Walks the grid cells the ray crosses, in order, and tests the faces in the
+// cells within r of them, each cell once, until the nearest hit found is
+// within the cells walked. Cells are indexed past the grid by as many as r
+// spans, for a sphere whose center is off the grid:
+//
+template< typename F >
+void
+march (const shield_mesh_t& mesh, const ray_t& ray, float r,
+       shield_hit_t& hit, F test) {
+    const auto& o = ray.origin.value;
+    const auto& d = ray.direction.value;
+
+    float t0 = 0, t1 = hit.t;
+
+    for (size_t k = 0; k < 3; ++k) {
+        const float inv = 1.f / d [k];
+
+        float a = (mesh.box.lo.value [k] - r - o [k]) * inv;
+        float b = (mesh.box.hi.value [k] + r - o [k]) * inv;
+
+        if (b < a)
+            swap (a, b);
+
+        t0 = t0 < a ? a : t0;
+        t1 = b < t1 ? b : t1;
+    }
+
+    if (!(t0 <= t1))
+        return;
+
+    int i [3], ext [3], step [3];
+    float next [3], delta [3];
+
+    for (size_t k = 0; k < 3; ++k) {
+        const int n = int (mesh.dims [k]);
+        const float lo = mesh.box.lo.value [k], size = mesh.cell.value [k];
+
+        ext [k] = int (min (ceil (r / size), float (n)));
+
+        const float x = floor ((o [k] + t0 * d [k] - lo) / size);
+        i [k] = int (max (min (x, float (n - 1 + ext [k])), float (-ext [k])));
+
+        if (0 < d [k]) {
+            step [k] = 1;
+            next [k] = (lo + (i [k] + 1) * size - o [k]) / d [k];
+            delta [k] = size / d [k];
+        }
+        else if (d [k] < 0) {
+            step [k] = -1;
+            next [k] = (lo + i [k] * size - o [k]) / d [k];
+            delta [k] = -size / d [k];
+        }
+        else {
+            step [k] = 0;
+            next [k] = delta [k] = HUGE_VALF;
+        }
+    }
+
+    auto visit = [&](const int (&a) [3], const int (&b) [3]) {
+        size_t lo [3], hi [3];
+
+        for (size_t k = 0; k < 3; ++k) {
+            if (b [k] < 0 || int (mesh.dims [k]) <= a [k])
+                return;
+
+            lo [k] = size_t (max (a [k], 0));
+            hi [k] = size_t (min (b [k], int (mesh.dims [k]) - 1));
+        }
+
+        size_t j [3];
+
+        for (j [2] = lo [2]; j [2] <= hi [2]; ++j [2]) {
+            for (j [1] = lo [1]; j [1] <= hi [1]; ++j [1]) {
+                for (j [0] = lo [0]; j [0] <= hi [0]; ++j [0]) {
+                    const size_t c = cell_index (mesh, j);
+
+                    for (uint32_t x = mesh.offsets [c];
+                         x < mesh.offsets [c + 1]; ++x)
+                        test (mesh.cells [x]);
+                }
+            }
+        }
+    };
+
+    int a [3], b [3];
+
+    for (size_t k = 0; k < 3; ++k)
+        a [k] = i [k] - ext [k], b [k] = i [k] + ext [k];
+
+    visit (a, b);
+
+    for (;;) {
+        const size_t k = next [0] < next [1]
+            ? (next [0] < next [2] ? 0 : 2)
+            : (next [1] < next [2] ? 1 : 2);
+
+        if (hit.t <= next [k] || t1 < next [k])
+            break;
+
+        i [k] += step [k];
+        next [k] += delta [k];
+
+        if (i [k] < -ext [k] || int (mesh.dims [k]) - 1 + ext [k] < i [k])
+            break;
+
+        //
+        // The cells that come within r with the step:
+        //
+        for (size_t j = 0; j < 3; ++j)
+            a [j] = i [j] - ext [j], b [j] = i [j] + ext [j];
+
+        a [k] = b [k] = i [k] + step [k] * ext [k];
+        visit (a, b);
+    }
+}
+
+//
+// Barycentric coordinates of a point in the plane of the face, false for a
+// degenerate face:
+//
+inline bool
+barycentric (const shield_mesh_t::face_t& face, const vector3f_t& x,
+             float& u, float& v) {
+    const vector3f_t w = x - face.p;
+
+    const float d00 = dot (face.e1, face.e1), d01 = dot (face.e1, face.e2);
+    const float d11 = dot (face.e2, face.e2);
+    const float d20 = dot (w, face.e1), d21 = dot (w, face.e2);
+
+    const float det = d00 * d11 - d01 * d01;
+
+    if (!(0 < det))
+        return false;
+
+    u = (d11 * d20 - d01 * d21) / det;
+    v = (d00 * d21 - d01 * d20) / det;
+
+    return true;
+}
+
+//
+// First contact of the sphere swept along the ray with the face: with the
+// interior of the face, if the sphere reaches the face's plane inside it,
+// otherwise with the edges, as cylinders, or with the corners, as spheres:
+//
+void
+sweep (const shield_mesh_t& mesh, uint32_t index, const ray_t& ray, float r,
+       shield_hit_t& hit) {
+    const auto& face = mesh.faces [index];
+    const auto& o = ray.origin;
+    const auto& d = ray.direction;
+
+    float best = hit.t, u = 0, v = 0;
+    vector3f_t contact;
+
+    //
+    // The segment of the center's path up to the nearest hit so far misses
+    // the face's bounding sphere grown by r:
+    //
+    const float dd = dot (d, d);
+    const vector3f_t m = face.center - o;
+
+    const float s = 0 < dd ? max (0.f, min (dot (m, d) / dd, best)) : 0;
+    const vector3f_t y = m - d * s;
+
+    if ((face.radius + r) * (face.radius + r) < dot (y, y))
+        return;
+
+    const float dist = dot (o - face.p, face.normal);
+    const float dn = dot (d, face.normal);
+
+    float t = -1;
+
+    if (fabs (dist) <= r)
+        t = 0;
+    else if (dist * dn < 0)
+        t = ((dist < 0 ? -r : r) - dist) / dn;
+
+    //
+    // The sphere touches the plane no later than the face:
+    //
+    if (!(0 <= t && t < best))
+        return;
+
+    //
+    // The center's distance to the plane is r at the contact, unless the
+    // sphere starts out across the plane:
+    //
+    const float at = 0 == t ? dist : (dist < 0 ? -r : r);
+    const vector3f_t x = o + d * t - face.normal * at;
+
+    if (barycentric (face, x, u, v) && 0 <= u && 0 <= v && u + v <= 1) {
+        hit = { int (index), t, u, v };
+        return;
+    }
+
+    const vector3f_t corners [3] = {
+        face.p, face.p + face.e1, face.p + face.e2
+    };
+
+    const float rr = r * r;
+    bool found = false;
+
+    for (size_t k = 0; k < 3; ++k) {
+        const vector3f_t& a = corners [k];
+        const vector3f_t ab = corners [(k + 1) % 3] - a, ao = o - a;
+
+        const float abab = dot (ab, ab), aoab = dot (ao, ab);
+        const float dab = dot (d, ab);
+
+        if (!(0 < abab))
+            continue;
+
+        const float A = abab * dd - dab * dab;
+        const float B = abab * dot (ao, d) - aoab * dab;
+        const float C = abab * dot (ao, ao) - aoab * aoab - rr * abab;
+
+        float t;
+
+        if (C <= 0)
+            t = 0;
+        else if (0 < A && B < 0 && 0 <= B * B - A * C)
+            t = (-B - sqrt (B * B - A * C)) / A;
+        else
+            continue;
+
+        const float s = (aoab + t * dab) / abab;
+
+        if (0 <= s && s <= 1 && t < best)
+            best = t, contact = a + ab * s, found = true;
+    }
+
+    for (const auto& x : corners) {
+        const vector3f_t m = o - x;
+        const float b = dot (m, d), c = dot (m, m) - rr;
+
+        float t;
+
+        if (c <= 0)
+            t = 0;
+        else if (0 < dd && b < 0 && 0 <= b * b - dd * c)
+            t = (-b - sqrt (b * b - dd * c)) / dd;
+        else
+            continue;
+
+        if (t < best)
+            best = t, contact = x, found = true;
+    }
+
+    if (found && barycentric (face, contact, u, v))
+        hit = { int (index), best, u, v };
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////
+
+void
+build_shield (const pof_t& pof, shield_mesh_t& mesh) {
+    const auto& shield = pof.shield;
+
+    const size_t nvertices = shield.vertices.size ();
+    const size_t nfaces = shield.faces.size ();
+
+    vector< vector3f_t > vertices (nvertices);
+
+    for (size_t i = 0; i < nvertices; ++i)
+        vertices [i] = position (shield.vertices [i]);
+
+    mesh.faces.resize (nfaces);
+
+    for (size_t i = 0; i < nfaces; ++i) {
+        const auto& src = shield.faces [i];
+
+        for (int j : src.vertices)
+            ensure (0 <= j && size_t (j) < nvertices, "shield: face vertex");
+
+        const vector3f_t& a = vertices [src.vertices [0]];
+        auto& face = mesh.faces [i];
+
+        face.p = a;
+        face.e1 = vertices [src.vertices [1]] - a;
+        face.e2 = vertices [src.vertices [2]] - a;
+
+        //
+        // The normal of the face, oriented as the model's:
+        //
+        face.normal = normalize (cross (face.e1, face.e2));
+
+        if (0 == dot (face.normal, face.normal))
+            face.normal = normalize (src.normal);
+        else if (dot (face.normal, src.normal) < 0)
+            face.normal = face.normal * -1.f;
+
+        face.center = a + (face.e1 + face.e2) * (1.f / 3);
+        face.radius = 0;
+
+        for (const auto& x : { a, a + face.e1, a + face.e2 }) {
+            const vector3f_t y = x - face.center;
+            face.radius = max (face.radius, sqrt (dot (y, y)));
+        }
+
+        //
+        // The neighbor across each edge, the one that has both its vertices:
+        //
+        for (size_t k = 0; k < 3; ++k) {
+            const int x = src.vertices [k], y = src.vertices [(k + 1) % 3];
+            face.neighbors [k] = -1;
+
+            for (int j : src.neighbors) {
+                if (j < 0 || nfaces <= size_t (j) || size_t (j) == i)
+                    continue;
+
+                const int* other = shield.faces [j].vertices;
+
+                if (other + 3 != find (other, other + 3, x) &&
+                    other + 3 != find (other, other + 3, y))
+                    face.neighbors [k] = j;
+            }
+        }
+    }
+
+    mesh.box = bounds (span_t< const vector3f_t >{
+            vertices.data (), vertices.data () + nvertices });
+
+    mesh.offsets.assign (1, 0);
+    mesh.cells.clear ();
+
+    if (0 == nfaces) {
+        mesh.dims [0] = mesh.dims [1] = mesh.dims [2] = 0;
+        mesh.convex = false;
+
+        return;
+    }
+
+    //
+    // A shield is convex if it is closed and convex at every edge, the far
+    // vertex of each neighbor behind or on the face, within a tolerance
+    // relative to its size, and, if small enough to check, if no vertex at
+    // all is in front of a face:
+    //
+    const vector3f_t size = mesh.box.hi - mesh.box.lo;
+    const float eps = 1e-4f * sqrt (dot (size, size));
+
+    auto behind = [&](const shield_mesh_t::face_t& face, const vector3f_t& x) {
+        return dot (x - face.p, face.normal) <= eps;
+    };
+
+    mesh.convex = true;
+
+    for (size_t i = 0; mesh.convex && i < nfaces; ++i) {
+        const auto& face = mesh.faces [i];
+
+        for (int j : face.neighbors) {
+            if (j < 0) {
+                mesh.convex = false;
+                break;
+            }
+
+            for (int x : shield.faces [j].vertices)
+                mesh.convex = mesh.convex && behind (face, vertices [x]);
+        }
+    }
+
+    if (nfaces * nvertices <= SHIELD_CONVEX_CHECK) {
+        for (size_t i = 0; mesh.convex && i < nfaces; ++i) {
+            for (const auto& x : vertices) {
+                if (!behind (mesh.faces [i], x)) {
+                    mesh.convex = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    //
+    // Cubic cells, as many as about two for each face, and no more than a
+    // maximum along each axis:
+    //
+    float volume = 1;
+
+    for (size_t k = 0; k < 3; ++k)
+        volume *= max (size.value [k], eps);
+
+    const float side = cbrt (volume / (SHIELD_CELLS_PER_FACE * nfaces));
+
+    for (size_t k = 0; k < 3; ++k) {
+        const float extent = max (size.value [k], eps);
+        const float n = ceil (extent / side);
+
+        mesh.dims [k] = n < SHIELD_MAX_DIM ? max (size_t (n), size_t (1))
+            : SHIELD_MAX_DIM;
+
+        mesh.cell.value [k] = extent / mesh.dims [k];
+    }
+
+    //
+    // Two passes over the faces' bounds, counting then filling in the faces
+    // of each cell:
+    //
+    const size_t ncells = mesh.dims [0] * mesh.dims [1] * mesh.dims [2];
+    mesh.offsets.assign (ncells + 1, 0);
+
+    auto for_cells = [&](size_t i, auto f) {
+        const auto& face = mesh.faces [i];
+        const vector3f_t b = face.p + face.e1, c = face.p + face.e2;
+
+        size_t lo [3], hi [3];
+
+        for (size_t k = 0; k < 3; ++k) {
+            const float xs [3] = { face.p.value [k], b.value [k], c.value [k] };
+
+            lo [k] = cell_of (mesh, *min_element (xs, xs + 3), k);
+            hi [k] = cell_of (mesh, *max_element (xs, xs + 3), k);
+        }
+
+        size_t j [3];
+
+        for (j [2] = lo [2]; j [2] <= hi [2]; ++j [2])
+            for (j [1] = lo [1]; j [1] <= hi [1]; ++j [1])
+                for (j [0] = lo [0]; j [0] <= hi [0]; ++j [0])
+                    f (cell_index (mesh, j));
+    };
+
+    for (size_t i = 0; i < nfaces; ++i)
+        for_cells (i, [&](size_t c) { ++mesh.offsets [c + 1]; });
+
+    for (size_t c = 0; c < ncells; ++c)
+        mesh.offsets [c + 1] += mesh.offsets [c];
+
+    mesh.cells.resize (mesh.offsets [ncells]);
+    vector< uint32_t > at (mesh.offsets.begin (), mesh.offsets.end () - 1);
+
+    for (size_t i = 0; i < nfaces; ++i)
+        for_cells (i, [&](size_t c) { mesh.cells [at [c]++] = uint32_t (i); });
+}
+
+bool
+cast (const shield_mesh_t& mesh, const ray_t& ray, shield_hit_t& hit,
+      int hint) {
+    hit = { -1, ray.t, 0, 0 };
+
+    if (mesh.faces.empty ())
+        return false;
+
+    if (mesh.convex && 0 <= hint && size_t (hint) < mesh.faces.size ()) {
+        const int result = walk (mesh, ray, hint, hit);
+
+        if (0 <= result)
+            return result;
+    }
+
+    march (mesh, ray, 0, hit, [&](uint32_t i) {
+        intersect (mesh, i, ray, hit);
+    });
+
+    return 0 <= hit.face;
+}
+
+bool
+sweep (const shield_mesh_t& mesh, const ray_t& ray, float r,
+       shield_hit_t& hit, int hint) {
+    hit = { -1, ray.t, 0, 0 };
+
+    if (mesh.faces.empty ())
+        return false;
+
+    //
+    // The hint and its neighbors bound the search:
+    //
+    if (0 <= hint && size_t (hint) < mesh.faces.size ()) {
+        sweep (mesh, uint32_t (hint), ray, r, hit);
+
+        for (int i : mesh.faces [hint].neighbors)
+            if (0 <= i)
+                sweep (mesh, uint32_t (i), ray, r, hit);
+    }
+
+    march (mesh, ray, r, hit, [&](uint32_t i) {
+        sweep (mesh, i, ray, r, hit);
+    });
+
+    return 0 <= hit.face;
+}
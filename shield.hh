@@ -0,0 +1,83 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_SHIELD_HH
+#define POF_SHIELD_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hh"
+#include "pof.hh"
+#include "simd.hh"
+#include "vector.hh"
+
+//
+// Collision mesh of a model's shield: the faces, each with the edges from its
+// first vertex, its unit normal, oriented as the model's, a bounding sphere
+// and its neighbors across edges 0-1, 1-2 and 2-0, -1 if none, matched from
+// the model's face adjacency. The faces are binned in a uniform grid over the
+// shield's bounds, with about two cells for each face, each face in all cells
+// its bounds overlap.
+//
+// The shield is convex if it is closed and no face has a neighbor in front of
+// it. Ray queries on a convex shield walk the faces from a hint to the hit:
+//
+struct shield_mesh_t {
+    struct face_t {
+        vector3f_t p, e1, e2, normal;
+
+        vector3f_t center;
+        float radius;
+
+        int neighbors [3];
+    };
+
+    vector< face_t > faces;
+    bool convex = false;
+
+    aabb_t box;
+
+    size_t dims [3];
+    vector3f_t cell;
+
+    //
+    // Faces of cell (x, y, z), cell x + dims [0] * (y + dims [1] * z), are
+    // [offsets [cell], offsets [cell + 1]) in cells:
+    //
+    vector< uint32_t > offsets, cells;
+};
+
+//
+// Builds the collision mesh of a decoded model; throws out_of_range if a face
+// refers to a vertex the shield does not have:
+//
+void build_shield (const pof_t&, shield_mesh_t&);
+
+//
+// The nearest hit: the face, the distance in units of the direction and the
+// barycentric coordinates on the face of the point hit, as in hit_t:
+//
+struct shield_hit_t {
+    int face;
+    float t, u, v;
+};
+
+//
+// Casts a ray at the shield and returns whether it hits within the ray's
+// range. The hint, typically the face the previous query of the same
+// projectile or beam hit, speeds up coherent queries on convex shields; the
+// result is the nearest hit regardless:
+//
+bool cast (const shield_mesh_t&, const ray_t&, shield_hit_t&, int hint = -1);
+
+//
+// Sweeps a sphere of the given radius along the ray and returns whether it
+// touches the shield within the ray's range, the hit being the first point
+// of contact on the shield; a sphere that starts out touching the shield
+// hits at 0. The hint and its neighbors are tried first:
+//
+bool sweep (const shield_mesh_t&, const ray_t&, float, shield_hit_t&,
+            int hint = -1);
+
+#endif // POF_SHIELD_HH
@@ -0,0 +1,946 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#  define POF_SIMD_X86 1
+#  include <immintrin.h>
+#endif
+
+#include "simd.hh"
+
+namespace {
+
+struct kernels_t {
+    void (*translate) (vector3f_t*, size_t, const vector3f_t&);
+    void (*transform) (const vector3f_t*, size_t, const transform_t&,
+                       vector3f_t*);
+    void (*normalize) (vector3f_t*, size_t);
+
+    void (*dot) (const vector3f_t*, size_t, const vector3f_t*, float*);
+    void (*cross) (const vector3f_t*, size_t, const vector3f_t*,
+                   vector3f_t*);
+
+    aabb_t (*bounds) (const vector3f_t*, size_t);
+
+    void (*transform_blocks) (const vector3f_block_t*, size_t,
+                              const transform_t&, vector3f_block_t*);
+    aabb_t (*bounds_blocks) (const vector3f_block_t*, size_t);
+
+    void (*classify_blocks) (const vector3f_block_t*, size_t, const float*,
+                             const plane_t*, size_t, uint8_t*);
+};
+
+inline aabb_t
+empty_aabb () {
+    const float inf = HUGE_VALF;
+    return { { { inf, inf, inf } }, { { -inf, -inf, -inf } } };
+}
+
+inline float*
+floats (vector3f_t* p) {
+    return p->value;
+}
+
+inline const float*
+floats (const vector3f_t* p) {
+    return p->value;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+namespace scalar {
+
+void
+translate (vector3f_t* p, size_t n, const vector3f_t& d) {
+    for (size_t i = 0; i < n; ++i)
+        p [i] += d;
+}
+
+inline vector3f_t
+transform (const vector3f_t& p, const transform_t& t) {
+    const float x = p.value [0], y = p.value [1], z = p.value [2];
+    vector3f_t q;
+
+    for (size_t k = 0; k < 3; ++k)
+        q.value [k] = t.m [k][0] * x + t.m [k][1] * y + t.m [k][2] * z +
+            t.t.value [k];
+
+    return q;
+}
+
+void
+transform (const vector3f_t* p, size_t n, const transform_t& t,
+           vector3f_t* q) {
+    for (size_t i = 0; i < n; ++i)
+        q [i] = transform (p [i], t);
+}
+
+void
+normalize (vector3f_t* p, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        p [i] = ::normalize (p [i]);
+}
+
+void
+dot (const vector3f_t* a, size_t n, const vector3f_t* b, float* q) {
+    for (size_t i = 0; i < n; ++i)
+        q [i] = ::dot (a [i], b [i]);
+}
+
+void
+cross (const vector3f_t* a, size_t n, const vector3f_t* b, vector3f_t* q) {
+    for (size_t i = 0; i < n; ++i)
+        q [i] = ::cross (a [i], b [i]);
+}
+
+aabb_t
+bounds (const vector3f_t* p, size_t n) {
+    aabb_t box = empty_aabb ();
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < 3; ++k) {
+            box.lo.value [k] = min (box.lo.value [k], p [i].value [k]);
+            box.hi.value [k] = max (box.hi.value [k], p [i].value [k]);
+        }
+    }
+
+    return box;
+}
+
+void
+transform_blocks (const vector3f_block_t* p, size_t n, const transform_t& t,
+                  vector3f_block_t* q) {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < 8; ++j) {
+            const vector3f_t a{ { p [i].x [j], p [i].y [j], p [i].z [j] } };
+            const vector3f_t b = transform (a, t);
+
+            q [i].x [j] = b.value [0];
+            q [i].y [j] = b.value [1];
+            q [i].z [j] = b.value [2];
+        }
+    }
+}
+
+aabb_t
+bounds_blocks (const vector3f_block_t* p, size_t n) {
+    aabb_t box = empty_aabb ();
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < 8; ++j) {
+            const float xs [3] = { p [i].x [j], p [i].y [j], p [i].z [j] };
+
+            for (size_t k = 0; k < 3; ++k) {
+                box.lo.value [k] = min (box.lo.value [k], xs [k]);
+                box.hi.value [k] = max (box.hi.value [k], xs [k]);
+            }
+        }
+    }
+
+    return box;
+}
+
+void
+classify_blocks (const vector3f_block_t* p, size_t n, const float* r,
+                 const plane_t* planes, size_t m, uint8_t* masks) {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < 8; ++j) {
+            const float x = p [i].x [j], y = p [i].y [j], z = p [i].z [j];
+            const float radius = r [8 * i + j];
+
+            uint8_t mask = 0;
+
+            for (size_t k = 0; k < m; ++k) {
+                const auto& a = planes [k];
+                const float d = a.n.value [0] * x + a.n.value [1] * y +
+                    a.n.value [2] * z + a.d;
+
+                if (d < -radius)
+                    mask |= SPHERE_OUTSIDE;
+                else if (d < radius)
+                    mask |= uint8_t (1U << k);
+            }
+
+            masks [8 * i + j] = mask;
+        }
+    }
+}
+
+const kernels_t kernels = {
+    translate, transform, normalize, dot, cross, bounds,
+    transform_blocks, bounds_blocks, classify_blocks
+};
+
+} // namespace scalar
+
+#if defined (POF_SIMD_X86)
+
+//
+// Folds the minima and maxima of the x, y and z components found in lanes
+// of accumulators that hold the components in rotation, x y z x y z ...:
+//
+inline aabb_t
+fold_bounds (const float* lo, const float* hi, size_t n, aabb_t box) {
+    for (size_t i = 0; i < n; ++i) {
+        box.lo.value [i % 3] = min (box.lo.value [i % 3], lo [i]);
+        box.hi.value [i % 3] = max (box.hi.value [i % 3], hi [i]);
+    }
+
+    return box;
+}
+
+//
+// Bytes of eight lanes, 1 where the lane's bit is set in a movemask and 0
+// elsewhere, lane 0 in the lowest byte; shifted, they set a bit of the masks
+// of eight spheres at once:
+//
+struct lane_bytes_t {
+    uint64_t bytes [256]{ };
+
+    lane_bytes_t () {
+        for (size_t i = 0; i < 256; ++i)
+            for (size_t j = 0; j < 8; ++j)
+                if (i & (1U << j))
+                    bytes [i] |= uint64_t (1) << (8 * j);
+    }
+};
+
+const lane_bytes_t lane_bytes;
+
+inline uint64_t
+spread (int lanes, size_t bit) {
+    return lane_bytes.bytes [lanes] << bit;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+namespace sse {
+
+//
+// Four vectors, x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, to and from their
+// components:
+//
+inline void
+load3 (const float* p, __m128& x, __m128& y, __m128& z) {
+    const __m128 m0 = _mm_loadu_ps (p);
+    const __m128 m1 = _mm_loadu_ps (p + 4);
+    const __m128 m2 = _mm_loadu_ps (p + 8);
+
+    const __m128 xy = _mm_shuffle_ps (m1, m2, _MM_SHUFFLE (2, 1, 3, 2));
+    const __m128 yz = _mm_shuffle_ps (m0, m1, _MM_SHUFFLE (1, 0, 2, 1));
+
+    x = _mm_shuffle_ps (m0, xy, _MM_SHUFFLE (2, 0, 3, 0));
+    y = _mm_shuffle_ps (yz, xy, _MM_SHUFFLE (3, 1, 2, 0));
+    z = _mm_shuffle_ps (yz, m2, _MM_SHUFFLE (3, 0, 3, 1));
+}
+
+inline void
+store3 (float* p, __m128 x, __m128 y, __m128 z) {
+    const __m128 xy = _mm_shuffle_ps (x, y, _MM_SHUFFLE (2, 0, 2, 0));
+    const __m128 yz = _mm_shuffle_ps (y, z, _MM_SHUFFLE (3, 1, 3, 1));
+    const __m128 zx = _mm_shuffle_ps (z, x, _MM_SHUFFLE (3, 1, 2, 0));
+
+    _mm_storeu_ps (p,     _mm_shuffle_ps (xy, zx, _MM_SHUFFLE (2, 0, 2, 0)));
+    _mm_storeu_ps (p + 4, _mm_shuffle_ps (yz, xy, _MM_SHUFFLE (3, 1, 2, 0)));
+    _mm_storeu_ps (p + 8, _mm_shuffle_ps (zx, yz, _MM_SHUFFLE (3, 1, 3, 1)));
+}
+
+inline void
+transform (__m128 x, __m128 y, __m128 z, const transform_t& t,
+           __m128& a, __m128& b, __m128& c) {
+    __m128* out [3] = { &a, &b, &c };
+
+    for (size_t k = 0; k < 3; ++k) {
+        *out [k] = _mm_add_ps (_mm_add_ps (_mm_add_ps (
+            _mm_mul_ps (_mm_set1_ps (t.m [k][0]), x),
+            _mm_mul_ps (_mm_set1_ps (t.m [k][1]), y)),
+            _mm_mul_ps (_mm_set1_ps (t.m [k][2]), z)),
+            _mm_set1_ps (t.t.value [k]));
+    }
+}
+
+void
+translate (vector3f_t* p, size_t n, const vector3f_t& d) {
+    const float dx = d.value [0], dy = d.value [1], dz = d.value [2];
+
+    const __m128 d0 = _mm_setr_ps (dx, dy, dz, dx);
+    const __m128 d1 = _mm_setr_ps (dy, dz, dx, dy);
+    const __m128 d2 = _mm_setr_ps (dz, dx, dy, dz);
+
+    float* f = floats (p);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4, f += 12) {
+        _mm_storeu_ps (f,     _mm_add_ps (_mm_loadu_ps (f),     d0));
+        _mm_storeu_ps (f + 4, _mm_add_ps (_mm_loadu_ps (f + 4), d1));
+        _mm_storeu_ps (f + 8, _mm_add_ps (_mm_loadu_ps (f + 8), d2));
+    }
+
+    scalar::translate (p + i, n - i, d);
+}
+
+void
+transform (const vector3f_t* p, size_t n, const transform_t& t,
+           vector3f_t* q) {
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 x, y, z, a, b, c;
+
+        load3 (floats (p + i), x, y, z);
+        transform (x, y, z, t, a, b, c);
+        store3 (floats (q + i), a, b, c);
+    }
+
+    scalar::transform (p + i, n - i, t, q + i);
+}
+
+void
+normalize (vector3f_t* p, size_t n) {
+    const __m128 zero = _mm_setzero_ps (), one = _mm_set1_ps (1.f);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 x, y, z;
+        load3 (floats (p + i), x, y, z);
+
+        const __m128 len = _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (
+            _mm_mul_ps (x, x), _mm_mul_ps (y, y)), _mm_mul_ps (z, z)));
+
+        const __m128 mask = _mm_cmplt_ps (zero, len);
+        const __m128 r = _mm_and_ps (mask, _mm_div_ps (one, len));
+
+        //
+        // Null vectors are kept as they are:
+        //
+        const __m128 keep = _mm_andnot_ps (mask, one);
+
+        store3 (floats (p + i),
+                _mm_add_ps (_mm_mul_ps (x, r), _mm_mul_ps (x, keep)),
+                _mm_add_ps (_mm_mul_ps (y, r), _mm_mul_ps (y, keep)),
+                _mm_add_ps (_mm_mul_ps (z, r), _mm_mul_ps (z, keep)));
+    }
+
+    scalar::normalize (p + i, n - i);
+}
+
+void
+dot (const vector3f_t* a, size_t n, const vector3f_t* b, float* q) {
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 ax, ay, az, bx, by, bz;
+
+        load3 (floats (a + i), ax, ay, az);
+        load3 (floats (b + i), bx, by, bz);
+
+        _mm_storeu_ps (q + i, _mm_add_ps (_mm_add_ps (
+            _mm_mul_ps (ax, bx), _mm_mul_ps (ay, by)), _mm_mul_ps (az, bz)));
+    }
+
+    scalar::dot (a + i, n - i, b + i, q + i);
+}
+
+void
+cross (const vector3f_t* a, size_t n, const vector3f_t* b, vector3f_t* q) {
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 ax, ay, az, bx, by, bz;
+
+        load3 (floats (a + i), ax, ay, az);
+        load3 (floats (b + i), bx, by, bz);
+
+        store3 (floats (q + i),
+                _mm_sub_ps (_mm_mul_ps (ay, bz), _mm_mul_ps (az, by)),
+                _mm_sub_ps (_mm_mul_ps (az, bx), _mm_mul_ps (ax, bz)),
+                _mm_sub_ps (_mm_mul_ps (ax, by), _mm_mul_ps (ay, bx)));
+    }
+
+    scalar::cross (a + i, n - i, b + i, q + i);
+}
+
+aabb_t
+bounds (const vector3f_t* p, size_t n) {
+    __m128 lo [3], hi [3];
+
+    for (size_t k = 0; k < 3; ++k) {
+        lo [k] = _mm_set1_ps (HUGE_VALF);
+        hi [k] = _mm_set1_ps (-HUGE_VALF);
+    }
+
+    const float* f = floats (p);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4, f += 12) {
+        for (size_t k = 0; k < 3; ++k) {
+            const __m128 x = _mm_loadu_ps (f + 4 * k);
+
+            lo [k] = _mm_min_ps (lo [k], x);
+            hi [k] = _mm_max_ps (hi [k], x);
+        }
+    }
+
+    float l [12], h [12];
+
+    for (size_t k = 0; k < 3; ++k) {
+        _mm_storeu_ps (l + 4 * k, lo [k]);
+        _mm_storeu_ps (h + 4 * k, hi [k]);
+    }
+
+    return fold_bounds (l, h, 12, scalar::bounds (p + i, n - i));
+}
+
+void
+transform_blocks (const vector3f_block_t* p, size_t n, const transform_t& t,
+                  vector3f_block_t* q) {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < 8; j += 4) {
+            __m128 a, b, c;
+
+            transform (_mm_loadu_ps (p [i].x + j), _mm_loadu_ps (p [i].y + j),
+                       _mm_loadu_ps (p [i].z + j), t, a, b, c);
+
+            _mm_storeu_ps (q [i].x + j, a);
+            _mm_storeu_ps (q [i].y + j, b);
+            _mm_storeu_ps (q [i].z + j, c);
+        }
+    }
+}
+
+aabb_t
+bounds_blocks (const vector3f_block_t* p, size_t n) {
+    __m128 lo [3], hi [3];
+
+    for (size_t k = 0; k < 3; ++k) {
+        lo [k] = _mm_set1_ps (HUGE_VALF);
+        hi [k] = _mm_set1_ps (-HUGE_VALF);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const float* xs [3] = { p [i].x, p [i].y, p [i].z };
+
+        for (size_t k = 0; k < 3; ++k) {
+            for (size_t j = 0; j < 8; j += 4) {
+                const __m128 x = _mm_loadu_ps (xs [k] + j);
+
+                lo [k] = _mm_min_ps (lo [k], x);
+                hi [k] = _mm_max_ps (hi [k], x);
+            }
+        }
+    }
+
+    aabb_t box = empty_aabb ();
+
+    for (size_t k = 0; k < 3; ++k) {
+        float l [4], h [4];
+
+        _mm_storeu_ps (l, lo [k]);
+        _mm_storeu_ps (h, hi [k]);
+
+        box.lo.value [k] = min ({ l [0], l [1], l [2], l [3] });
+        box.hi.value [k] = max ({ h [0], h [1], h [2], h [3] });
+    }
+
+    return box;
+}
+
+void
+classify_blocks (const vector3f_block_t* p, size_t n, const float* r,
+                 const plane_t* planes, size_t m, uint8_t* masks) {
+    const __m128 zero = _mm_setzero_ps ();
+
+    for (size_t i = 0; i < n; ++i) {
+        int straddle [8]{ }, outside = 0;
+
+        for (size_t j = 0; j < 8; j += 4) {
+            const __m128 x = _mm_loadu_ps (p [i].x + j);
+            const __m128 y = _mm_loadu_ps (p [i].y + j);
+            const __m128 z = _mm_loadu_ps (p [i].z + j);
+
+            const __m128 radius = _mm_loadu_ps (r + 8 * i + j);
+            const __m128 neg = _mm_sub_ps (zero, radius);
+
+            for (size_t k = 0; k < m; ++k) {
+                const auto& a = planes [k];
+
+                const __m128 d = _mm_add_ps (_mm_add_ps (_mm_add_ps (
+                    _mm_mul_ps (_mm_set1_ps (a.n.value [0]), x),
+                    _mm_mul_ps (_mm_set1_ps (a.n.value [1]), y)),
+                    _mm_mul_ps (_mm_set1_ps (a.n.value [2]), z)),
+                    _mm_set1_ps (a.d));
+
+                const __m128 o = _mm_cmplt_ps (d, neg);
+
+                outside |= _mm_movemask_ps (o) << j;
+                straddle [k] |= _mm_movemask_ps (
+                    _mm_andnot_ps (o, _mm_cmplt_ps (d, radius))) << j;
+            }
+        }
+
+        uint64_t bytes = spread (outside, 7);
+
+        for (size_t k = 0; k < m; ++k)
+            bytes |= spread (straddle [k], k);
+
+        memcpy (masks + 8 * i, &bytes, sizeof bytes);
+    }
+}
+
+const kernels_t kernels = {
+    translate, transform, normalize, dot, cross, bounds,
+    transform_blocks, bounds_blocks, classify_blocks
+};
+
+} // namespace sse
+
+////////////////////////////////////////////////////////////////////////
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+
+namespace avx2 {
+
+//
+// Each kernel clears the upper halves of the registers before it returns or
+// hands the rest of the array to the SSE kernel, which the compiler does not
+// do for functions compiled for AVX2 by pragma. Left set, they slow down all
+// SSE code that runs after, in the library and out of it, e.g., sinf, many
+// times over:
+//
+
+//
+// Eight vectors, as two groups of four in the two lanes of the registers,
+// which are then shuffled as in the SSE kernels:
+//
+inline void
+load3 (const float* p, __m256& x, __m256& y, __m256& z) {
+    __m256 m03 = _mm256_castps128_ps256 (_mm_loadu_ps (p));
+    __m256 m14 = _mm256_castps128_ps256 (_mm_loadu_ps (p + 4));
+    __m256 m25 = _mm256_castps128_ps256 (_mm_loadu_ps (p + 8));
+
+    m03 = _mm256_insertf128_ps (m03, _mm_loadu_ps (p + 12), 1);
+    m14 = _mm256_insertf128_ps (m14, _mm_loadu_ps (p + 16), 1);
+    m25 = _mm256_insertf128_ps (m25, _mm_loadu_ps (p + 20), 1);
+
+    const __m256 xy = _mm256_shuffle_ps (m14, m25, _MM_SHUFFLE (2, 1, 3, 2));
+    const __m256 yz = _mm256_shuffle_ps (m03, m14, _MM_SHUFFLE (1, 0, 2, 1));
+
+    x = _mm256_shuffle_ps (m03, xy, _MM_SHUFFLE (2, 0, 3, 0));
+    y = _mm256_shuffle_ps (yz, xy, _MM_SHUFFLE (3, 1, 2, 0));
+    z = _mm256_shuffle_ps (yz, m25, _MM_SHUFFLE (3, 0, 3, 1));
+}
+
+inline void
+store3 (float* p, __m256 x, __m256 y, __m256 z) {
+    const __m256 xy = _mm256_shuffle_ps (x, y, _MM_SHUFFLE (2, 0, 2, 0));
+    const __m256 yz = _mm256_shuffle_ps (y, z, _MM_SHUFFLE (3, 1, 3, 1));
+    const __m256 zx = _mm256_shuffle_ps (z, x, _MM_SHUFFLE (3, 1, 2, 0));
+
+    const __m256 m03 = _mm256_shuffle_ps (xy, zx, _MM_SHUFFLE (2, 0, 2, 0));
+    const __m256 m14 = _mm256_shuffle_ps (yz, xy, _MM_SHUFFLE (3, 1, 2, 0));
+    const __m256 m25 = _mm256_shuffle_ps (zx, yz, _MM_SHUFFLE (3, 1, 3, 1));
+
+    _mm_storeu_ps (p,      _mm256_castps256_ps128 (m03));
+    _mm_storeu_ps (p + 4,  _mm256_castps256_ps128 (m14));
+    _mm_storeu_ps (p + 8,  _mm256_castps256_ps128 (m25));
+    _mm_storeu_ps (p + 12, _mm256_extractf128_ps (m03, 1));
+    _mm_storeu_ps (p + 16, _mm256_extractf128_ps (m14, 1));
+    _mm_storeu_ps (p + 20, _mm256_extractf128_ps (m25, 1));
+}
+
+inline void
+transform (__m256 x, __m256 y, __m256 z, const transform_t& t,
+           __m256& a, __m256& b, __m256& c) {
+    __m256* out [3] = { &a, &b, &c };
+
+    for (size_t k = 0; k < 3; ++k) {
+        *out [k] = _mm256_add_ps (_mm256_add_ps (_mm256_add_ps (
+            _mm256_mul_ps (_mm256_set1_ps (t.m [k][0]), x),
+            _mm256_mul_ps (_mm256_set1_ps (t.m [k][1]), y)),
+            _mm256_mul_ps (_mm256_set1_ps (t.m [k][2]), z)),
+            _mm256_set1_ps (t.t.value [k]));
+    }
+}
+
+void
+translate (vector3f_t* p, size_t n, const vector3f_t& d) {
+    const float dx = d.value [0], dy = d.value [1], dz = d.value [2];
+
+    const __m256 d0 = _mm256_setr_ps (dx, dy, dz, dx, dy, dz, dx, dy);
+    const __m256 d1 = _mm256_setr_ps (dz, dx, dy, dz, dx, dy, dz, dx);
+    const __m256 d2 = _mm256_setr_ps (dy, dz, dx, dy, dz, dx, dy, dz);
+
+    float* f = floats (p);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8, f += 24) {
+        _mm256_storeu_ps (f,      _mm256_add_ps (_mm256_loadu_ps (f),      d0));
+        _mm256_storeu_ps (f + 8,  _mm256_add_ps (_mm256_loadu_ps (f + 8),  d1));
+        _mm256_storeu_ps (f + 16, _mm256_add_ps (_mm256_loadu_ps (f + 16), d2));
+    }
+
+    _mm256_zeroupper ();
+    sse::translate (p + i, n - i, d);
+}
+
+void
+transform (const vector3f_t* p, size_t n, const transform_t& t,
+           vector3f_t* q) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 x, y, z, a, b, c;
+
+        load3 (floats (p + i), x, y, z);
+        transform (x, y, z, t, a, b, c);
+        store3 (floats (q + i), a, b, c);
+    }
+
+    _mm256_zeroupper ();
+    sse::transform (p + i, n - i, t, q + i);
+}
+
+void
+normalize (vector3f_t* p, size_t n) {
+    const __m256 zero = _mm256_setzero_ps (), one = _mm256_set1_ps (1.f);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 x, y, z;
+        load3 (floats (p + i), x, y, z);
+
+        const __m256 len = _mm256_sqrt_ps (_mm256_add_ps (_mm256_add_ps (
+            _mm256_mul_ps (x, x), _mm256_mul_ps (y, y)),
+            _mm256_mul_ps (z, z)));
+
+        const __m256 mask = _mm256_cmp_ps (zero, len, _CMP_LT_OQ);
+        const __m256 r = _mm256_and_ps (mask, _mm256_div_ps (one, len));
+        const __m256 keep = _mm256_andnot_ps (mask, one);
+
+        store3 (floats (p + i),
+                _mm256_add_ps (_mm256_mul_ps (x, r), _mm256_mul_ps (x, keep)),
+                _mm256_add_ps (_mm256_mul_ps (y, r), _mm256_mul_ps (y, keep)),
+                _mm256_add_ps (_mm256_mul_ps (z, r), _mm256_mul_ps (z, keep)));
+    }
+
+    _mm256_zeroupper ();
+    sse::normalize (p + i, n - i);
+}
+
+void
+dot (const vector3f_t* a, size_t n, const vector3f_t* b, float* q) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 ax, ay, az, bx, by, bz;
+
+        load3 (floats (a + i), ax, ay, az);
+        load3 (floats (b + i), bx, by, bz);
+
+        _mm256_storeu_ps (q + i, _mm256_add_ps (_mm256_add_ps (
+            _mm256_mul_ps (ax, bx), _mm256_mul_ps (ay, by)),
+            _mm256_mul_ps (az, bz)));
+    }
+
+    _mm256_zeroupper ();
+    sse::dot (a + i, n - i, b + i, q + i);
+}
+
+void
+cross (const vector3f_t* a, size_t n, const vector3f_t* b, vector3f_t* q) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 ax, ay, az, bx, by, bz;
+
+        load3 (floats (a + i), ax, ay, az);
+        load3 (floats (b + i), bx, by, bz);
+
+        store3 (floats (q + i),
+                _mm256_sub_ps (_mm256_mul_ps (ay, bz), _mm256_mul_ps (az, by)),
+                _mm256_sub_ps (_mm256_mul_ps (az, bx), _mm256_mul_ps (ax, bz)),
+                _mm256_sub_ps (_mm256_mul_ps (ax, by), _mm256_mul_ps (ay, bx)));
+    }
+
+    _mm256_zeroupper ();
+    sse::cross (a + i, n - i, b + i, q + i);
+}
+
+aabb_t
+bounds (const vector3f_t* p, size_t n) {
+    __m256 lo [3], hi [3];
+
+    for (size_t k = 0; k < 3; ++k) {
+        lo [k] = _mm256_set1_ps (HUGE_VALF);
+        hi [k] = _mm256_set1_ps (-HUGE_VALF);
+    }
+
+    const float* f = floats (p);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8, f += 24) {
+        for (size_t k = 0; k < 3; ++k) {
+            const __m256 x = _mm256_loadu_ps (f + 8 * k);
+
+            lo [k] = _mm256_min_ps (lo [k], x);
+            hi [k] = _mm256_max_ps (hi [k], x);
+        }
+    }
+
+    float l [24], h [24];
+
+    for (size_t k = 0; k < 3; ++k) {
+        _mm256_storeu_ps (l + 8 * k, lo [k]);
+        _mm256_storeu_ps (h + 8 * k, hi [k]);
+    }
+
+    _mm256_zeroupper ();
+
+    return fold_bounds (l, h, 24, sse::bounds (p + i, n - i));
+}
+
+void
+transform_blocks (const vector3f_block_t* p, size_t n, const transform_t& t,
+                  vector3f_block_t* q) {
+    for (size_t i = 0; i < n; ++i) {
+        __m256 a, b, c;
+
+        transform (_mm256_loadu_ps (p [i].x), _mm256_loadu_ps (p [i].y),
+                   _mm256_loadu_ps (p [i].z), t, a, b, c);
+
+        _mm256_storeu_ps (q [i].x, a);
+        _mm256_storeu_ps (q [i].y, b);
+        _mm256_storeu_ps (q [i].z, c);
+    }
+
+    _mm256_zeroupper ();
+}
+
+aabb_t
+bounds_blocks (const vector3f_block_t* p, size_t n) {
+    __m256 lo [3], hi [3];
+
+    for (size_t k = 0; k < 3; ++k) {
+        lo [k] = _mm256_set1_ps (HUGE_VALF);
+        hi [k] = _mm256_set1_ps (-HUGE_VALF);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const float* xs [3] = { p [i].x, p [i].y, p [i].z };
+
+        for (size_t k = 0; k < 3; ++k) {
+            const __m256 x = _mm256_loadu_ps (xs [k]);
+
+            lo [k] = _mm256_min_ps (lo [k], x);
+            hi [k] = _mm256_max_ps (hi [k], x);
+        }
+    }
+
+    aabb_t box = empty_aabb ();
+
+    for (size_t k = 0; k < 3; ++k) {
+        float l [8], h [8];
+
+        _mm256_storeu_ps (l, lo [k]);
+        _mm256_storeu_ps (h, hi [k]);
+
+        for (size_t j = 0; j < 8; ++j) {
+            box.lo.value [k] = min (box.lo.value [k], l [j]);
+            box.hi.value [k] = max (box.hi.value [k], h [j]);
+        }
+    }
+
+    _mm256_zeroupper ();
+
+    return box;
+}
+
+void
+classify_blocks (const vector3f_block_t* p, size_t n, const float* r,
+                 const plane_t* planes, size_t m, uint8_t* masks) {
+    const __m256 zero = _mm256_setzero_ps ();
+
+    for (size_t i = 0; i < n; ++i) {
+        const __m256 x = _mm256_loadu_ps (p [i].x);
+        const __m256 y = _mm256_loadu_ps (p [i].y);
+        const __m256 z = _mm256_loadu_ps (p [i].z);
+
+        const __m256 radius = _mm256_loadu_ps (r + 8 * i);
+        const __m256 neg = _mm256_sub_ps (zero, radius);
+
+        int outside = 0;
+        uint64_t bytes = 0;
+
+        for (size_t k = 0; k < m; ++k) {
+            const auto& a = planes [k];
+
+            const __m256 d = _mm256_add_ps (_mm256_add_ps (_mm256_add_ps (
+                _mm256_mul_ps (_mm256_set1_ps (a.n.value [0]), x),
+                _mm256_mul_ps (_mm256_set1_ps (a.n.value [1]), y)),
+                _mm256_mul_ps (_mm256_set1_ps (a.n.value [2]), z)),
+                _mm256_set1_ps (a.d));
+
+            const __m256 o = _mm256_cmp_ps (d, neg, _CMP_LT_OQ);
+
+            outside |= _mm256_movemask_ps (o);
+            bytes |= spread (_mm256_movemask_ps (_mm256_andnot_ps (
+                o, _mm256_cmp_ps (d, radius, _CMP_LT_OQ))), k);
+        }
+
+        bytes |= spread (outside, 7);
+        memcpy (masks + 8 * i, &bytes, sizeof bytes);
+    }
+
+    _mm256_zeroupper ();
+}
+
+const kernels_t kernels = {
+    translate, transform, normalize, dot, cross, bounds,
+    transform_blocks, bounds_blocks, classify_blocks
+};
+
+} // namespace avx2
+
+#pragma GCC pop_options
+
+#endif // POF_SIMD_X86
+
+////////////////////////////////////////////////////////////////////////
+
+const kernels_t* const implementations [] = {
+    &scalar::kernels,
+#if defined (POF_SIMD_X86)
+    &sse::kernels, &avx2::kernels
+#endif // POF_SIMD_X86
+};
+
+simd_level_t
+detect () {
+#if defined (POF_SIMD_X86)
+    __builtin_cpu_init ();
+
+    if (__builtin_cpu_supports ("avx2"))
+        return SIMD_AVX2;
+
+    if (__builtin_cpu_supports ("sse2"))
+        return SIMD_SSE;
+#endif // POF_SIMD_X86
+
+    return SIMD_SCALAR;
+}
+
+const simd_level_t supported = detect ();
+atomic< int > selected{ supported };
+
+inline const kernels_t&
+kernels () {
+    return *implementations [selected.load (memory_order_relaxed)];
+}
+
+} // anonymous namespace
+
+simd_level_t
+simd_level () {
+    return simd_level_t (selected.load ());
+}
+
+simd_level_t
+simd_supported () {
+    return supported;
+}
+
+simd_level_t
+simd_select (simd_level_t level) {
+    if (level > supported)
+        level = supported;
+
+    selected = level;
+    return level;
+}
+
+const char*
+simd_name (simd_level_t level) {
+    static const char* names [] = { "scalar", "sse", "avx2" };
+    return names [level];
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void
+translate (span_t< vector3f_t > xs, const vector3f_t& d) {
+    kernels ().translate (xs.first, xs.size (), d);
+}
+
+void
+transform (span_t< const vector3f_t > xs, const transform_t& t,
+           vector3f_t* out) {
+    kernels ().transform (xs.first, xs.size (), t, out);
+}
+
+void
+normalize (span_t< vector3f_t > xs) {
+    kernels ().normalize (xs.first, xs.size ());
+}
+
+void
+dot (span_t< const vector3f_t > xs, const vector3f_t* ys, float* out) {
+    kernels ().dot (xs.first, xs.size (), ys, out);
+}
+
+void
+cross (span_t< const vector3f_t > xs, const vector3f_t* ys,
+       vector3f_t* out) {
+    kernels ().cross (xs.first, xs.size (), ys, out);
+}
+
+aabb_t
+bounds (span_t< const vector3f_t > xs) {
+    return kernels ().bounds (xs.first, xs.size ());
+}
+
+void
+pack (span_t< const vector3f_t > xs, vector3f_block_t* out) {
+    const size_t n = xs.size ();
+
+    for (size_t i = 0; i < blocks_for (n); ++i) {
+        for (size_t j = 0; j < 8; ++j) {
+            const auto& x = xs [min (8 * i + j, n - 1)];
+
+            out [i].x [j] = x.value [0];
+            out [i].y [j] = x.value [1];
+            out [i].z [j] = x.value [2];
+        }
+    }
+}
+
+void
+unpack (const vector3f_block_t* xs, size_t n, vector3f_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const auto& block = xs [i / 8];
+        out [i] = { { block.x [i % 8], block.y [i % 8], block.z [i % 8] } };
+    }
+}
+
+void
+transform (span_t< const vector3f_block_t > xs, const transform_t& t,
+           vector3f_block_t* out) {
+    kernels ().transform_blocks (xs.first, xs.size (), t, out);
+}
+
+aabb_t
+bounds (span_t< const vector3f_block_t > xs) {
+    return kernels ().bounds_blocks (xs.first, xs.size ());
+}
+
+void
+classify (span_t< const vector3f_block_t > xs, const float* radii,
+          span_t< const plane_t > planes, uint8_t* out) {
+    kernels ().classify_blocks (xs.first, xs.size (), radii, planes.first,
+                                min (planes.size (), size_t (7)), out);
+}
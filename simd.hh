@@ -0,0 +1,105 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_SIMD_HH
+#define POF_SIMD_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include "span.hh"
+#include "vector.hh"
+
+//
+// Batched math over arrays of vectors. Each kernel has a scalar, an SSE and
+// an AVX2 implementation; the widest the processor supports is chosen when
+// the library is loaded, and simd_select can force a narrower one, e.g., to
+// compare them. All implementations do the same operations in the same order
+// and give identical results:
+//
+enum simd_level_t { SIMD_SCALAR, SIMD_SSE, SIMD_AVX2 };
+
+simd_level_t simd_level ();
+simd_level_t simd_supported ();
+
+//
+// Selects an implementation, the widest supported if the one asked for is
+// not, and returns the one selected:
+//
+simd_level_t simd_select (simd_level_t);
+
+const char* simd_name (simd_level_t);
+
+struct aabb_t {
+    vector3f_t lo, hi;
+};
+
+//
+// Affine transform, p' = m p + t:
+//
+struct transform_t {
+    float m [3][3];
+    vector3f_t t;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Kernels over arrays of vectors, the layout of the model. Destinations may
+// be the sources; other overlaps are not allowed:
+//
+void translate (span_t< vector3f_t >, const vector3f_t&);
+void transform (span_t< const vector3f_t >, const transform_t&, vector3f_t*);
+void normalize (span_t< vector3f_t >);
+
+void dot (span_t< const vector3f_t >, const vector3f_t*, float*);
+void cross (span_t< const vector3f_t >, const vector3f_t*, vector3f_t*);
+
+//
+// Bounds of the vectors, inverted (lo > hi) for an empty span:
+//
+aabb_t bounds (span_t< const vector3f_t >);
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Blocks of eight vectors, by component, for kernels that stream over many
+// vectors; the last block of an array is padded with copies of its last
+// vector:
+//
+struct vector3f_block_t {
+    float x [8], y [8], z [8];
+};
+
+inline size_t
+blocks_for (size_t n) {
+    return (n + 7) / 8;
+}
+
+void pack (span_t< const vector3f_t >, vector3f_block_t*);
+void unpack (const vector3f_block_t*, size_t, vector3f_t*);
+
+void transform (span_t< const vector3f_block_t >, const transform_t&,
+                vector3f_block_t*);
+
+aabb_t bounds (span_t< const vector3f_block_t >);
+
+//
+// Plane n x + d = 0, with the inside where n x + d is positive:
+//
+struct plane_t {
+    vector3f_t n;
+    float d;
+};
+
+#define SPHERE_OUTSIDE 0x80 // mask of a sphere wholly outside a plane
+
+//
+// Classifies spheres against up to seven planes: centers in blocks and radii
+// as many, eight to a block, to a mask for each sphere with bit k set if the
+// sphere straddles plane k, and SPHERE_OUTSIDE set if it is wholly outside
+// any plane:
+//
+void classify (span_t< const vector3f_block_t >, const float*,
+               span_t< const plane_t >, uint8_t*);
+
+#endif // POF_SIMD_HH
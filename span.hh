@@ -0,0 +1,24 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_SPAN_HH
+#define POF_SPAN_HH
+
+#include <cstddef>
+
+//
+// Non-owning view of a contiguous range of objects:
+//
+template< typename T >
+struct span_t {
+    T *first, *last;
+
+    T* begin () const { return first; }
+    T* end () const { return last; }
+
+    size_t size () const { return size_t (last - first); }
+    bool empty () const { return first == last; }
+
+    T& operator[] (size_t i) const { return first [i]; }
+};
+
+#endif // POF_SPAN_HH
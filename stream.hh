@@ -3,16 +3,47 @@
 #ifndef POF_STREAM_HH
 #define POF_STREAM_HH
 
+#include <type_traits>
+
+#include "endian.hh"
+#include "span.hh"
 #include "util.hh"
 #include "vector.hh"
 
+//
+// Scalars, and vectors of them, are little-endian in the stream:
+//
 template< typename T >
 inline istream&
 read (istream& s, T& t, size_t n = sizeof (T)) {
     t = T{ };
-    return s.read (reinterpret_cast< char* > (&t), n);
+    s.read (reinterpret_cast< char* > (&t), n);
+
+    if constexpr (is_bulk_v< T >)
+        t = from_little (t);
+
+    return s;
 }
 
+//
+// Reads an array of arithmetic types, or of vectors of them, in one go:
+//
+template< typename T >
+inline istream&
+read (istream& s, span_t< T > xs) {
+    static_assert (is_bulk_v< T >, "read: not an arithmetic type");
+
+    s.read (reinterpret_cast< char* > (xs.first),
+            streamsize (xs.size () * sizeof (T)));
+
+    return from_little (xs), s;
+}
+
+//
+// Strings are stored as a length and as many characters, NULs included; the
+// characters in x and the NULs are dropped. The characters are read in one go
+// into the end of the buffer or string:
+//
 static inline istream&
 read (istream& s, char* pbuf, streamsize len, const char* x = "") {
     int n = 0;
@@ -20,32 +51,30 @@ read (istream& s, char* pbuf, streamsize len, const char* x = "") {
     ASSERT (read (s, n));
     ASSERT (0 < n);
 
-    char c = 0;
-    streamsize j = 0;
+    string buf (size_t (n), 0);
+    s.read (&buf [0], n);
 
-    for (streamsize i = 0; i < n && j < len; ++i) {
-        ASSERT (read (s, c));
+    const size_t j = min (
+        size_t (len), compact_string (&buf [0], size_t (s.gcount ()), x));
 
-        if (c && !in_set (c, x))
-            pbuf [j++] = c;
-    }
-
-    return pbuf [j] = 0, s;
+    return memcpy (pbuf, buf.data (), j), pbuf [j] = 0, s;
 }
 
-static inline istream&
-read (istream& s, string& str, const char* x = "") {
+template< typename Traits, typename Alloc >
+inline istream&
+read (istream& s, basic_string< char, Traits, Alloc >& str,
+      const char* x = "") {
     int n = 0;
 
     ASSERT (read (s, n));
     ASSERT (0 < n);
 
-    char c = 0;
+    const size_t at = str.size ();
 
-    for (size_t i = 0; i < size_t (n) && read (s, c); ++i) {
-        if (c && !in_set (c, x))
-            str += c;
-    }
+    str.resize (at + size_t (n));
+    s.read (&str [at], n);
+
+    str.resize (at + compact_string (&str [at], size_t (s.gcount ()), x));
 
     return s;
 }
@@ -53,22 +82,29 @@ read (istream& s, string& str, const char* x = "") {
 template< typename T, size_t N >
 inline istream&
 read (istream& s, vector_t< T, N >& v) {
-    for (size_t i = 0; i < N; ++i)
-        ASSERT (read (s, v.value [i]));
-    return s;
+    return read (s, span_t< T >{ v.value, v.value + N });
 }
 
-template< typename T >
+template< typename T, typename Alloc >
 inline istream&
-read (istream& s, vector< T >& xs) {
-    for (auto& x : xs) ASSERT (read (s, x));
+read (istream& s, vector< T, Alloc >& xs) {
+    if constexpr (is_bulk_v< T >)
+        read (s, span_t< T >{ xs.data (), xs.data () + xs.size () });
+    else
+        for (auto& x : xs) ASSERT (read (s, x));
+
     return s;
 }
 
 template< typename T >
 inline ostream&
 write (ostream& s, const T& t, size_t n = sizeof (T)) {
-    return s.write (reinterpret_cast< const char* > (&t), n);
+    if constexpr (is_bulk_v< T >) {
+        const T x = to_little (t);
+        return s.write (reinterpret_cast< const char* > (&x), n);
+    }
+    else
+        return s.write (reinterpret_cast< const char* > (&t), n);
 }
 
 template< typename T >
@@ -0,0 +1,850 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <boost/endian/conversion.hpp>
+using namespace boost::endian;
+
+#include "assert.hh"
+#include "pof.hh"
+#include "stream.hh"
+#include "synth.hh"
+#include "vector.hh"
+
+//
+// Sizes of the BSP records, the polygons without their corners:
+//
+#define SYNTH_POINT_DEF_HEADER 20
+#define SYNTH_POLY_HEADER      44
+#define SYNTH_BSP_DEF_SIZE     80
+#define SYNTH_BOX_DEF_SIZE     32
+#define SYNTH_EOF_SIZE          8
+
+static inline void
+ensure (bool b, const char* what) {
+    if (!b)
+        throw out_of_range (what);
+}
+
+namespace {
+
+using random_t = mt19937;
+
+inline float
+uniform (random_t& g, float lo, float hi) {
+    return uniform_real_distribution< float > (lo, hi) (g);
+}
+
+inline vector3f_t
+uniform (random_t& g, float r) {
+    return { { uniform (g, -r, r), uniform (g, -r, r), uniform (g, -r, r) } };
+}
+
+inline ostream&
+write_int (ostream& s, int x) {
+    return write (s, x);
+}
+
+inline ostream&
+write_float (ostream& s, float x) {
+    return write (s, x);
+}
+
+//
+// Strings are stored with their terminating NUL, after their length:
+//
+inline ostream&
+write_string (ostream& s, const string& str) {
+    write_int (s, int (str.size ()) + 1);
+    return s.write (str.c_str (), streamsize (str.size ()) + 1);
+}
+
+//
+// Chunk ids are stored character by character, i.e., in big-endian order:
+//
+inline ostream&
+write_chunk (ostream& s, int id, const string& body) {
+    write_int (s, endian_reverse (id));
+    write_int (s, int (body.size ()));
+
+    return s.write (body.data (), streamsize (body.size ()));
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// Colors of the flat polygons:
+//
+const int palette [] = {
+    0xb0b0b0, 0x808890, 0x5a6470, 0x9a8060,
+    0x607850, 0x884040, 0x405880, 0xc0a040
+};
+
+//
+// A subobject's geometry: a sphere of rows of quads around the z axis, one
+// normal and one pair of texture coordinates to a vertex, its longitude and
+// latitude, so that the corners of a vertex agree.
+//
+// The quads are split evenly among the leaves of a BSP tree of the given
+// depth. The leaves under each node two levels below the root, bands of
+// latitude, make a region, and the polygons of a region share their
+// material; regions are numbered in the order they are written. Flat regions
+// take their colors from the palette, starting at shade:
+//
+struct sphere_t {
+    vector< vector3f_t > vertices;
+    vector< array< float, 2 > > uvs;
+
+    vector< array< int, 4 > > quads;
+    vector< int > regions;
+
+    int shade = 0;
+
+    struct box_t {
+        vector3f_t lo, hi;
+    };
+
+    vector< box_t > boxes;
+};
+
+//
+// Polygons [first, last) of a tree of the given depth, split in halves; a leaf
+// is a bounding box, its polygons and the end of its list. An inner node is
+// followed by the end of its list, then its front and back subtrees:
+//
+inline bool
+is_leaf (int first, int last, int depth) {
+    return 0 == depth || last - first <= 1;
+}
+
+void
+number_regions (vector< int >& regions, int first, int last, int depth,
+                int level, int& region) {
+    if (2 == level || is_leaf (first, last, depth)) {
+        fill (regions.begin () + first, regions.begin () + last, region++);
+        return;
+    }
+
+    const int mid = first + (last - first) / 2;
+
+    number_regions (regions, first, mid, depth - 1, level + 1, region);
+    number_regions (regions, mid, last, depth - 1, level + 1, region);
+}
+
+sphere_t
+make_sphere (int polys, int depth, float radius) {
+    const int columns = max (3, int (sqrt (float (polys))));
+    const int rows = (polys + columns - 1) / columns;
+
+    ensure ((rows + 1) * columns <= 32767,
+            "synth: too many vertices in a subobject");
+
+    sphere_t sphere;
+
+    for (int i = 0; i <= rows; ++i) {
+        const float a = float (M_PI) * (float (i) / rows - .5f) * .9f;
+
+        for (int j = 0; j < columns; ++j) {
+            const float b = 2 * float (M_PI) * j / columns;
+
+            sphere.vertices.push_back ({ {
+                        radius * cos (a) * cos (b),
+                        radius * cos (a) * sin (b),
+                        radius * sin (a) } });
+
+            sphere.uvs.push_back ({ float (j) / columns, float (i) / rows });
+        }
+    }
+
+    for (int k = 0; k < polys; ++k) {
+        const int i = k / columns, j = k % columns, next = (j + 1) % columns;
+
+        sphere.quads.push_back ({
+                i * columns + j, i * columns + next,
+                (i + 1) * columns + next, (i + 1) * columns + j });
+
+        auto& box = sphere.boxes.emplace_back ();
+        box.lo = box.hi = sphere.vertices [sphere.quads.back () [0]];
+
+        for (int x : sphere.quads.back ()) {
+            const auto& v = sphere.vertices [x];
+
+            for (size_t c = 0; c < 3; ++c) {
+                box.lo.value [c] = min (box.lo.value [c], v.value [c]);
+                box.hi.value [c] = max (box.hi.value [c], v.value [c]);
+            }
+        }
+    }
+
+    sphere.regions.resize (sphere.quads.size ());
+
+    int region = 0;
+    number_regions (sphere.regions, 0, polys, depth, 0, region);
+
+    return sphere;
+}
+
+//
+// Every fourth region is flat, if there are textures to map the others:
+//
+inline bool
+textured (int region, int textures) {
+    return 0 < textures && region % 4;
+}
+
+inline int
+material (const sphere_t& sphere, int region, int textures) {
+    const size_t n = sizeof palette / sizeof *palette;
+
+    return textured (region, textures)
+        ? region % textures
+        : palette [size_t (sphere.shade + region) % n];
+}
+
+inline size_t
+poly_size (int region, int textures) {
+    return SYNTH_POLY_HEADER + 4 * (textured (region, textures) ? 12 : 4);
+}
+
+size_t
+tree_size (const sphere_t& sphere, int first, int last, int depth,
+           int textures) {
+    if (is_leaf (first, last, depth)) {
+        size_t n = SYNTH_BOX_DEF_SIZE + SYNTH_EOF_SIZE;
+
+        for (int k = first; k < last; ++k)
+            n += poly_size (sphere.regions [k], textures);
+
+        return n;
+    }
+
+    const int mid = first + (last - first) / 2;
+
+    return SYNTH_BSP_DEF_SIZE + SYNTH_EOF_SIZE +
+        tree_size (sphere, first, mid, depth - 1, textures) +
+        tree_size (sphere, mid, last, depth - 1, textures);
+}
+
+sphere_t::box_t
+bounds (const sphere_t& sphere, int first, int last) {
+    sphere_t::box_t box = sphere.boxes [first];
+
+    for (int k = first + 1; k < last; ++k) {
+        for (size_t c = 0; c < 3; ++c) {
+            box.lo.value [c] = min (box.lo.value [c],
+                                    sphere.boxes [k].lo.value [c]);
+            box.hi.value [c] = max (box.hi.value [c],
+                                    sphere.boxes [k].hi.value [c]);
+        }
+    }
+
+    return box;
+}
+
+void
+write_poly (ostream& s, const sphere_t& sphere, int k, int textures) {
+    const auto& quad = sphere.quads [k];
+    const auto& v = sphere.vertices;
+
+    const int region = sphere.regions [k];
+    const bool mapped = textured (region, textures);
+
+    vector3f_t center{ };
+
+    for (int x : quad)
+        center = center + v [x] * .25f;
+
+    float radius = 0;
+
+    for (int x : quad) {
+        const vector3f_t d = v [x] - center;
+        radius = max (radius, sqrt (dot (d, d)));
+    }
+
+    const vector3f_t normal = normalize (
+        cross (v [quad [1]] - v [quad [0]], v [quad [2]] - v [quad [0]]));
+
+    write_int (s, mapped ? TEXTPOLY_DEF : FLATPOLY_DEF);
+    write_int (s, int (poly_size (region, textures)));
+
+    write (s, normal);
+    write (s, center);
+    write_float (s, radius);
+
+    write_int (s, 4);
+    write_int (s, material (sphere, region, textures));
+
+    for (int x : quad) {
+        const short i = short (x);
+
+        write (s, i);
+        write (s, i);
+
+        if (mapped) {
+            write_float (s, sphere.uvs [x][0]);
+            write_float (s, sphere.uvs [x][1]);
+        }
+    }
+}
+
+void
+write_tree (ostream& s, const sphere_t& sphere, int first, int last,
+            int depth, int textures) {
+    const auto box = bounds (sphere, first, last);
+
+    if (is_leaf (first, last, depth)) {
+        write_int (s, BOX_DEF);
+        write_int (s, SYNTH_BOX_DEF_SIZE);
+        write (s, box.lo);
+        write (s, box.hi);
+
+        for (int k = first; k < last; ++k)
+            write_poly (s, sphere, k, textures);
+
+        write_int (s, 0);
+        write_int (s, 0);
+
+        return;
+    }
+
+    const int mid = first + (last - first) / 2;
+    const size_t front = SYNTH_BSP_DEF_SIZE + SYNTH_EOF_SIZE;
+
+    write_int (s, BSP_DEF);
+    write_int (s, SYNTH_BSP_DEF_SIZE);
+
+    write (s, vector3f_t{ { 0, 0, 1 } });
+    write (s, sphere.boxes [mid].lo);
+
+    write_int (s, 0);
+    write_int (s, int (front));
+    write_int (s, int (front + tree_size (
+                           sphere, first, mid, depth - 1, textures)));
+
+    write_int (s, 0);
+    write_int (s, 0);
+    write_int (s, 0);
+
+    write (s, box.lo);
+    write (s, box.hi);
+
+    write_int (s, 0);
+    write_int (s, 0);
+
+    write_tree (s, sphere, first, mid, depth - 1, textures);
+    write_tree (s, sphere, mid, last, depth - 1, textures);
+}
+
+//
+// The vertices, each with its normal, then the tree:
+//
+string
+make_bsp (const sphere_t& sphere, int depth, int textures) {
+    ostringstream s;
+
+    const int n = int (sphere.vertices.size ());
+    const int off = (SYNTH_POINT_DEF_HEADER + n + 3) & ~3;
+
+    write_int (s, POINT_DEF);
+    write_int (s, off + 24 * n);
+    write_int (s, n);
+    write_int (s, n);
+    write_int (s, off);
+
+    for (int i = 0; i < n; ++i)
+        s.put (1);
+
+    for (int i = SYNTH_POINT_DEF_HEADER + n; i < off; ++i)
+        s.put (0);
+
+    for (const auto& v : sphere.vertices) {
+        write (s, v);
+        write (s, normalize (v));
+    }
+
+    if (sphere.quads.empty ()) {
+        write_int (s, 0);
+        write_int (s, 0);
+    }
+    else
+        write_tree (s, sphere, 0, int (sphere.quads.size ()), depth,
+                    textures);
+
+    return s.str ();
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//
+// A closed sphere of segments around the z axis and stacks between the
+// poles, its faces wound counter-clockwise seen from outside:
+//
+struct shield_t {
+    vector< vector3f_t > vertices;
+    vector< array< int, 3 > > faces;
+};
+
+shield_t
+make_shield (int faces, float radius) {
+    const int segments = max (3, int (sqrt (faces / 2.f) + .5f));
+    const int stacks = max (2, int (faces / (2.f * segments) + .5f) + 1);
+
+    shield_t shield;
+
+    shield.vertices.push_back ({ { 0, 0, radius } });
+
+    for (int i = 1; i < stacks; ++i) {
+        const float a = float (M_PI) * i / stacks;
+
+        for (int j = 0; j < segments; ++j) {
+            const float b = 2 * float (M_PI) * j / segments;
+
+            shield.vertices.push_back ({ {
+                        radius * sin (a) * cos (b),
+                        radius * sin (a) * sin (b),
+                        radius * cos (a) } });
+        }
+    }
+
+    const int south = int (shield.vertices.size ());
+    shield.vertices.push_back ({ { 0, 0, -radius } });
+
+    auto at = [=](int ring, int j) {
+        return 1 + ring * segments + (j % segments);
+    };
+
+    for (int j = 0; j < segments; ++j)
+        shield.faces.push_back ({ 0, at (0, j), at (0, j + 1) });
+
+    for (int i = 0; i + 2 < stacks; ++i) {
+        for (int j = 0; j < segments; ++j) {
+            shield.faces.push_back ({ at (i, j), at (i + 1, j),
+                                      at (i + 1, j + 1) });
+            shield.faces.push_back ({ at (i, j), at (i + 1, j + 1),
+                                      at (i, j + 1) });
+        }
+    }
+
+    for (int j = 0; j < segments; ++j)
+        shield.faces.push_back ({ south, at (stacks - 2, j + 1),
+                                  at (stacks - 2, j) });
+
+    return shield;
+}
+
+string
+make_shld (const shield_t& shield) {
+    ostringstream s;
+
+    write_int (s, int (shield.vertices.size ()));
+
+    for (const auto& v : shield.vertices)
+        write (s, v);
+
+    //
+    // The faces across each edge, by the edge's vertices:
+    //
+    map< pair< int, int >, vector< int > > edges;
+
+    for (size_t i = 0; i < shield.faces.size (); ++i) {
+        const auto& f = shield.faces [i];
+
+        for (size_t k = 0; k < 3; ++k) {
+            const int a = f [k], b = f [(k + 1) % 3];
+            edges [{ min (a, b), max (a, b) }].push_back (int (i));
+        }
+    }
+
+    write_int (s, int (shield.faces.size ()));
+
+    for (size_t i = 0; i < shield.faces.size (); ++i) {
+        const auto& f = shield.faces [i];
+        const auto& v = shield.vertices;
+
+        write (s, normalize (cross (v [f [1]] - v [f [0]],
+                                    v [f [2]] - v [f [0]])));
+
+        for (int x : f)
+            write_int (s, x);
+
+        for (size_t k = 0; k < 3; ++k) {
+            const int a = f [k], b = f [(k + 1) % 3];
+            int neighbor = -1;
+
+            for (int j : edges [{ min (a, b), max (a, b) }])
+                if (j != int (i)) neighbor = j;
+
+            write_int (s, neighbor);
+        }
+    }
+
+    return s.str ();
+}
+
+////////////////////////////////////////////////////////////////////////
+
+struct subobj_t {
+    int parent;
+    float radius;
+    vector3f_t off, inherited;
+    string bsp;
+};
+
+string
+make_hdr2 (const synth_params_t& params, const vector< subobj_t >& subobjs,
+           float radius, random_t& g) {
+    ostringstream s;
+
+    write_float (s, radius);
+    write_int (s, 0);
+    write_int (s, int (subobjs.size ()));
+
+    write (s, vector3f_t{ { -radius, -radius, -radius } });
+    write (s, vector3f_t{ {  radius,  radius,  radius } });
+
+    //
+    // One detail level, without debris:
+    //
+    write_int (s, 1);
+    write_int (s, 0);
+    write_int (s, 0);
+
+    if (params.version >= 1903) {
+        write_float (s, 100 * radius);
+        write (s, vector3f_t{ });
+
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                write_float (s, i == j ? radius : 0);
+    }
+
+    if (params.version >= 2014) {
+        write_int (s, 4);
+
+        for (int i = 0; i < 4; ++i) {
+            write_float (s, radius * (i - 1.5f) / 2);
+            write_float (s, radius * uniform (g, .25f, .5f));
+        }
+    }
+
+    if (params.version >= 2007) {
+        write_int (s, 2);
+
+        for (int type : { 1, 2 }) {
+            write (s, uniform (g, radius));
+            write_int (s, type);
+        }
+    }
+
+    return s.str ();
+}
+
+string
+make_subobj (const synth_params_t& params, const vector< subobj_t >& subobjs,
+             int i) {
+    ostringstream s;
+
+    const auto& subobj = subobjs [i];
+    const float r = subobj.radius;
+
+    write_int (s, i);
+
+    if (params.version >= 2116)
+        write_float (s, r);
+
+    write_int (s, subobj.parent);
+    write (s, subobj.off);
+
+    if (params.version < 2116)
+        write_float (s, r);
+
+    write (s, vector3f_t{ });
+    write (s, vector3f_t{ { -r, -r, -r } });
+    write (s, vector3f_t{ {  r,  r,  r } });
+
+    write_string (s, "sub" + to_string (i));
+    write_string (s, i ? "$special=subsystem" : "");
+
+    //
+    // Movement type and axis, unused:
+    //
+    write_int (s, i ? 1 : -1);
+    write_int (s, i ? 1 : -1);
+
+    write_int (s, 0);
+
+    write_int (s, int (subobj.bsp.size ()));
+    s.write (subobj.bsp.data (), streamsize (subobj.bsp.size ()));
+
+    return s.str ();
+}
+
+//
+// Gun or missile points, two to a bank, on the front of the model:
+//
+string
+make_points (int n, float radius, random_t& g) {
+    ostringstream s;
+
+    write_int (s, (n + 1) / 2);
+
+    for (int i = 0; i < n; i += 2) {
+        write_int (s, min (2, n - i));
+
+        for (int j = i; j < min (n, i + 2); ++j) {
+            auto pos = uniform (g, radius / 2);
+            pos.value [2] = radius;
+
+            write (s, pos);
+            write (s, vector3f_t{ { 0, 0, 1 } });
+        }
+    }
+
+    return s.str ();
+}
+
+string
+make_turrets (int n, int subobjs, float radius, random_t& g) {
+    ostringstream s;
+
+    write_int (s, n);
+
+    for (int i = 0; i < n; ++i) {
+        const int subobj = subobjs ? int (g () % unsigned (subobjs)) : 0;
+
+        write_int (s, subobj);
+        write_int (s, subobj);
+        write (s, vector3f_t{ { 0, 1, 0 } });
+
+        write_int (s, 2);
+
+        for (int j = 0; j < 2; ++j)
+            write (s, uniform (g, radius));
+    }
+
+    return s.str ();
+}
+
+string
+make_spcl (int turrets, float radius, random_t& g) {
+    ostringstream s;
+
+    write_int (s, turrets);
+
+    for (int i = 0; i < turrets; ++i) {
+        write_string (s, "$turret" + to_string (i));
+        write_string (s, "$special=subsystem");
+        write (s, uniform (g, radius));
+        write_float (s, radius / 8);
+    }
+
+    return s.str ();
+}
+
+string
+make_dock (int n, float radius, random_t& g) {
+    ostringstream s;
+
+    write_int (s, n);
+
+    for (int i = 0; i < n; ++i) {
+        write_string (s, "$name=dock" + to_string (i));
+
+        write_int (s, 1);
+        write_int (s, i);
+
+        write_int (s, 2);
+
+        for (int j = 0; j < 2; ++j) {
+            write (s, uniform (g, radius));
+            write (s, normalize (uniform (g, 1)));
+        }
+    }
+
+    return s.str ();
+}
+
+//
+// A path to each dock, of three vertices, the last one with a turret:
+//
+string
+make_path (int n, float radius, random_t& g) {
+    ostringstream s;
+
+    write_int (s, n);
+
+    for (int i = 0; i < n; ++i) {
+        write_string (s, "$dock" + to_string (i) + " path");
+        write_string (s, "sub0");
+
+        write_int (s, 3);
+
+        for (int j = 0; j < 3; ++j) {
+            write (s, uniform (g, 2 * radius));
+            write_float (s, radius / 4);
+
+            write_int (s, j / 2);
+
+            if (j / 2)
+                write_int (s, 0);
+        }
+    }
+
+    return s.str ();
+}
+
+string
+make_fuel (const synth_params_t& params, float radius, random_t& g) {
+    ostringstream s;
+
+    write_int (s, params.thrusters);
+
+    for (int i = 0; i < params.thrusters; ++i) {
+        write_int (s, 2);
+
+        if (params.version >= 2117)
+            write_string (s, "$engine_subsystem=engine" + to_string (i));
+
+        for (int j = 0; j < 2; ++j) {
+            auto pos = uniform (g, radius / 2);
+            pos.value [2] = -radius;
+
+            write (s, pos);
+            write (s, vector3f_t{ { 0, 0, -1 } });
+            write_float (s, radius / 16);
+        }
+    }
+
+    return s.str ();
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////
+
+ostream&
+synthesize (ostream& s, const synth_params_t& params) {
+    ensure (0 < params.subobjs, "synth: no subobjects");
+    ensure (0 <= params.depth && params.depth < 24, "synth: BSP depth");
+    ensure (0 <= params.polys, "synth: polygon count");
+    ensure (0 <= params.textures, "synth: texture count");
+    ensure (0 <= params.shield, "synth: shield size");
+    ensure (0 <= params.guns && 0 <= params.missiles &&
+            0 <= params.turrets && 0 <= params.docks &&
+            0 <= params.thrusters, "synth: weapon, dock or thruster count");
+
+    random_t g (params.seed);
+
+    //
+    // Subobjects of decreasing size, each offset within its parent:
+    //
+    vector< subobj_t > subobjs (size_t (params.subobjs));
+    float radius = 0;
+
+    for (int i = 0; i < params.subobjs; ++i) {
+        auto& subobj = subobjs [i];
+
+        if (0 == i) {
+            subobj.parent = -1;
+            subobj.radius = 50;
+        }
+        else {
+            subobj.parent = int (g () % unsigned (i));
+
+            const auto& parent = subobjs [subobj.parent];
+
+            subobj.radius = parent.radius * uniform (g, .25f, .5f);
+            subobj.off = uniform (g, parent.radius - subobj.radius);
+            subobj.inherited = parent.inherited + parent.off;
+        }
+
+        const vector3f_t at = subobj.inherited + subobj.off;
+        radius = max (radius, sqrt (dot (at, at)) + subobj.radius);
+
+        auto sphere = make_sphere (params.polys, params.depth, subobj.radius);
+        sphere.shade = i;
+
+        subobj.bsp = make_bsp (sphere, params.depth, params.textures);
+    }
+
+    write_int (s, endian_reverse (int ('PSPO')));
+    write_int (s, params.version);
+
+    write_chunk (s, 'HDR2', make_hdr2 (params, subobjs, radius, g));
+
+    {
+        ostringstream txtr;
+        write_int (txtr, params.textures);
+
+        for (int i = 0; i < params.textures; ++i)
+            write_string (txtr, "synth" + to_string (i));
+
+        write_chunk (s, 'TXTR', txtr.str ());
+    }
+
+    {
+        ostringstream pinf;
+        pinf << "synthesized by pofer" << '\0' << "seed " << params.seed
+             << '\0';
+
+        write_chunk (s, 'PINF', pinf.str ());
+    }
+
+    for (int i = 0; i < params.subobjs; ++i)
+        write_chunk (s, params.version >= 2116 ? 'OBJ2' : 'SOBJ',
+                     make_subobj (params, subobjs, i));
+
+    write_chunk (s, 'SPCL', make_spcl (params.turrets, radius, g));
+
+    write_chunk (s, 'GPNT', make_points (params.guns, radius, g));
+    write_chunk (s, 'MPNT', make_points (params.missiles, radius, g));
+
+    write_chunk (s, 'TGUN', make_turrets (
+                     params.turrets, params.subobjs, radius, g));
+    write_chunk (s, 'TMIS', make_turrets (
+                     params.turrets, params.subobjs, radius, g));
+
+    write_chunk (s, 'DOCK', make_dock (params.docks, radius, g));
+    write_chunk (s, 'FUEL', make_fuel (params, radius, g));
+
+    if (params.shield)
+        write_chunk (s, 'SHLD', make_shld (
+                         make_shield (params.shield, 1.1f * radius)));
+
+    {
+        ostringstream eye;
+
+        write_int (eye, 1);
+        write_int (eye, 0);
+        write (eye, vector3f_t{ { 0, radius / 4, radius / 2 } });
+        write (eye, vector3f_t{ { 0, 0, 1 } });
+
+        write_chunk (s, 'EYE ', eye.str ());
+    }
+
+    {
+        ostringstream acen;
+        write (acen, vector3f_t{ });
+
+        write_chunk (s, 'ACEN', acen.str ());
+    }
+
+    return write_chunk (s, 'PATH', make_path (params.docks, radius, g));
+}
+
+string
+synthesize (const synth_params_t& params) {
+    ostringstream s;
+    return synthesize (s, params), s.str ();
+}
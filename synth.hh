@@ -0,0 +1,43 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_SYNTH_HH
+#define POF_SYNTH_HH
+
+#include <iostream>
+#include <string>
+
+//
+// Shape of a synthetic model. Subobject 0 is the root of the only detail
+// level and the others hang off earlier subobjects. Each subobject is a
+// tessellated sphere of the given number of polygons in a BSP tree of the
+// given depth, the polygons split evenly among its leaves. The sphere is in
+// bands of flat or textured polygons, of one color or texture each, mapped by
+// longitude and latitude, so that only the edges of the bands are seams. The
+// shield is a closed sphere of about the given number of faces. Guns and
+// missiles are points, two to a bank; turrets are banks of each kind, two
+// barrels to a bank:
+//
+struct synth_params_t {
+    int version = 2117;
+    unsigned seed = 1;
+
+    int subobjs = 4, depth = 4, polys = 256;
+    int textures = 4;
+
+    int shield = 320;
+
+    int guns = 4, missiles = 4, turrets = 2;
+    int docks = 1, thrusters = 2;
+};
+
+//
+// Writes a synthetic model, with every chunk the decoder handles but OHDR and
+// INSG, in the layouts of the given file version. The model is the same for
+// the same parameters; throws out_of_range on parameters the format cannot
+// hold, e.g., more vertices to a subobject than polygons can refer to:
+//
+ostream& synthesize (ostream&, const synth_params_t&);
+
+string synthesize (const synth_params_t&);
+
+#endif // POF_SYNTH_HH
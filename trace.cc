@@ -0,0 +1,199 @@
+// -*- mode: c++; -*-
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <unistd.h>
+
+#include "trace.hh"
+
+#if defined (POF_TRACE)
+
+namespace {
+
+using clock_type = chrono::steady_clock;
+
+struct event_t {
+    const char* name;
+    string detail;
+    int64_t begin, end;
+};
+
+//
+// Events of one thread, appended to by the thread and drained by trace_stop.
+// The tracer shares the buffer with the thread, so that the events of a
+// thread that exits before the trace stops are kept:
+//
+struct buffer_t {
+    mutex m;
+    vector< event_t > events;
+    int tid;
+};
+
+struct tracer_t {
+    mutex m;
+    vector< shared_ptr< buffer_t > > buffers;
+    int threads = 0;
+
+    FILE* file = 0;
+    clock_type::time_point start;
+};
+
+tracer_t tracer;
+atomic< bool > enabled{ false };
+
+inline int64_t
+now () {
+    return chrono::duration_cast< chrono::nanoseconds > (
+        clock_type::now () - tracer.start).count ();
+}
+
+buffer_t&
+local_buffer () {
+    thread_local shared_ptr< buffer_t > buffer = [] {
+        auto buffer = make_shared< buffer_t > ();
+
+        lock_guard< mutex > lock (tracer.m);
+
+        buffer->tid = ++tracer.threads;
+        tracer.buffers.push_back (buffer);
+
+        return buffer;
+    } ();
+
+    return *buffer;
+}
+
+void
+write_escaped (FILE* file, const string& s) {
+    for (unsigned char c : s) {
+        if ('"' == c || '\\' == c)
+            fprintf (file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf (file, "\\u%04x", c);
+        else
+            fputc (c, file);
+    }
+}
+
+} // anonymous namespace
+
+trace_zone_t::trace_zone_t (const char* name, string detail)
+    : name (name), detail (move (detail)),
+      begin (enabled.load (memory_order_acquire) ? now () : -1)
+{ }
+
+trace_zone_t::~trace_zone_t () {
+    if (0 > begin || !enabled.load (memory_order_relaxed))
+        return;
+
+    const int64_t end = now ();
+    auto& buffer = local_buffer ();
+
+    lock_guard< mutex > lock (buffer.m);
+    buffer.events.push_back ({ name, move (detail), begin, end });
+}
+
+bool
+trace_start (const char* filename) {
+    lock_guard< mutex > lock (tracer.m);
+
+    if (tracer.file || 0 == (tracer.file = fopen (filename, "w")))
+        return false;
+
+    //
+    // Drop what zones recorded as an earlier trace stopped:
+    //
+    for (auto& buffer : tracer.buffers) {
+        lock_guard< mutex > lock (buffer->m);
+        buffer->events.clear ();
+    }
+
+    tracer.start = clock_type::now ();
+    enabled = true;
+
+    return true;
+}
+
+bool
+trace_stop () {
+    lock_guard< mutex > lock (tracer.m);
+
+    if (0 == tracer.file)
+        return true;
+
+    enabled = false;
+
+    FILE* file = tracer.file;
+    tracer.file = 0;
+
+    const int pid = int (getpid ());
+    const char* separator = "";
+
+    fprintf (file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (auto& buffer : tracer.buffers) {
+        vector< event_t > events;
+
+        {
+            lock_guard< mutex > lock (buffer->m);
+            events.swap (buffer->events);
+        }
+
+        fprintf (file, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                 "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                 separator, pid, buffer->tid, buffer->tid);
+
+        separator = ",\n";
+
+        for (const auto& event : events) {
+            fprintf (file, ",\n{\"name\":\"%s", event.name);
+
+            if (!event.detail.empty ()) {
+                fputc (' ', file);
+                write_escaped (file, event.detail);
+            }
+
+            fprintf (file, "\",\"cat\":\"pof\",\"ph\":\"X\",\"pid\":%d,"
+                     "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     pid, buffer->tid, event.begin / 1e3,
+                     (event.end - event.begin) / 1e3);
+        }
+    }
+
+    //
+    // Threads that exited have nothing more to record:
+    //
+    tracer.buffers.erase (
+        remove_if (tracer.buffers.begin (), tracer.buffers.end (),
+                   [](const auto& buffer) {
+                       return 1 == buffer.use_count ();
+                   }),
+        tracer.buffers.end ());
+
+    fprintf (file, "\n]}\n");
+
+    const bool good = !ferror (file);
+    return 0 == fclose (file) && good;
+}
+
+#else
+
+bool
+trace_start (const char*) {
+    return false;
+}
+
+bool
+trace_stop () {
+    return true;
+}
+
+#endif // POF_TRACE
@@ -0,0 +1,52 @@
+// -*- mode: c++; -*-
+
+#ifndef POF_TRACE_HH
+#define POF_TRACE_HH
+
+#include <cstdint>
+#include <string>
+
+//
+// Timeline of scoped zones, written as a Chrome trace (JSON), which both
+// chrome://tracing and Perfetto open. Zones are compiled in only when
+// POF_TRACE is defined, e.g., by make TRACE=1; otherwise TRACE_ZONE expands to
+// nothing and its arguments are not evaluated. A zone records the thread it
+// ran on, pool workers included, and an optional detail, e.g., a chunk id or
+// a file name. Zones record nothing outside of trace_start and trace_stop.
+//
+// trace_start returns false if tracing is compiled out; trace_stop writes the
+// trace, if started, and returns false if it could not. Zones still running
+// when the trace stops are left out of it:
+//
+bool trace_start (const char*);
+bool trace_stop ();
+
+#if defined (POF_TRACE)
+
+struct trace_zone_t {
+    explicit trace_zone_t (const char*, string = { });
+    ~trace_zone_t ();
+
+    trace_zone_t (const trace_zone_t&) = delete;
+    trace_zone_t& operator= (const trace_zone_t&) = delete;
+
+private:
+    const char* name;
+    string detail;
+
+    int64_t begin;
+};
+
+#  define TRACE_CONCAT_(a, b) a ## b
+#  define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#  define TRACE_ZONE(...) \
+    trace_zone_t TRACE_CONCAT (trace_zone_, __LINE__) (__VA_ARGS__)
+
+#else
+
+#  define TRACE_ZONE(...) ((void) 0)
+
+#endif // POF_TRACE
+
+#endif // POF_TRACE_HH
@@ -3,6 +3,9 @@
 #ifndef POF_UTIL_HH
 #define POF_UTIL_HH
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <string>
 
 inline bool
@@ -12,6 +15,41 @@ in_set (const char c, const char* x = "") {
     return x [0];
 }
 
+//
+// Drops the NULs, and the characters in x, from the n characters at p, in
+// place, and returns the number of characters left. Without x the characters
+// are moved a run between NULs at a time, the NULs found by memchr; a string
+// is most often a single run with a NUL, or a few, at its end:
+//
+inline size_t
+compact_string (char* p, size_t n, const char* x = "") {
+    size_t j = 0;
+
+    if (x && x [0]) {
+        for (size_t i = 0; i < n; ++i) {
+            if (p [i] && !in_set (p [i], x))
+                p [j++] = p [i];
+        }
+
+        return j;
+    }
+
+    for (char *q = p, *end = p + n; q < end;) {
+        char* nul = static_cast< char* > (memchr (q, 0, size_t (end - q)));
+
+        if (0 == nul)
+            nul = end;
+
+        if (p + j != q)
+            memmove (p + j, q, size_t (nul - q));
+
+        j += size_t (nul - q);
+        q = nul + 1;
+    }
+
+    return j;
+}
+
 inline string
 string_from (int id) {
     string s;
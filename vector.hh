@@ -3,6 +3,8 @@
 #ifndef POF_VECTOR_HH
 #define POF_VECTOR_HH
 
+#include <cmath>
+
 template< typename T, size_t N >
 struct vector_t {
     static constexpr size_t size = N;
@@ -28,6 +30,59 @@ operator+ (vector_t< T, N > lhs, const vector_t< T, N >& rhs) {
     return lhs += rhs, lhs;
 }
 
+template< typename T, size_t N >
+inline vector_t< T, N >&
+operator-= (vector_t< T, N >& lhs, const vector_t< T, N >& rhs) {
+    lhs.value [0] -= rhs.value [0];
+    lhs.value [1] -= rhs.value [1];
+    lhs.value [2] -= rhs.value [2];
+
+    return lhs;
+}
+
+template< typename T, size_t N >
+inline vector_t< T, N >
+operator- (vector_t< T, N > lhs, const vector_t< T, N >& rhs) {
+    return lhs -= rhs, lhs;
+}
+
+template< typename T, size_t N >
+inline vector_t< T, N >
+operator* (vector_t< T, N > lhs, T x) {
+    lhs.value [0] *= x;
+    lhs.value [1] *= x;
+    lhs.value [2] *= x;
+
+    return lhs;
+}
+
+template< typename T, size_t N >
+inline T
+dot (const vector_t< T, N >& lhs, const vector_t< T, N >& rhs) {
+    return lhs.value [0] * rhs.value [0] + lhs.value [1] * rhs.value [1] +
+        lhs.value [2] * rhs.value [2];
+}
+
+template< typename T >
+inline vector_t< T, 3 >
+cross (const vector_t< T, 3 >& lhs, const vector_t< T, 3 >& rhs) {
+    return { {
+        lhs.value [1] * rhs.value [2] - lhs.value [2] * rhs.value [1],
+        lhs.value [2] * rhs.value [0] - lhs.value [0] * rhs.value [2],
+        lhs.value [0] * rhs.value [1] - lhs.value [1] * rhs.value [0]
+    } };
+}
+
+//
+// Unit vector along x, or x itself if it is null:
+//
+template< typename T, size_t N >
+inline vector_t< T, N >
+normalize (const vector_t< T, N >& x) {
+    const T n = sqrt (dot (x, x));
+    return 0 < n ? x * (T (1) / n) : x;
+}
+
 using point3i_t = vector_t< int, 3 >;
 using point3f_t = vector_t< float, 3 >;
 